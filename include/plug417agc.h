@@ -0,0 +1,73 @@
+/*
+ * PLUG417 host side automatic gain control, Y16 to 8 bit display
+ */
+#ifndef _PLUG417_AGC_H_
+#define _PLUG417_AGC_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "plug417serial.h"
+#include "plug417video.h"
+
+#define PLUG417_AGC_BINS		4096
+#define PLUG417_AGC_LUT_SIZE		65536
+
+/* Clip limit of platform equalization in mean counts of used bins */
+#define PLUG417_AGC_PLATEAU		2
+
+/*
+ * As the dimming fields of the algorithm control page. Throw points are
+ * in 0.1 percent of the pixels, brightness and contrast neutral at 50,
+ * hybrid is the percent of platform mapping blended into linear.
+ */
+struct plug417_agc_settings {
+	unsigned int mode;		/* PLUG417_ALGORITHM_DIMMING_MODE_* */
+	unsigned int upper;
+	unsigned int lower;
+	unsigned int brightness;
+	unsigned int contrast;
+	unsigned int hybrid;
+	unsigned int smoothing;		/* percent of the previous mapping kept */
+};
+
+struct plug417_agc {
+	struct plug417_agc_settings settings;
+	int primed;
+	int base;
+	unsigned int shift;
+	unsigned int bins;
+	uint32_t total;
+	float lo;
+	float hi;
+	uint32_t hist[4][PLUG417_AGC_BINS] __attribute__((aligned(64)));
+	float curve[PLUG417_AGC_LUT_SIZE] __attribute__((aligned(64)));
+	uint8_t lut[PLUG417_AGC_LUT_SIZE] __attribute__((aligned(64)));	/* indexed by Y16 as unsigned */
+};
+
+struct plug417_agc *plug417_agc_alloc(const struct plug417_agc_settings *settings);
+
+void plug417_agc_free(struct plug417_agc *a);
+
+int plug417_agc_set(struct plug417_agc *a, const struct plug417_agc_settings *settings);
+
+int plug417_agc_from_page(struct plug417_agc *a,
+		const struct plug417_alorithm_control_page_1 *page);
+
+void plug417_agc_reset(struct plug417_agc *a);
+
+int plug417_agc_update(struct plug417_agc *a, const struct plug417_video_frame *f);
+
+int plug417_agc_map(const struct plug417_agc *a, const struct plug417_video_frame *f,
+		uint8_t *out, unsigned int out_stride);
+
+int plug417_agc_process(void *arg, struct plug417_video_frame *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,80 @@
+/*
+ * PLUG417 host side temperature alarms
+ */
+#ifndef _PLUG417_ALARM_H_
+#define _PLUG417_ALARM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "plug417video.h"
+#include "plug417area.h"
+
+#define PLUG417_ALARM_MAX		0	/* hottest point above threshold */
+#define PLUG417_ALARM_MIN		1	/* coldest point below threshold */
+#define PLUG417_ALARM_MEAN		2	/* mean above threshold */
+#define PLUG417_ALARM_ISOTHERM		3	/* pixels within band above threshold */
+#define PLUG417_ALARM_RISE		4	/* hottest point rise, Y16 per second */
+#define PLUG417_ALARM_TYPE_MAX		PLUG417_ALARM_RISE
+
+struct plug417_alarm_event {
+	unsigned int rule;
+	int active;
+	int32_t value;
+	unsigned int x;
+	unsigned int y;
+	uint32_t sequence;
+	uint64_t timestamp;
+};
+
+typedef void (*plug417_alarm_callback)(void *arg, const struct plug417_alarm_event *ev);
+
+/*
+ * Alarm is raised past threshold and cleared hysteresis back from it,
+ * either change needs debounce consecutive frames
+ */
+struct plug417_alarm_rule {
+	int type;
+	struct plug417_roi roi;
+	int32_t threshold;
+	int32_t hysteresis;
+	int16_t band_lo;
+	int16_t band_hi;
+	unsigned int debounce;
+	plug417_alarm_callback callback;
+	void *arg;
+
+	/* State */
+	int active;
+	unsigned int pending;
+	int32_t value;
+	int16_t last_hottest;
+	uint64_t last_timestamp;
+};
+
+struct plug417_alarm {
+	struct plug417_area_engine *area;
+	unsigned int count;
+	unsigned int size;
+	struct plug417_alarm_rule *rules;
+	struct plug417_area *areas;
+	struct plug417_area_result *results;
+};
+
+struct plug417_alarm *plug417_alarm_alloc(unsigned int width, unsigned int height,
+		unsigned int rules);
+
+void plug417_alarm_free(struct plug417_alarm *a);
+
+int plug417_alarm_add(struct plug417_alarm *a, const struct plug417_alarm_rule *rule);
+
+int plug417_alarm_process(struct plug417_alarm *a, const struct plug417_video_frame *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * PLUG417 host side area analysis
+ */
+#ifndef _PLUG417_AREA_H_
+#define _PLUG417_AREA_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "plug417serial.h"
+#include "plug417video.h"
+
+#define PLUG417_AREA_BLOCK		16
+
+struct plug417_area {
+	struct plug417_roi roi;
+	int alarm;
+	int16_t alarm_threshold;
+};
+
+/*
+ * Same content as struct plug417_area_analysis_page, host order
+ */
+struct plug417_area_result {
+	unsigned int coldest_x;
+	unsigned int coldest_y;
+	int16_t coldest_y16;
+	unsigned int hottest_x;
+	unsigned int hottest_y;
+	int16_t hottest_y16;
+	unsigned int cursor_x;
+	unsigned int cursor_y;
+	int16_t cursor_y16;
+	int16_t regional_y16;
+	unsigned int count;
+	int exceeds;
+};
+
+/*
+ * Summed area table and block minimum/maximum of the last frame
+ */
+struct plug417_area_engine {
+	unsigned int width;
+	unsigned int height;
+	unsigned int blocks_x;
+	unsigned int blocks_y;
+	const struct plug417_video_frame *frame;
+	int64_t *sat;
+	int16_t *block_min;
+	int16_t *block_max;
+};
+
+struct plug417_area_engine *plug417_area_alloc(unsigned int width, unsigned int height);
+
+void plug417_area_free(struct plug417_area_engine *e);
+
+int plug417_area_update(struct plug417_area_engine *e, const struct plug417_video_frame *f);
+
+int plug417_area_analyze(struct plug417_area_engine *e, const struct plug417_area *areas,
+		struct plug417_area_result *results, unsigned int count);
+
+void plug417_area_to_page(const struct plug417_area *a, const struct plug417_area_result *r,
+		struct plug417_area_analysis_page *page);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
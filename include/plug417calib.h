@@ -0,0 +1,100 @@
+/*
+ * PLUG417 blackbody calibration
+ */
+#ifndef _PLUG417_CALIB_H_
+#define _PLUG417_CALIB_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "plug417serial.h"
+#include "plug417video.h"
+#include "plug417format.h"
+
+#define PLUG417_CALIB_POINTS_MAX	32
+#define PLUG417_CALIB_SETTINGS_MAX	16
+#define PLUG417_CALIB_RANGES		2	/* -20~150 (0), -20~800 (1) */
+
+/* Frames dropped after a setting or blackbody change */
+#define PLUG417_CALIB_SKIP		8
+
+/*
+ * One blackbody temperature, Y16 averaged over the ROI and the frames
+ */
+struct plug417_calib_point {
+	int16_t reference;	/* blackbody, 0.1°C */
+	unsigned int range;
+	unsigned int frames;
+	double sum;
+	double sum2;
+	double mean;
+	double noise;		/* temporal standard deviation of the ROI mean */
+};
+
+/*
+ * reference = gain * Y16 + offset. The sensor only takes a constant
+ * correction, shift is the best one for the points of the range.
+ */
+struct plug417_calib_fit {
+	unsigned int points;
+	double gain;
+	double offset;
+	double shift;
+	double residual;	/* largest error of the linear fit, 0.1°C */
+	double residual_shift;	/* same with the sensor correction */
+};
+
+/*
+ * Blackbody control, returns once the blackbody settled at reference
+ */
+typedef int (*plug417_calib_blackbody)(void *arg, int16_t reference);
+
+struct plug417_calib {
+	struct plug417_roi roi;
+	int whole;		/* no roi given */
+	unsigned int frames;
+	unsigned int skip;
+	unsigned int count;
+	unsigned int current;
+	unsigned int skipped;
+	struct plug417_calib_point points[PLUG417_CALIB_POINTS_MAX];
+	unsigned int settings;
+	struct plug417_batch setup[PLUG417_CALIB_SETTINGS_MAX];
+	struct plug417_calib_fit fit[PLUG417_CALIB_RANGES];
+	plug417_calib_blackbody blackbody;
+	void *arg;
+};
+
+struct plug417_calib *plug417_calib_alloc(const struct plug417_roi *roi, unsigned int frames);
+
+void plug417_calib_free(struct plug417_calib *c);
+
+int plug417_calib_point(struct plug417_calib *c, int16_t reference, unsigned int range);
+
+int plug417_calib_setting(struct plug417_calib *c, uint8_t functional, uint8_t page,
+		uint8_t option, uint32_t command);
+
+void plug417_calib_set_blackbody(struct plug417_calib *c, plug417_calib_blackbody blackbody,
+		void *arg);
+
+int plug417_calib_frame(struct plug417_calib *c, const struct plug417_video_frame *f);
+
+int plug417_calib_run(struct plug417_calib *c, struct plug417_serial *s,
+		struct plug417_video *v);
+
+int plug417_calib_fit(struct plug417_calib *c);
+
+int16_t plug417_calib_correct(const struct plug417_calib *c, unsigned int range, int16_t y16);
+
+int plug417_calib_write(struct plug417_calib *c, struct plug417_serial *s, int save);
+
+int plug417_calib_report(struct plug417_calib *c, struct plug417_output *o);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+/*
+ * PLUG417 lossless Y16 codec
+ */
+#ifndef _PLUG417_CODEC_H_
+#define _PLUG417_CODEC_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "plug417video.h"
+
+#define PLUG417_CODEC_VERSION		1
+
+#define PLUG417_CODEC_INTRA		0	/* spatial prediction only */
+#define PLUG417_CODEC_INTER		1	/* on the difference to the previous frame */
+
+#define PLUG417_CODEC_KEYFRAME		50
+
+/*
+ * Compressed frame header, host byte order, followed by size bytes of
+ * Rice coded prediction residuals
+ */
+struct plug417_codec_header {
+	uint8_t magic[2];
+	uint8_t version;
+	uint8_t mode;
+	uint16_t width;
+	uint16_t height;
+	uint32_t size;
+};
+
+/*
+ * Encoder or decoder state, one per stream
+ */
+struct plug417_codec {
+	unsigned int width;
+	unsigned int height;
+	unsigned int keyframe;
+	unsigned int frames;
+	int reference;
+	uint16_t *prev;
+	uint16_t *rows[2];
+	uint16_t *residual;
+};
+
+struct plug417_codec *plug417_codec_alloc(unsigned int width, unsigned int height,
+		unsigned int keyframe);
+
+void plug417_codec_free(struct plug417_codec *c);
+
+size_t plug417_codec_bound(unsigned int width, unsigned int height);
+
+int plug417_codec_encode(struct plug417_codec *c, const struct plug417_video_frame *f,
+		uint8_t *out, size_t size);
+
+int plug417_codec_decode(struct plug417_codec *c, const uint8_t *in, size_t len,
+		uint16_t *y16);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
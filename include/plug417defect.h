@@ -0,0 +1,105 @@
+/*
+ * PLUG417 host side defective pixel detection and correction
+ */
+#ifndef _PLUG417_DEFECT_H_
+#define _PLUG417_DEFECT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "plug417video.h"
+
+/* Defect types */
+#define PLUG417_DEFECT_STUCK		0x01	/* no temporal noise */
+#define PLUG417_DEFECT_HOT		0x02
+#define PLUG417_DEFECT_COLD		0x04
+#define PLUG417_DEFECT_NOISY		0x08
+#define PLUG417_DEFECT_MANUAL		0x10
+
+/* Good neighbours are searched up to this distance */
+#define PLUG417_DEFECT_RADIUS		4
+
+/*
+ * Median temporal noise used for the relative tests is at least this,
+ * Y16. Below it the frames are too quiet to tell stuck pixels apart.
+ */
+#define PLUG417_DEFECT_NOISE_MIN	0.5f
+
+/*
+ * Each defect is replaced by the mean of four good pixels, the nearest
+ * one left, right, above and below where they exist
+ */
+struct plug417_defect_pixel {
+	uint16_t x;
+	uint16_t y;
+	int8_t dx[4];
+	int8_t dy[4];
+	uint8_t type;
+} __attribute__((packed));
+
+struct plug417_defect_map {
+	unsigned int width;
+	unsigned int height;
+	unsigned int count;
+	unsigned int size;
+	int dirty;
+	struct plug417_defect_pixel *pixels;
+	uint8_t *mask;		/* one bit per pixel */
+};
+
+struct plug417_defect_thresholds {
+	float hot;		/* Y16 above the 3x3 median of the mean image */
+	float cold;		/* Y16 below it */
+	float stuck;		/* temporal noise below this times the median noise */
+	float noisy;		/* temporal noise above this times the median noise */
+};
+
+/*
+ * Temporal mean and noise per pixel over the frames given
+ */
+struct plug417_defect_detect {
+	unsigned int width;
+	unsigned int height;
+	unsigned int frames;
+	float *mean;
+	float *m2;
+};
+
+struct plug417_defect_map *plug417_defect_alloc(unsigned int width, unsigned int height);
+
+void plug417_defect_free(struct plug417_defect_map *m);
+
+int plug417_defect_add(struct plug417_defect_map *m, unsigned int x, unsigned int y,
+		unsigned int type);
+
+int plug417_defect_is(const struct plug417_defect_map *m, unsigned int x, unsigned int y);
+
+int plug417_defect_build(struct plug417_defect_map *m);
+
+int plug417_defect_load(struct plug417_defect_map *m, const char *path);
+
+int plug417_defect_save(const struct plug417_defect_map *m, const char *path);
+
+int plug417_defect_correct(const struct plug417_defect_map *m, struct plug417_video_frame *f);
+
+int plug417_defect_process(void *arg, struct plug417_video_frame *f);
+
+struct plug417_defect_detect *plug417_defect_detect_alloc(unsigned int width,
+		unsigned int height);
+
+void plug417_defect_detect_free(struct plug417_defect_detect *d);
+
+int plug417_defect_detect_frame(struct plug417_defect_detect *d,
+		const struct plug417_video_frame *f);
+
+int plug417_defect_detect_finish(struct plug417_defect_detect *d,
+		const struct plug417_defect_thresholds *t, struct plug417_defect_map *m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
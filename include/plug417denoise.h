@@ -0,0 +1,51 @@
+/*
+ * PLUG417 host side temporal noise filter for Y16
+ */
+#ifndef _PLUG417_DENOISE_H_
+#define _PLUG417_DENOISE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "plug417serial.h"
+#include "plug417video.h"
+
+/* Strength is PLUG417_ALGORITHM_LEVEL_0..4 or off */
+#define PLUG417_DENOISE_OFF		-1
+
+struct plug417_denoise {
+	unsigned int width;
+	unsigned int height;
+	int level;
+	int motion;		/* weight moving pixels towards the new frame */
+	float weight;		/* of the new frame for static pixels */
+	float threshold;	/* Y16 difference taken as motion */
+	int primed;
+	float *acc;
+	uint64_t frames;
+};
+
+struct plug417_denoise *plug417_denoise_alloc(unsigned int width, unsigned int height,
+		int level);
+
+void plug417_denoise_free(struct plug417_denoise *d);
+
+int plug417_denoise_set(struct plug417_denoise *d, int level, int motion);
+
+int plug417_denoise_from_page(struct plug417_denoise *d,
+		const struct plug417_alorithm_control_page_1 *page);
+
+void plug417_denoise_reset(struct plug417_denoise *d);
+
+int plug417_denoise_frame(struct plug417_denoise *d, struct plug417_video_frame *f);
+
+int plug417_denoise_process(void *arg, struct plug417_video_frame *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ * PLUG417 host side hottest and coldest point search
+ */
+#ifndef _PLUG417_EXTREMA_H_
+#define _PLUG417_EXTREMA_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "plug417video.h"
+
+struct plug417_extrema {
+	int16_t max_value;
+	unsigned int max_x;
+	unsigned int max_y;
+	int16_t min_value;
+	unsigned int min_x;
+	unsigned int min_y;
+};
+
+/*
+ * Local maximum, cx and cy are refined to sub-pixel precision
+ */
+struct plug417_peak {
+	int16_t value;
+	unsigned int x;
+	unsigned int y;
+	float cx;
+	float cy;
+};
+
+void plug417_extrema_row(const int16_t *p, unsigned int n, int16_t *min, int16_t *max);
+
+int plug417_extrema_find(const struct plug417_video_frame *f,
+		const struct plug417_roi *roi, struct plug417_extrema *e);
+
+int plug417_extrema_peaks(const struct plug417_video_frame *f,
+		const struct plug417_roi *roi, struct plug417_peak *peaks,
+		unsigned int k, unsigned int radius);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
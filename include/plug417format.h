@@ -0,0 +1,104 @@
+/*
+ * PLUG417 machine readable output formats
+ */
+#ifndef _PLUG417_FORMAT_H_
+#define _PLUG417_FORMAT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "plug417serial.h"
+
+#define PLUG417_FORMAT_TEXT		0
+#define PLUG417_FORMAT_JSON		1
+#define PLUG417_FORMAT_CSV		2
+#define PLUG417_FORMAT_BIN		3
+#define PLUG417_FORMAT_MAX		PLUG417_FORMAT_BIN
+
+#define PLUG417_OUTPUT_SIZE		4096
+
+/*
+ * Binary record, all fields little endian.
+ * Header is followed by count signed 32 bit values in page field order.
+ */
+#define PLUG417_RECORD_MAGIC0		'P'
+#define PLUG417_RECORD_MAGIC1		'4'
+#define PLUG417_RECORD_VERSION		1
+
+struct plug417_record_header {
+	uint8_t magic[2];
+	uint8_t version;
+	uint8_t functional;
+	uint8_t page;
+	uint8_t count;
+	uint16_t length;
+} __attribute__((packed));
+
+/*
+ * Records made on the host rather than read from a sensor page have
+ * functional PLUG417_FUNCTIONAL_HOST and one of these as page. Records
+ * of a stage or point carry its number as the first field.
+ */
+#define PLUG417_FUNCTIONAL_HOST		0xff
+
+#define PLUG417_HOST_REPLAY_STAGE	0
+#define PLUG417_HOST_PIPELINE_STAGE	1
+#define PLUG417_HOST_POOL		2
+#define PLUG417_HOST_CALIB_POINT	3
+#define PLUG417_HOST_SWEEP_POINT	4
+
+struct plug417_output {
+	int format;
+	int pass;
+	int count;
+	int len;
+	int start;
+	int size;
+	int overflow;
+	char *buf;
+};
+
+int plug417_format_parse(const char *name);
+
+void plug417_output_init(struct plug417_output *o, int format, void *buf, int size);
+
+int plug417_output_write(struct plug417_output *o, int fd);
+
+/*
+ * Output primitives, used by page renderers
+ */
+void plug417_out_printf(struct plug417_output *o, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+void plug417_out_raw(struct plug417_output *o, const void *buf, int size);
+
+void plug417_out_begin(struct plug417_output *o, unsigned int functional,
+		unsigned int page, const char *title);
+
+void plug417_out_end(struct plug417_output *o, unsigned int functional,
+		unsigned int page);
+
+void plug417_out_text(struct plug417_output *o, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+void plug417_out_field(struct plug417_output *o, const char *key,
+		const char *label, int64_t value, const char *str);
+
+void plug417_out_fixed(struct plug417_output *o, const char *key,
+		const char *label, int64_t value, double scale);
+
+void plug417_out_hex(struct plug417_output *o, const char *key,
+		const char *label, uint32_t value, int digits);
+
+int plug417_query_reply_format(struct plug417_serial *s, struct plug417_output *o);
+
+int plug417_status_format(struct plug417_status *st, struct plug417_output *o);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,68 @@
+/*
+ * PLUG417 link and sensor health metrics
+ */
+#ifndef _PLUG417_METRICS_H_
+#define _PLUG417_METRICS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+struct plug417_serial;
+
+struct plug417_metrics {
+	uint64_t frames_tx;
+	uint64_t frames_rx;
+	uint64_t bytes_tx;
+	uint64_t bytes_rx;
+	uint64_t handshake_ok;
+	uint64_t handshake_error;
+	uint64_t timeouts;
+	uint64_t checksum_errors;
+	uint64_t resyncs;	/* frames lost to a bad header or end byte */
+	int64_t focal_spot_temperature;
+	uint64_t focal_spot_timestamp;
+};
+
+#define PLUG417_METRICS_MAGIC		"PLUG417M"
+#define PLUG417_METRICS_VERSION		1
+
+/*
+ * Shared snapshot, seq is odd while the writer updates it
+ */
+struct plug417_metrics_shm {
+	char magic[8];
+	uint32_t version;
+	uint32_t seq;
+	struct plug417_metrics metrics;
+};
+
+#define plug417_metrics_inc(m, member, n)				\
+	__atomic_fetch_add(&(m)->member, n, __ATOMIC_RELAXED)
+
+void plug417_metrics_snapshot(const struct plug417_metrics *src,
+		struct plug417_metrics *m);
+
+int plug417_metrics_prometheus(const struct plug417_metrics *m,
+		const char *labels, char *buf, int size);
+
+int plug417_metrics_write_file(const struct plug417_metrics *m,
+		const char *labels, const char *path);
+
+struct plug417_metrics_shm *plug417_metrics_shm_open(const char *path, int create);
+
+void plug417_metrics_shm_close(struct plug417_metrics_shm *shm);
+
+void plug417_metrics_shm_publish(struct plug417_metrics_shm *shm,
+		const struct plug417_metrics *m);
+
+int plug417_metrics_shm_read(const struct plug417_metrics_shm *shm,
+		struct plug417_metrics *m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
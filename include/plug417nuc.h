@@ -0,0 +1,99 @@
+/*
+ * PLUG417 shutter and NUC event detection
+ */
+#ifndef _PLUG417_NUC_H_
+#define _PLUG417_NUC_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "plug417serial.h"
+#include "plug417video.h"
+
+/* Frames inside an event */
+#define PLUG417_NUC_GATE		0	/* gated past later pipeline stages */
+#define PLUG417_NUC_HOLD		1	/* replaced by the last good frame */
+
+/* Event causes */
+#define PLUG417_NUC_SHUTTER		0x01	/* parameter line shutter closed */
+#define PLUG417_NUC_FROZEN		0x02	/* frame repeated */
+#define PLUG417_NUC_JUMP		0x04	/* frame mean stepped */
+#define PLUG417_NUC_TRIGGERED		0x08	/* within the expected time of a trigger */
+
+/* The shutter word of the parameter line is not verified, opt in */
+#define PLUG417_NUC_CAUSES_DEFAULT	(PLUG417_NUC_FROZEN | PLUG417_NUC_JUMP | \
+		PLUG417_NUC_TRIGGERED)
+
+/* Statistics use every step-th pixel of every step-th row */
+#define PLUG417_NUC_STEP		8
+
+struct plug417_nuc_settings {
+	float frozen;		/* mean absolute difference to the previous frame, Y16 */
+	float jump;		/* step of the frame mean, Y16 */
+	unsigned int recover;	/* frames still inside the event once it cleared */
+	unsigned int limit;	/* longest event in frames, a frozen scene ends it */
+	uint64_t expected;	/* duration after plug417_nuc_trigger(), ns */
+	unsigned int mode;
+	unsigned int causes;	/* PLUG417_NUC_* detected */
+};
+
+struct plug417_nuc_event {
+	int active;
+	unsigned int cause;	/* causes seen during the event */
+	uint32_t sequence;	/* first frame, or the frame that ended it */
+	uint64_t timestamp;
+	unsigned int frames;
+};
+
+typedef void (*plug417_nuc_callback)(void *arg, const struct plug417_nuc_event *ev);
+
+struct plug417_nuc {
+	unsigned int width;
+	unsigned int height;
+	struct plug417_nuc_settings settings;
+	plug417_nuc_callback callback;
+	void *arg;
+	/* State */
+	struct plug417_nuc_event event;
+	unsigned int recover;
+	unsigned int suppress;	/* causes ignored until they clear */
+	uint64_t expect_until;
+	int have_prev;
+	double mean;
+	unsigned int count;
+	int16_t *sample;
+	uint16_t *held;
+	int have_held;
+	/* Statistics */
+	uint64_t frames;
+	uint64_t events;
+	uint64_t gated;
+};
+
+struct plug417_nuc *plug417_nuc_alloc(unsigned int width, unsigned int height,
+		const struct plug417_nuc_settings *settings);
+
+void plug417_nuc_free(struct plug417_nuc *n);
+
+void plug417_nuc_set(struct plug417_nuc *n, const struct plug417_nuc_settings *settings);
+
+void plug417_nuc_set_callback(struct plug417_nuc *n, plug417_nuc_callback callback, void *arg);
+
+void plug417_nuc_reset(struct plug417_nuc *n);
+
+int plug417_nuc_expect(struct plug417_nuc *n, uint64_t timestamp);
+
+int plug417_nuc_trigger(struct plug417_nuc *n, struct plug417_serial *s);
+
+int plug417_nuc_frame(struct plug417_nuc *n, struct plug417_video_frame *f);
+
+int plug417_nuc_process(void *arg, struct plug417_video_frame *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,49 @@
+/*
+ * PLUG417 host side pseudo color
+ */
+#ifndef _PLUG417_PALETTE_H_
+#define _PLUG417_PALETTE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "plug417video.h"
+
+#define PLUG417_PALETTE_RGB24		0
+#define PLUG417_PALETTE_RGBA		1
+#define PLUG417_PALETTE_YUV422		2
+#define PLUG417_PALETTE_FORMAT_MAX	PLUG417_PALETTE_YUV422
+
+#define PLUG417_PALETTE_SIZE		256
+
+/*
+ * Read only once built, any number of threads may colorize with it
+ */
+struct plug417_palette {
+	uint8_t rgba[PLUG417_PALETTE_SIZE][4];
+	uint8_t yuv[PLUG417_PALETTE_SIZE][4];
+};
+
+int plug417_palette_init(struct plug417_palette *p, unsigned int color);
+
+int plug417_palette_custom(struct plug417_palette *p, const uint8_t (*stops)[3],
+		unsigned int count);
+
+int plug417_palette_load(struct plug417_palette *p, const char *path);
+
+int plug417_palette_colorize(const struct plug417_palette *p,
+		const struct plug417_video_frame *f, int lo, int hi,
+		unsigned int format, uint8_t *out, unsigned int out_stride);
+
+int plug417_palette_colorize_lut(const struct plug417_palette *p,
+		const struct plug417_video_frame *f, const uint8_t *lut,
+		unsigned int format, uint8_t *out, unsigned int out_stride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
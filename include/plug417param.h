@@ -0,0 +1,56 @@
+/*
+ * PLUG417 digital video parameter line
+ */
+#ifndef _PLUG417_PARAM_H_
+#define _PLUG417_PARAM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * 16 bit word positions in the parameter line, host order. The protocol
+ * description in this tree does not document the line, this layout is
+ * assumed and not verified on hardware yet: check the frame counter and
+ * shutter words against a capture before relying on them.
+ */
+#define PLUG417_PARAM_WORD_FRAME_COUNTER_HI	0
+#define PLUG417_PARAM_WORD_FRAME_COUNTER_LO	1
+#define PLUG417_PARAM_WORD_FOCAL_SPOT		2
+#define PLUG417_PARAM_WORD_MAX_X		3
+#define PLUG417_PARAM_WORD_MAX_Y		4
+#define PLUG417_PARAM_WORD_MAX_VALUE		5
+#define PLUG417_PARAM_WORD_MIN_X		6
+#define PLUG417_PARAM_WORD_MIN_Y		7
+#define PLUG417_PARAM_WORD_MIN_VALUE		8
+#define PLUG417_PARAM_WORD_CENTER_VALUE		9
+#define PLUG417_PARAM_WORD_SHUTTER		10
+#define PLUG417_PARAM_WORDS			11
+
+#define PLUG417_PARAM_SHUTTER_OPEN		0
+#define PLUG417_PARAM_SHUTTER_CLOSED		1
+
+struct plug417_param {
+	uint32_t frame_counter;
+	int16_t focal_spot_temperature;	/* 0.01 degree Celsius */
+	uint16_t max_x;
+	uint16_t max_y;
+	int16_t max_value;		/* Y16, 0.1 degree Celsius */
+	uint16_t min_x;
+	uint16_t min_y;
+	int16_t min_value;
+	int16_t center_value;
+	uint8_t shutter;
+	uint8_t valid;
+};
+
+int plug417_param_decode(const uint16_t *line, unsigned int width,
+		unsigned int height, struct plug417_param *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,178 @@
+/*
+ * PLUG417 parallel frame pipeline on a work-stealing scheduler
+ */
+#ifndef _PLUG417_PIPELINE_H_
+#define _PLUG417_PIPELINE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "plug417video.h"
+#include "plug417format.h"
+
+#define PLUG417_PIPELINE_STAGES_MAX	16
+#define PLUG417_PIPELINE_DEPTH		8
+#define PLUG417_SCHED_THREADS_MAX	256
+#define PLUG417_SCHED_DEQUE		1024	/* tasks per worker, power of two */
+#define PLUG417_SCHED_INJECT		1024	/* tasks from other threads */
+
+/* Stage flags */
+#define PLUG417_PIPELINE_PARALLEL	0	/* frames run concurrently */
+#define PLUG417_PIPELINE_ORDERED	1	/* one frame at a time in submit order */
+
+struct plug417_task;
+
+typedef void (*plug417_task_run)(struct plug417_task *t);
+
+struct plug417_task {
+	plug417_task_run run;
+};
+
+/*
+ * Bounded lock-free queue, any number of producers and consumers
+ */
+struct plug417_ring_slot {
+	uint64_t seq;
+	void *data;
+};
+
+struct plug417_ring {
+	uint64_t head __attribute__((aligned(64)));
+	uint64_t tail __attribute__((aligned(64)));
+	unsigned int mask __attribute__((aligned(64)));
+	struct plug417_ring_slot *slots;
+};
+
+/*
+ * Chase-Lev deque, the owner pushes and pops at the bottom, thieves
+ * take from the top
+ */
+struct plug417_deque {
+	int64_t top __attribute__((aligned(64)));
+	int64_t bottom __attribute__((aligned(64)));
+	struct plug417_task *tasks[PLUG417_SCHED_DEQUE] __attribute__((aligned(64)));
+};
+
+struct plug417_sched_worker {
+	struct plug417_deque deque;
+	struct plug417_sched *sched;
+	pthread_t thread;
+	unsigned int id;
+	uint32_t seed;
+	uint64_t executed;
+	uint64_t stolen;
+} __attribute__((aligned(64)));
+
+struct plug417_sched {
+	unsigned int threads;
+	int stop;
+	unsigned int sleepers;
+	unsigned int signal;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	struct plug417_ring inject;
+	struct plug417_sched_worker *workers;
+};
+
+/* Negative on error, positive to gate the frame past the later stages */
+typedef int (*plug417_pipeline_process)(void *arg, struct plug417_video_frame *f);
+
+/* Rows y0 up to y1 of the frame, called concurrently for other tiles */
+typedef void (*plug417_pipeline_rows)(void *arg, struct plug417_video_frame *f,
+		unsigned int y0, unsigned int y1);
+
+struct plug417_pipeline_job;
+
+struct plug417_pipeline_stage {
+	const char *name;
+	int flags;
+	plug417_pipeline_process process;
+	plug417_pipeline_rows rows;
+	unsigned int tile;
+	void *arg;
+	/* Ordered stages, jobs wait in slots by ticket */
+	int busy;
+	uint64_t next;
+	struct plug417_pipeline_job **order;
+	/* Statistics, updated atomically */
+	uint64_t frames;
+	uint64_t errors;
+	uint64_t gated;
+	uint64_t ns;
+	uint64_t latency;
+	uint64_t latency_max;
+};
+
+struct plug417_pipeline_tile {
+	struct plug417_task task;
+	struct plug417_pipeline_job *job;
+	unsigned int y0;
+	unsigned int y1;
+};
+
+struct plug417_pipeline_job {
+	struct plug417_task task;
+	struct plug417_pipeline *pipeline;
+	struct plug417_video_frame *frame;
+	uint64_t ticket;
+	uint64_t submitted;
+	uint64_t ready;
+	uint64_t tile_ns;
+	unsigned int stage;
+	unsigned int remaining;
+	int error;
+	int gated;
+	unsigned int tiles_size;
+	struct plug417_pipeline_tile *tiles;
+};
+
+struct plug417_pipeline {
+	struct plug417_sched *sched;
+	unsigned int depth;
+	unsigned int count;
+	struct plug417_pipeline_stage stages[PLUG417_PIPELINE_STAGES_MAX];
+	struct plug417_pipeline_job *jobs;
+	struct plug417_ring idle;
+	struct plug417_ring done;
+	unsigned int in_flight;
+	uint64_t ticket;
+	uint64_t start;
+	uint64_t end;
+	uint64_t frames;
+	uint64_t latency;
+	uint64_t latency_max;
+};
+
+struct plug417_sched *plug417_sched_alloc(unsigned int threads);
+
+void plug417_sched_free(struct plug417_sched *s);
+
+int plug417_sched_submit(struct plug417_sched *s, struct plug417_task *t);
+
+struct plug417_pipeline *plug417_pipeline_alloc(struct plug417_sched *s, unsigned int depth);
+
+void plug417_pipeline_free(struct plug417_pipeline *p);
+
+int plug417_pipeline_stage(struct plug417_pipeline *p, const char *name, int flags,
+		plug417_pipeline_process process, void *arg);
+
+int plug417_pipeline_stage_rows(struct plug417_pipeline *p, const char *name,
+		plug417_pipeline_rows rows, void *arg, unsigned int tile);
+
+int plug417_pipeline_submit(struct plug417_pipeline *p, struct plug417_video_frame *f);
+
+int plug417_pipeline_collect(struct plug417_pipeline *p, struct plug417_video_frame **f);
+
+void plug417_pipeline_drain(struct plug417_pipeline *p);
+
+int plug417_pipeline_report(struct plug417_pipeline *p, struct plug417_output *o);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * PLUG417 reference counted frame buffer pool
+ */
+#ifndef _PLUG417_POOL_H_
+#define _PLUG417_POOL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "plug417video.h"
+#include "plug417format.h"
+
+#define PLUG417_POOL_HUGE_PAGE		(2UL << 20)
+#define PLUG417_POOL_SHARDS_MAX		64
+
+/* Buffer contents, sized from a PLUG417_VIDEO_* resolution */
+#define PLUG417_POOL_Y16		0	/* 16 bit per pixel */
+#define PLUG417_POOL_TEMP		1	/* float per pixel */
+#define PLUG417_POOL_RGB24		2
+#define PLUG417_POOL_RGBA		3
+#define PLUG417_POOL_YUV422		4
+
+/* Flags */
+#define PLUG417_POOL_HUGETLB		1	/* reserved huge pages, else transparent */
+#define PLUG417_POOL_POPULATE		2	/* fault in on first get, else on first write */
+
+struct plug417_pool;
+
+struct plug417_pool_buffer {
+	void *data;
+	struct plug417_pool *pool;
+	unsigned int index;
+	unsigned int refs;
+	uint32_t next;
+	int home;	/* shard of the CPU that touched it first, -1 untouched */
+};
+
+/*
+ * Free list, index + 1 in the low half and an ABA tag in the high half
+ */
+struct plug417_pool_shard {
+	uint64_t head;
+} __attribute__((aligned(64)));
+
+struct plug417_pool_stats {
+	size_t size;
+	unsigned int count;
+	unsigned int in_use;
+	unsigned int peak;
+	int huge;
+	uint64_t gets;
+	uint64_t puts;
+	uint64_t refs;
+	uint64_t empty;
+	uint64_t steals;
+};
+
+struct plug417_pool {
+	size_t size;
+	unsigned int count;
+	unsigned int shards;
+	int flags;
+	void *map;
+	size_t map_size;
+	uint8_t *base;
+	struct plug417_pool_buffer *buffers;
+	struct plug417_pool_shard untouched;
+	struct plug417_pool_shard *local;
+	struct plug417_pool_stats stats;
+};
+
+size_t plug417_pool_frame_size(unsigned int resolution, int kind);
+
+struct plug417_pool *plug417_pool_alloc(size_t size, unsigned int count, int flags);
+
+void plug417_pool_free(struct plug417_pool *p);
+
+struct plug417_pool_buffer *plug417_pool_get(struct plug417_pool *p);
+
+void plug417_pool_ref(struct plug417_pool_buffer *b);
+
+void plug417_pool_put(struct plug417_pool_buffer *b);
+
+struct plug417_pool_buffer *plug417_pool_buffer(struct plug417_pool *p, const void *data);
+
+void plug417_pool_stats(struct plug417_pool *p, struct plug417_pool_stats *stats);
+
+int plug417_pool_report(struct plug417_pool *p, const char *name, struct plug417_output *o);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
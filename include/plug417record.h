@@ -0,0 +1,154 @@
+/*
+ * PLUG417 recording container, Y16 frames and control link events
+ */
+#ifndef _PLUG417_RECORD_H_
+#define _PLUG417_RECORD_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "plug417video.h"
+#include "plug417param.h"
+#include "plug417codec.h"
+
+#define PLUG417_RECORD_FILE_MAGIC		"PLUG417R"
+#define PLUG417_RECORD_FILE_VERSION		1
+#define PLUG417_RECORD_FILE_BYTE_ORDER	0x0102
+
+#define PLUG417_RECORD_ALIGN		4096
+#define PLUG417_RECORD_BATCH		(4 << 20)
+
+#define PLUG417_RECORD_CHUNK_FRAME	1
+#define PLUG417_RECORD_CHUNK_EVENT	2
+#define PLUG417_RECORD_CHUNK_INDEX	3
+
+/*
+ * File is the header followed by chunks, each padded to 8 bytes. The
+ * frame index chunk is written last and located by index_offset, zero
+ * when the recording was not finished. Host byte order.
+ */
+struct plug417_record_file_header {
+	char magic[8];
+	uint16_t version;
+	uint16_t byte_order;
+	uint32_t width;
+	uint32_t height;
+	uint32_t frame_size;
+	uint64_t index_offset;
+	uint64_t frames;
+	uint64_t events;
+	uint64_t created;
+	uint8_t reserved[8];
+};
+
+struct plug417_record_chunk {
+	uint32_t type;
+	uint32_t size;
+	uint64_t timestamp;
+};
+
+#define PLUG417_RECORD_FRAME_COMPRESSED	0x01
+
+/*
+ * Followed by frame_size bytes of Y16, width pixels per line, or by one
+ * intra coded plug417codec frame when compressed
+ */
+struct plug417_record_frame {
+	uint32_t sequence;
+	uint32_t flags;
+	uint64_t timestamp;
+	struct plug417_param param;
+};
+
+/*
+ * Serial frame as sent or received, PLUG417_MONITOR_*
+ */
+struct plug417_record_event {
+	uint8_t direction;
+	uint8_t reserved;
+	uint16_t len;
+	uint8_t data[];
+};
+
+struct plug417_record_index {
+	uint64_t offset;
+	uint64_t timestamp;
+};
+
+/*
+ * Chunks are appended to buf under lock. A full batch is swapped with
+ * spare and written under flush_lock only, so writers are not held up
+ * by write(). Frames are compressed into encoded before lock is taken.
+ */
+struct plug417_record_writer {
+	int fd;
+	pthread_mutex_t lock;
+	pthread_mutex_t flush_lock;
+	pthread_mutex_t codec_lock;
+	struct plug417_record_file_header header;
+	uint8_t *buf;
+	size_t len;
+	uint64_t offset;
+	uint8_t *spare;
+	size_t pending;		/* bytes of spare to be written */
+	int failed;
+	struct plug417_record_index *index;
+	size_t index_size;
+	struct plug417_codec *codec;
+	uint8_t *encoded;
+};
+
+struct plug417_record {
+	int fd;
+	uint8_t *map;
+	size_t size;
+	const struct plug417_record_file_header *header;
+	const struct plug417_record_index *index;
+	struct plug417_record_index *rebuilt;
+	uint64_t frames;
+	struct plug417_codec *codec;
+	uint16_t *decoded;
+};
+
+struct plug417_record_writer *plug417_record_create(const char *path,
+		unsigned int width, unsigned int height);
+
+int plug417_record_compress(struct plug417_record_writer *w);
+
+int plug417_record_write_frame(struct plug417_record_writer *w,
+		const struct plug417_video_frame *f);
+
+int plug417_record_write_event(struct plug417_record_writer *w, int direction,
+		const void *buf, int len, uint64_t timestamp);
+
+void plug417_record_monitor(void *arg, int direction, const void *buf, int len);
+
+int plug417_record_finish(struct plug417_record_writer *w);
+
+struct plug417_record *plug417_record_open(const char *path);
+
+void plug417_record_close(struct plug417_record *r);
+
+int plug417_record_valid(const struct plug417_record *r, uint64_t offset);
+
+int plug417_record_frame_at(struct plug417_record *r, uint64_t offset,
+		struct plug417_video_frame *f);
+
+int plug417_record_frame(struct plug417_record *r, uint64_t n,
+		struct plug417_video_frame *f);
+
+uint64_t plug417_record_seek(const struct plug417_record *r, uint64_t timestamp);
+
+const struct plug417_record_chunk *plug417_record_chunk(const struct plug417_record *r,
+		uint64_t *offset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ * PLUG417 replay of recorded sessions and serial captures
+ */
+#ifndef _PLUG417_REPLAY_H_
+#define _PLUG417_REPLAY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "plug417serial.h"
+#include "plug417format.h"
+#include "plug417record.h"
+
+#define PLUG417_REPLAY_STAGES_MAX	16
+
+/* Speed 0 replays as fast as possible, 1 in real time */
+#define PLUG417_REPLAY_FAST		0.0
+#define PLUG417_REPLAY_REALTIME		1.0
+
+typedef int (*plug417_replay_process)(void *arg, const struct plug417_video_frame *f);
+
+struct plug417_replay_stage {
+	const char *name;
+	plug417_replay_process process;
+	void *arg;
+	uint64_t frames;
+	uint64_t ns;
+};
+
+struct plug417_replay {
+	struct plug417_record *record;
+	struct plug417_serial *serial;
+	unsigned int count;
+	struct plug417_replay_stage stages[PLUG417_REPLAY_STAGES_MAX];
+	/* Serial receive path, reported as the last stage */
+	struct plug417_replay_stage recv;
+	uint64_t frames;
+	uint64_t events;
+	uint64_t elapsed;
+};
+
+struct plug417_replay *plug417_replay_open(const char *path);
+
+void plug417_replay_close(struct plug417_replay *r);
+
+int plug417_replay_stage(struct plug417_replay *r, const char *name,
+		plug417_replay_process process, void *arg);
+
+void plug417_replay_serial(struct plug417_replay *r, struct plug417_serial *s);
+
+int plug417_replay_run(struct plug417_replay *r, double speed);
+
+int plug417_replay_capture(struct plug417_replay *r, const char *path);
+
+int plug417_replay_report(struct plug417_replay *r, struct plug417_output *o);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * PLUG417 table driven page schema
+ */
+#ifndef _PLUG417_SCHEMA_H_
+#define _PLUG417_SCHEMA_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "plug417serial.h"
+#include "plug417format.h"
+
+#define PLUG417_FIELD_SIGNED		(1 << 0)
+#define PLUG417_FIELD_ON_OFF		(1 << 1)
+#define PLUG417_FIELD_HEX		(1 << 2)
+
+/*
+ * Field of a packed page structure, big endian on the wire
+ */
+struct plug417_field {
+	const char *name;
+	const char *label;
+	uint16_t offset;
+	uint8_t width;
+	uint8_t flags;
+	uint32_t mask;
+	double scale;
+	unsigned int max;
+	const char **labels;
+};
+
+struct plug417_page_schema {
+	uint8_t functional;
+	uint8_t page;
+	uint16_t base;
+	uint16_t size;
+	const char *name;
+	unsigned int count;
+	const struct plug417_field *fields;
+};
+
+#define PLUG417_SCHEMA_FIELDS_MAX	32
+
+#define PLUG417_MEMBER_SIZE(type, member)	sizeof(((struct type *)0)->member)
+
+#define PLUG417_FIELD(type, member, n, l, ...)				\
+	{								\
+		.name = n,						\
+		.label = l,						\
+		.offset = offsetof(struct type, member),		\
+		.width = PLUG417_MEMBER_SIZE(type, member),		\
+		__VA_ARGS__						\
+	}
+
+#define PLUG417_PAGE_SCHEMA(f, p, type, b, n, tab)			\
+	{								\
+		.functional = f,					\
+		.page = p,						\
+		.base = b,						\
+		.size = sizeof(struct type),				\
+		.name = n,						\
+		.count = sizeof(tab) / sizeof(tab[0]),			\
+		.fields = tab,						\
+	}
+
+const struct plug417_page_schema *plug417_schema_find(unsigned int functional,
+		unsigned int page);
+
+int plug417_schema_check(void);
+
+int plug417_schema_field_index(const struct plug417_page_schema *ps,
+		const char *name);
+
+int plug417_schema_decode(const struct plug417_page_schema *ps,
+		const void *payload, int size, int32_t *values);
+
+void plug417_schema_fields(const struct plug417_page_schema *ps,
+		const int32_t *values, struct plug417_output *o);
+
+int plug417_schema_format(const struct plug417_page_schema *ps,
+		const int32_t *values, struct plug417_output *o);
+
+int plug417_schema_diff(const struct plug417_page_schema *ps,
+		const int32_t *prev, const int32_t *values, struct plug417_output *o);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
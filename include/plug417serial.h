@@ -11,6 +11,8 @@ extern "C" {
 #include <stdint.h>
 #include <termios.h>
 
+#include "plug417metrics.h"
+
 #define PLUG417_FRAME_HEADER0			0x55
 #define PLUG417_FRAME_HEADER1			0xaa
 #define PLUG417_FRAME_END			0xf0
@@ -166,8 +168,18 @@ extern "C" {
 #define PLUG417_OPTION_HOTTEST_CURSOR_G			6
 #define PLUG417_OPTION_HOTTEST_CURSOR_B			7
 
+#define PLUG417_OPTION_TIME_DOMAIN_FILTERING		0x01
+#define PLUG417_OPTION_FILTERING_STRENGTH		0x02
+#define PLUG417_OPTION_VERTICAL_STRIP_REMOVAL		0x03
+#define PLUG417_OPTION_VERTICAL_STRIP_STRENGTH		0x04
+#define PLUG417_OPTION_SHARPENING			0x05
+#define PLUG417_OPTION_SHARPENING_STRENGTH		0x06
+#define PLUG417_OPTION_DIMMING_MODE			0x07
+#define PLUG417_OPTION_UPPER_THROWING_POINT		0x08
+#define PLUG417_OPTION_LOWER_THROWING_POINT		0x09
 #define PLUG417_OPTION_BRIGHTNESS			0x0a
 #define PLUG417_OPTION_CONTRAST				0x0b
+#define PLUG417_OPTION_HYBRID_DIMMING_MAPPING		0x0c
 
 /* Temperature measurement */
 #define PLUG417_OPTION_DISTANCE				1
@@ -423,13 +435,39 @@ struct plug417_frame {
 	uint8_t end;
 } __attribute__((packed));
 
+#define PLUG417_MONITOR_TX	0
+#define PLUG417_MONITOR_RX	1
+
+/*
+ * Sees every frame sent and every complete frame received
+ */
+typedef void (*plug417_monitor)(void *arg, int direction, const void *buf, int len);
+
+/*
+ * Pipelined commands, see plug417_send_batch()
+ */
+#define PLUG417_BATCH_WINDOW		8
+#define PLUG417_BATCH_WINDOW_MAX	32
+
+struct plug417_batch {
+	uint8_t functional;
+	uint8_t page;
+	uint8_t option;
+	uint32_t command;
+	int result;		/* 0 acknowledged, -1 rejected or not sent */
+};
+
 struct plug417_serial {
 	int fd;
 	int size;
+	int hunting;	/* frame lost, looking for the next header */
 	long timeout;
 	struct termios termios;
 	struct plug417_frame frame;
 	int frame_size;
+	struct plug417_metrics metrics;
+	plug417_monitor monitor;
+	void *monitor_arg;
 };
 
 int plug417serial_debug_level_set(int level);
@@ -443,10 +481,17 @@ struct plug417_serial *plug417_open(const char *serial);
 
 void plug417_close(struct plug417_serial *s);
 
+void plug417_serial_monitor(struct plug417_serial *s, plug417_monitor monitor, void *arg);
+
+int plug417_send_batch(struct plug417_serial *s, struct plug417_batch *b,
+		unsigned int count, unsigned int window);
+
 int plug417_query_status(struct plug417_serial *s, struct plug417_status *st);
 
 int plug417_query(struct plug417_serial *s, unsigned int func, unsigned int page);
 
+int plug417_query_defective_pixel(struct plug417_serial *s, void *buf, unsigned int size);
+
 int plug417_query_reply_print(struct plug417_serial *s);
 
 void plug417_print_status(struct plug417_serial *s, struct plug417_status *st);
@@ -471,6 +516,8 @@ int plug417_set_hotspot_track_on(struct plug417_serial *s, unsigned int on);
 
 int plug417_set_test_screen(struct plug417_serial *s, unsigned int test);
 
+int plug417_set_shutter_control(struct plug417_serial *s, unsigned int v);
+
 int plug417_set_external_synchronization(struct plug417_serial *s, unsigned int v);
 
 int plug417_set_digital_port_parallel_type(struct plug417_serial *s, unsigned int v);
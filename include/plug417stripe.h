@@ -0,0 +1,57 @@
+/*
+ * PLUG417 host side vertical stripe removal for Y16
+ */
+#ifndef _PLUG417_STRIPE_H_
+#define _PLUG417_STRIPE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "plug417serial.h"
+#include "plug417video.h"
+
+/* Strength is PLUG417_ALGORITHM_LEVEL_0..4 or off */
+#define PLUG417_STRIPE_OFF		-1
+
+/* Rows summed in 16 bit before they are added to the totals */
+#define PLUG417_STRIPE_FLUSH		1024
+
+struct plug417_stripe {
+	unsigned int width;
+	unsigned int height;
+	int level;
+	float rate;		/* of the offset update per frame */
+	int threshold;		/* residuals above are scene edges */
+	float *offset;		/* per column, subtracted */
+	int16_t *correction;
+	int16_t *sum;
+	int16_t *count;
+	int32_t *total;
+	int32_t *total_count;
+	uint64_t frames;
+};
+
+struct plug417_stripe *plug417_stripe_alloc(unsigned int width, unsigned int height,
+		int level);
+
+void plug417_stripe_free(struct plug417_stripe *s);
+
+int plug417_stripe_set(struct plug417_stripe *s, int level);
+
+int plug417_stripe_from_page(struct plug417_stripe *s,
+		const struct plug417_alorithm_control_page_1 *page);
+
+void plug417_stripe_reset(struct plug417_stripe *s);
+
+int plug417_stripe_frame(struct plug417_stripe *s, struct plug417_video_frame *f);
+
+int plug417_stripe_process(void *arg, struct plug417_video_frame *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
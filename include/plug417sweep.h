@@ -0,0 +1,85 @@
+/*
+ * PLUG417 parameter sweep
+ */
+#ifndef _PLUG417_SWEEP_H_
+#define _PLUG417_SWEEP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "plug417serial.h"
+#include "plug417video.h"
+#include "plug417format.h"
+#include "plug417record.h"
+
+#define PLUG417_SWEEP_AXES_MAX		8
+#define PLUG417_SWEEP_VALUES_MAX	256
+#define PLUG417_SWEEP_NAME_SIZE		32
+
+/*
+ * One option and the values it takes, the last axis changes fastest
+ */
+struct plug417_sweep_axis {
+	char name[PLUG417_SWEEP_NAME_SIZE];
+	uint8_t functional;
+	uint8_t page;
+	uint8_t option;
+	unsigned int count;
+	unsigned int index;
+	int32_t values[PLUG417_SWEEP_VALUES_MAX];
+};
+
+/*
+ * Averages over the ROI of the frames captured at a point
+ */
+struct plug417_sweep_stats {
+	unsigned int frames;
+	uint32_t sequence;	/* first frame */
+	uint64_t timestamp;
+	double mean;
+	double noise;
+	int16_t min;
+	int16_t max;
+};
+
+struct plug417_sweep {
+	unsigned int count;
+	struct plug417_sweep_axis axes[PLUG417_SWEEP_AXES_MAX];
+	unsigned int points;
+	unsigned int settle_ms;		/* after the settings are acknowledged */
+	unsigned int settle_frames;	/* frames dropped once settle_ms passed */
+	int functional;			/* page queried at every point, -1 none */
+	int page;
+	struct plug417_video *video;
+	struct plug417_roi roi;
+	int whole;
+	unsigned int frames;
+	struct plug417_record_writer *record;
+	struct plug417_sweep_stats stats;
+};
+
+struct plug417_sweep *plug417_sweep_alloc(void);
+
+void plug417_sweep_free(struct plug417_sweep *sw);
+
+int plug417_sweep_axis(struct plug417_sweep *sw, const char *spec);
+
+void plug417_sweep_query(struct plug417_sweep *sw, int functional, int page);
+
+void plug417_sweep_video(struct plug417_sweep *sw, struct plug417_video *v,
+		const struct plug417_roi *roi, unsigned int frames);
+
+void plug417_sweep_record(struct plug417_sweep *sw, struct plug417_record_writer *w);
+
+int plug417_sweep_run(struct plug417_sweep *sw, struct plug417_serial *s, int format, int fd);
+
+void plug417_sweep_help(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ * PLUG417 Y16 to temperature conversion
+ */
+#ifndef _PLUG417_TEMP_H_
+#define _PLUG417_TEMP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "plug417serial.h"
+#include "plug417video.h"
+
+/* Same values as PLUG417_OPTION_TEMPERATURE_SHOW */
+#define PLUG417_TEMP_UNIT_CELSIUS	0
+#define PLUG417_TEMP_UNIT_FAHRENHEIT	1
+#define PLUG417_TEMP_UNIT_KELVIN	2
+#define PLUG417_TEMP_UNIT_MAX		PLUG417_TEMP_UNIT_KELVIN
+
+/* Y16 and reflected temperature are signed 0.1 degree Celsius */
+#define PLUG417_TEMP_Y16_SCALE		10
+
+/* Fixed point output is in 0.1 of the selected unit */
+#define PLUG417_TEMP_FIXED_SCALE	10
+
+#define PLUG417_TEMP_LUT_SIZE		65536
+
+/*
+ * Measurement settings as on the temperature measurement page, only the
+ * ones the conversion uses: a change of any of them rebuilds the tables
+ */
+struct plug417_temp_settings {
+	unsigned int distance;		/* meter */
+	unsigned int emissivity;	/* percent */
+	int reflected;			/* 0.1 degree Celsius */
+	unsigned int humidity;		/* percent */
+	unsigned int unit;
+};
+
+struct plug417_temp {
+	struct plug417_temp_settings settings;
+	float lut[PLUG417_TEMP_LUT_SIZE];
+	int16_t lut_fixed[PLUG417_TEMP_LUT_SIZE];
+};
+
+#define PLUG417_TEMP_MATERIALS_MAX	16
+
+/*
+ * Per pixel compensation. Y16 goes through one table to apparent
+ * radiance, each material removes its own reflected and atmospheric
+ * part and scales by its emissivity and transmission.
+ */
+struct plug417_radiometry {
+	unsigned int width;
+	unsigned int height;
+	unsigned int unit;
+	unsigned int count;
+	struct plug417_temp_settings materials[PLUG417_TEMP_MATERIALS_MAX];
+	float offset[PLUG417_TEMP_MATERIALS_MAX];
+	float scale[PLUG417_TEMP_MATERIALS_MAX];
+	uint8_t *map;		/* material per pixel, 0 where none was assigned */
+	float radiance[PLUG417_TEMP_LUT_SIZE];
+};
+
+struct plug417_temp *plug417_temp_alloc(const struct plug417_temp_settings *settings);
+
+void plug417_temp_free(struct plug417_temp *t);
+
+void plug417_temp_settings_from_page(const struct plug417_measurement_page_1 *p,
+		struct plug417_temp_settings *settings);
+
+int plug417_temp_set(struct plug417_temp *t, const struct plug417_temp_settings *settings);
+
+float plug417_temp_y16(const struct plug417_temp_settings *settings, uint16_t y16);
+
+void plug417_temp_convert(const struct plug417_temp *t, const uint16_t *y16,
+		float *temp, size_t count);
+
+void plug417_temp_convert_fixed(const struct plug417_temp *t, const uint16_t *y16,
+		int16_t *temp, size_t count);
+
+struct plug417_radiometry *plug417_radiometry_alloc(unsigned int width, unsigned int height,
+		const struct plug417_temp_settings *settings);
+
+void plug417_radiometry_free(struct plug417_radiometry *r);
+
+int plug417_radiometry_material(struct plug417_radiometry *r,
+		const struct plug417_temp_settings *settings);
+
+int plug417_radiometry_set(struct plug417_radiometry *r, unsigned int material,
+		const struct plug417_temp_settings *settings);
+
+int plug417_radiometry_assign(struct plug417_radiometry *r, const struct plug417_roi *roi,
+		unsigned int material);
+
+float plug417_radiometry_pixel(const struct plug417_radiometry *r, uint16_t y16,
+		unsigned int material);
+
+int plug417_radiometry_convert(const struct plug417_radiometry *r,
+		const struct plug417_video_frame *f, float *temp, unsigned int temp_stride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ * PLUG417 binary trace ring
+ */
+#ifndef _PLUG417_TRACE_H_
+#define _PLUG417_TRACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Compile time gating, events above PLUG417_TRACE_LEVEL are compiled out
+ */
+#define PLUG417_TRACE_LEVEL_ERROR	1
+#define PLUG417_TRACE_LEVEL_FRAME	2
+#define PLUG417_TRACE_LEVEL_BYTES	3
+
+#ifndef PLUG417_TRACE_LEVEL
+#define PLUG417_TRACE_LEVEL		PLUG417_TRACE_LEVEL_FRAME
+#endif
+
+#define PLUG417_TRACE_TX		1
+#define PLUG417_TRACE_RX		2
+#define PLUG417_TRACE_HANDSHAKE_OK	3
+#define PLUG417_TRACE_HANDSHAKE_ERROR	4
+#define PLUG417_TRACE_TIMEOUT		5
+#define PLUG417_TRACE_CHECKSUM		6
+#define PLUG417_TRACE_RESYNC		7
+#define PLUG417_TRACE_READ		8
+#define PLUG417_TRACE_EVENT_MAX		PLUG417_TRACE_READ
+
+#define PLUG417_TRACE_MAGIC		"PLUG417T"
+#define PLUG417_TRACE_VERSION		1
+#define PLUG417_TRACE_RECORDS		4096
+#define PLUG417_TRACE_DATA_SIZE		48
+
+/*
+ * One cache line per record, seq is published last and equals
+ * ring position + 1 once the record is complete
+ */
+struct plug417_trace_record {
+	uint32_t seq;
+	uint8_t event;
+	uint8_t reserved;
+	uint16_t len;
+	uint64_t timestamp;
+	uint8_t data[PLUG417_TRACE_DATA_SIZE];
+} __attribute__((packed, aligned(64)));
+
+struct plug417_trace_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t records;
+	uint64_t head;
+	uint8_t reserved[40];
+} __attribute__((packed, aligned(64)));
+
+/*
+ *
+ */
+static inline uint64_t plug417_clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int plug417_trace_open(const char *path, unsigned int records);
+
+void plug417_trace_close(void);
+
+void plug417_trace_write(unsigned int event, const void *buf, unsigned int len);
+
+int plug417_trace_dump(const char *path, FILE *out);
+
+#define plug417_trace(level, event, buf, len)				\
+	do {								\
+		if ((level) <= PLUG417_TRACE_LEVEL)			\
+			plug417_trace_write(event, buf, len);		\
+	} while (0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * PLUG417 digital video frame ingestion
+ */
+#ifndef _PLUG417_VIDEO_H_
+#define _PLUG417_VIDEO_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "plug417serial.h"
+#include "plug417param.h"
+
+#define PLUG417_VIDEO_SOURCE_FILE	0
+#define PLUG417_VIDEO_SOURCE_V4L2	1
+
+#define PLUG417_VIDEO_BUFFERS		4
+#define PLUG417_VIDEO_BUFFERS_MAX	32
+
+/*
+ * Frame layout on the digital port, one line is width 16 bit words:
+ * optional parameter line, Y16 image, YUV422 image
+ */
+struct plug417_video_layout {
+	unsigned int width;
+	unsigned int height;
+	unsigned int line_size;
+	unsigned int param_lines;
+	unsigned int y16_lines;
+	unsigned int yuv_lines;
+	size_t param_offset;
+	size_t y16_offset;
+	size_t yuv_offset;
+	size_t frame_size;
+};
+
+struct plug417_video_frame {
+	uint16_t *y16;
+	uint8_t *yuv;
+	uint16_t *param;
+	unsigned int width;
+	unsigned int height;
+	unsigned int stride;
+	uint32_t sequence;
+	uint64_t timestamp;
+	int index;
+	struct plug417_param info;	/* valid only with a parameter line */
+};
+
+/*
+ * Region of interest in frame pixels
+ */
+struct plug417_roi {
+	unsigned int x;
+	unsigned int y;
+	unsigned int width;
+	unsigned int height;
+};
+
+struct plug417_video {
+	int fd;
+	int source;
+	unsigned int resolution;
+	unsigned int format;
+	unsigned int interface;
+	struct plug417_video_layout layout;
+	unsigned int count;
+	uint32_t busy;
+	void *map[PLUG417_VIDEO_BUFFERS_MAX];
+	size_t map_size[PLUG417_VIDEO_BUFFERS_MAX];
+	struct plug417_video_frame frames[PLUG417_VIDEO_BUFFERS_MAX];
+	uint8_t *file;
+	size_t file_size;
+	size_t file_pos;
+	uint32_t sequence;
+};
+
+int plug417_video_resolution(unsigned int resolution, unsigned int *width,
+		unsigned int *height);
+
+int plug417_video_layout(unsigned int resolution, unsigned int format,
+		struct plug417_video_layout *l);
+
+struct plug417_video *plug417_video_open(const char *path, unsigned int resolution,
+		unsigned int format, unsigned int interface, unsigned int buffers);
+
+void plug417_video_close(struct plug417_video *v);
+
+int plug417_video_dequeue(struct plug417_video *v, struct plug417_video_frame **frame,
+		int timeout);
+
+int plug417_video_queue(struct plug417_video *v, struct plug417_video_frame *frame);
+
+void plug417_video_swap16(uint16_t *buf, size_t count);
+
+int plug417_video_roi(const struct plug417_video_frame *f, const struct plug417_roi *roi,
+		struct plug417_roi *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
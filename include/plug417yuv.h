@@ -0,0 +1,63 @@
+/*
+ * PLUG417 BT.656 stream decoding and YUV422 conversion
+ */
+#ifndef _PLUG417_YUV_H_
+#define _PLUG417_YUV_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "plug417video.h"
+
+/* Byte order of packed 4:2:2, BT.656 carries UYVY */
+#define PLUG417_YUV_YUYV		0
+#define PLUG417_YUV_UYVY		1
+
+#define PLUG417_RGB24			0
+#define PLUG417_RGBA			1
+
+#define PLUG417_BT656_SYNC		0	/* looking for a timing reference */
+#define PLUG417_BT656_ACTIVE		1	/* copying an active line */
+
+/*
+ * Stream parser, frame holds one UYVY picture of width * 2 bytes per line
+ */
+struct plug417_bt656 {
+	unsigned int width;
+	unsigned int height;
+	int interlaced;
+	int state;
+	unsigned int sync;
+	unsigned int field;
+	unsigned int lines[2];
+	int vblank;
+	uint8_t *line;
+	unsigned int pos;
+	uint8_t *frame;
+	uint64_t frames;
+	uint64_t errors;
+};
+
+struct plug417_bt656 *plug417_bt656_alloc(unsigned int resolution, int interlaced);
+
+void plug417_bt656_free(struct plug417_bt656 *p);
+
+int plug417_bt656_parse(struct plug417_bt656 *p, const uint8_t *buf, size_t len,
+		size_t *used);
+
+void plug417_yuv_to_rgb(const uint8_t *src, unsigned int src_stride, unsigned int width,
+		unsigned int height, int order, uint8_t *dst, unsigned int dst_stride,
+		int format);
+
+void plug417_yuv_to_gray(const uint8_t *src, unsigned int src_stride, unsigned int width,
+		unsigned int height, int order, uint8_t *dst, unsigned int dst_stride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,336 @@
+/*
+ * plug417 host side automatic gain control, Y16 to 8 bit display
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "plug417agc.h"
+#include "plug417extrema.h"
+#include "plug417simd.h"
+
+static const struct plug417_agc_settings plug417_agc_default = {
+	.mode = PLUG417_ALGORITHM_DIMMING_MODE_LINEAR,
+	.upper = 10,
+	.lower = 10,
+	.brightness = 50,
+	.contrast = 50,
+	.hybrid = 50,
+	.smoothing = 80,
+};
+
+/*
+ * NULL settings start linear with 1 percent thrown at both ends
+ */
+struct plug417_agc *plug417_agc_alloc(const struct plug417_agc_settings *settings)
+{
+	struct plug417_agc *a;
+
+	if (posix_memalign((void **)&a, PLUG417_CACHE_LINE, sizeof(struct plug417_agc)))
+		return NULL;
+
+	memset(a, 0, sizeof(struct plug417_agc));
+	if (plug417_agc_set(a, settings ? settings : &plug417_agc_default) < 0) {
+		free(a);
+		return NULL;
+	}
+	return a;
+}
+
+/*
+ *
+ */
+void plug417_agc_free(struct plug417_agc *a)
+{
+	free(a);
+}
+
+/*
+ *
+ */
+int plug417_agc_set(struct plug417_agc *a, const struct plug417_agc_settings *settings)
+{
+	if (settings->mode > PLUG417_ALGORITHM_DIMMING_MODE_MAX ||
+			settings->upper + settings->lower >= 1000 ||
+			settings->brightness > 100 || settings->contrast > 100 ||
+			settings->hybrid > 100 || settings->smoothing > 99)
+		return -1;
+
+	a->settings = *settings;
+	return 0;
+}
+
+/*
+ * Smoothing is not on the page and is kept
+ */
+int plug417_agc_from_page(struct plug417_agc *a,
+		const struct plug417_alorithm_control_page_1 *page)
+{
+	struct plug417_agc_settings s = a->settings;
+
+	s.mode = page->dimming_mode;
+	s.upper = page->proportion_upper_throwing_point;
+	s.lower = page->proportion_lower_throwing_point;
+	s.brightness = page->brightness;
+	s.contrast = page->contrast;
+	s.hybrid = page->hybrid_dimming_mapping;
+	return plug417_agc_set(a, &s);
+}
+
+/*
+ * Next frame sets the mapping without smoothing, after a scene cut
+ */
+void plug417_agc_reset(struct plug417_agc *a)
+{
+	a->primed = 0;
+}
+
+/*
+ * Bins cover min to max of the frame, four tables break the dependency
+ * between neighbouring pixels that fall in the same bin
+ */
+static void plug417_agc_histogram(struct plug417_agc *a, const struct plug417_video_frame *f)
+{
+	int16_t min = INT16_MAX, max = INT16_MIN, rmin, rmax;
+	const int16_t *p;
+	unsigned int x, y, n = f->width;
+	uint32_t *h0 = a->hist[0], *h1 = a->hist[1], *h2 = a->hist[2], *h3 = a->hist[3];
+	int range;
+
+	for (y = 0; y < f->height; y++) {
+		plug417_extrema_row((const int16_t *)f->y16 + (size_t)y * f->stride, n,
+				&rmin, &rmax);
+		if (rmin < min)
+			min = rmin;
+		if (rmax > max)
+			max = rmax;
+	}
+
+	range = max - min + 1;
+	for (a->shift = 0; (range >> a->shift) >= PLUG417_AGC_BINS; a->shift++)
+		;
+	a->base = min;
+	a->bins = ((range - 1) >> a->shift) + 1;
+	a->total = f->width * f->height;
+
+	memset(a->hist, 0, sizeof(a->hist));
+	for (y = 0; y < f->height; y++) {
+		p = (const int16_t *)f->y16 + (size_t)y * f->stride;
+		for (x = 0; x + 4 <= n; x += 4) {
+			h0[(p[x] - min) >> a->shift]++;
+			h1[(p[x + 1] - min) >> a->shift]++;
+			h2[(p[x + 2] - min) >> a->shift]++;
+			h3[(p[x + 3] - min) >> a->shift]++;
+		}
+		for (; x < n; x++)
+			h0[(p[x] - min) >> a->shift]++;
+	}
+
+	for (x = 0; x < a->bins; x++)
+		h0[x] += h1[x] + h2[x] + h3[x];
+}
+
+/*
+ * Bins below lo and above hi hold the thrown pixels
+ */
+static void plug417_agc_throw(struct plug417_agc *a, unsigned int *lo, unsigned int *hi)
+{
+	const uint32_t *h = a->hist[0];
+	uint64_t lower = (uint64_t)a->total * a->settings.lower / 1000;
+	uint64_t upper = (uint64_t)a->total * a->settings.upper / 1000;
+	uint64_t sum;
+	unsigned int i;
+
+	for (i = 0, sum = 0; i + 1 < a->bins && sum + h[i] <= lower; i++)
+		sum += h[i];
+	*lo = i;
+
+	for (i = a->bins - 1, sum = 0; i > *lo && sum + h[i] <= upper; i--)
+		sum += h[i];
+	*hi = i;
+}
+
+/*
+ * Clipped histogram equalization between lo and hi, 0..255 per bin in
+ * the pixel counts table
+ */
+static void plug417_agc_platform(struct plug417_agc *a, unsigned int lo, unsigned int hi,
+		float *map)
+{
+	const uint32_t *h = a->hist[0];
+	uint64_t sum = 0, used = 0, total = 0, plateau;
+	unsigned int i;
+
+	for (i = lo; i <= hi; i++) {
+		sum += h[i];
+		used += h[i] != 0;
+	}
+	plateau = used ? sum / used * PLUG417_AGC_PLATEAU : 1;
+	if (!plateau)
+		plateau = 1;
+
+	for (i = lo; i <= hi; i++)
+		total += h[i] < plateau ? h[i] : plateau;
+
+	/* Centre of each bin's share of the cumulative distribution */
+	for (i = lo, sum = 0; i <= hi; i++) {
+		uint64_t c = h[i] < plateau ? h[i] : plateau;
+
+		map[i] = total ? (sum + c / 2.0f) * 255.0f / total : 0.0f;
+		sum += c;
+	}
+}
+
+/*
+ * Entries y0 to y1 with a constant target, negative Y16 are in the upper
+ * half of the table
+ */
+static void plug417_agc_smooth(float *curve, int y0, int y1, float target, float keep)
+{
+	int y;
+
+	if (y0 < 0 && y1 >= 0) {
+		plug417_agc_smooth(curve, y0, -1, target, keep);
+		y0 = 0;
+	}
+	curve += (uint16_t)y0;
+	for (y = 0; y <= y1 - y0; y++)
+		curve[y] = keep * curve[y] + (1.0f - keep) * target;
+}
+
+/*
+ * Brightness and contrast applied to the curve, rounded to nearest
+ */
+static void plug417_agc_lut(struct plug417_agc *a, float gain, float offset)
+{
+	unsigned int i = 0;
+	float v;
+
+#if defined(PLUG417_SSE2)
+	const __m128 g = _mm_set1_ps(gain), o = _mm_set1_ps(offset);
+	__m128i q0, q1, q2, q3;
+
+	/* Out of range saturates in the packs */
+	for (; i < PLUG417_AGC_LUT_SIZE; i += 16) {
+		q0 = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_load_ps(a->curve + i), g), o));
+		q1 = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_load_ps(a->curve + i + 4), g), o));
+		q2 = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_load_ps(a->curve + i + 8), g), o));
+		q3 = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_load_ps(a->curve + i + 12), g), o));
+		_mm_store_si128((__m128i *)(a->lut + i), _mm_packus_epi16(
+				_mm_packs_epi32(q0, q1), _mm_packs_epi32(q2, q3)));
+	}
+#elif defined(PLUG417_NEON) && defined(__aarch64__)
+	const float32x4_t g = vdupq_n_f32(gain), o = vdupq_n_f32(offset);
+	int16x8_t lo, hi;
+
+	for (; i < PLUG417_AGC_LUT_SIZE; i += 16) {
+		lo = vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(vmlaq_f32(o, vld1q_f32(a->curve + i), g))),
+				vqmovn_s32(vcvtnq_s32_f32(vmlaq_f32(o, vld1q_f32(a->curve + i + 4), g))));
+		hi = vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(vmlaq_f32(o, vld1q_f32(a->curve + i + 8), g))),
+				vqmovn_s32(vcvtnq_s32_f32(vmlaq_f32(o, vld1q_f32(a->curve + i + 12), g))));
+		vst1q_u8(a->lut + i, vcombine_u8(vqmovun_s16(lo), vqmovun_s16(hi)));
+	}
+#endif
+	for (; i < PLUG417_AGC_LUT_SIZE; i++) {
+		v = a->curve[i] * gain + offset;
+		a->lut[i] = v < 0.0f ? 0 : v > 255.0f ? 255 : lrintf(v);
+	}
+}
+
+/*
+ *
+ */
+int plug417_agc_update(struct plug417_agc *a, const struct plug417_video_frame *f)
+{
+	const struct plug417_agc_settings *s = &a->settings;
+	const float keep = a->primed ? s->smoothing / 100.0f : 0.0f;
+	const float gain = s->contrast / 50.0f;
+	const float offset = 127.5f - 127.5f * gain + (s->brightness - 50) * 2.55f;
+	float map[PLUG417_AGC_BINS], t, lin, k, h;
+	unsigned int lo, hi, bin;
+	int y, ylo, yhi, start, end;
+
+	if (!f->y16 || !f->width || !f->height)
+		return -1;
+
+	plug417_agc_histogram(a, f);
+	plug417_agc_throw(a, &lo, &hi);
+
+	/* Throw points move slowly so the picture does not pump */
+	t = a->base + (float)(lo << a->shift);
+	a->lo = keep * a->lo + (1.0f - keep) * t;
+	t = a->base + (float)(((hi + 1) << a->shift) - 1);
+	a->hi = keep * a->hi + (1.0f - keep) * t;
+	if (a->hi < a->lo + 1.0f)
+		a->hi = a->lo + 1.0f;
+
+	h = s->mode == PLUG417_ALGORITHM_DIMMING_MODE_PLATFORM ? 1.0f :
+			s->mode == PLUG417_ALGORITHM_DIMMING_MODE_HYBRID ? s->hybrid / 100.0f :
+			0.0f;
+	if (h > 0.0f)
+		plug417_agc_platform(a, lo, hi, map);
+
+	k = 255.0f / (a->hi - a->lo);
+	ylo = a->base + (lo << a->shift);
+	yhi = a->base + (int)(((hi + 1) << a->shift) - 1);
+
+	/* Only values between the throw points map to anything but 0 or 255 */
+	start = ylo < a->lo ? ylo : (int)a->lo;
+	end = yhi > a->hi ? yhi : (int)a->hi + 1;
+	if (end > INT16_MAX)
+		end = INT16_MAX;
+	plug417_agc_smooth(a->curve, INT16_MIN, start - 1, 0.0f, keep);
+	plug417_agc_smooth(a->curve, end + 1, INT16_MAX, 255.0f, keep);
+
+	for (y = start; y <= end; y++) {
+		lin = (y - a->lo) * k;
+		lin = lin < 0.0f ? 0.0f : lin > 255.0f ? 255.0f : lin;
+		if (h > 0.0f) {
+			bin = y < ylo ? lo : y > yhi ? hi : (unsigned int)(y - a->base) >> a->shift;
+			t = y < ylo ? 0.0f : y > yhi ? 255.0f : map[bin];
+			lin += (t - lin) * h;
+		}
+		a->curve[(uint16_t)y] = keep * a->curve[(uint16_t)y] + (1.0f - keep) * lin;
+	}
+
+	plug417_agc_lut(a, gain, offset);
+
+	a->primed = 1;
+	return 0;
+}
+
+/*
+ * 8 bit gray, out_stride in bytes
+ */
+int plug417_agc_map(const struct plug417_agc *a, const struct plug417_video_frame *f,
+		uint8_t *out, unsigned int out_stride)
+{
+	const uint16_t *p;
+	uint8_t *d;
+	unsigned int x, y;
+
+	if (!f->y16 || !a->primed)
+		return -1;
+
+	for (y = 0; y < f->height; y++) {
+		p = f->y16 + (size_t)y * f->stride;
+		d = out + (size_t)y * out_stride;
+		for (x = 0; x + 4 <= f->width; x += 4) {
+			d[x] = a->lut[p[x]];
+			d[x + 1] = a->lut[p[x + 1]];
+			d[x + 2] = a->lut[p[x + 2]];
+			d[x + 3] = a->lut[p[x + 3]];
+		}
+		for (; x < f->width; x++)
+			d[x] = a->lut[p[x]];
+	}
+	return 0;
+}
+
+/*
+ * Pipeline stage updating the mapping, add it as ordered for smoothing
+ */
+int plug417_agc_process(void *arg, struct plug417_video_frame *f)
+{
+	return plug417_agc_update(arg, f);
+}
@@ -0,0 +1,218 @@
+/*
+ * plug417 host side temperature alarms
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "plug417alarm.h"
+#include "plug417simd.h"
+
+/*
+ *
+ */
+struct plug417_alarm *plug417_alarm_alloc(unsigned int width, unsigned int height,
+		unsigned int rules)
+{
+	struct plug417_alarm *a;
+
+	if (!rules)
+		return NULL;
+
+	a = malloc(sizeof(struct plug417_alarm));
+	if (!a)
+		return NULL;
+
+	memset(a, 0, sizeof(struct plug417_alarm));
+	a->size = rules;
+	a->area = plug417_area_alloc(width, height);
+	a->rules = calloc(rules, sizeof(struct plug417_alarm_rule));
+	a->areas = calloc(rules, sizeof(struct plug417_area));
+	a->results = calloc(rules, sizeof(struct plug417_area_result));
+	if (!a->area || !a->rules || !a->areas || !a->results) {
+		plug417_alarm_free(a);
+		return NULL;
+	}
+	return a;
+}
+
+/*
+ *
+ */
+void plug417_alarm_free(struct plug417_alarm *a)
+{
+	if (a->area)
+		plug417_area_free(a->area);
+	free(a->rules);
+	free(a->areas);
+	free(a->results);
+	free(a);
+}
+
+/*
+ * Returns the rule number used in events
+ */
+int plug417_alarm_add(struct plug417_alarm *a, const struct plug417_alarm_rule *rule)
+{
+	struct plug417_alarm_rule *r;
+
+	if (a->count == a->size || rule->type < 0 || rule->type > PLUG417_ALARM_TYPE_MAX ||
+			rule->hysteresis < 0 || rule->band_lo > rule->band_hi ||
+			!rule->roi.width || !rule->roi.height ||
+			rule->roi.x + rule->roi.width > a->area->width ||
+			rule->roi.y + rule->roi.height > a->area->height)
+		return -1;
+
+	r = &a->rules[a->count];
+	*r = *rule;
+	r->active = 0;
+	r->pending = 0;
+	r->value = 0;
+	r->last_timestamp = 0;
+
+	a->areas[a->count].roi = rule->roi;
+	return a->count++;
+}
+
+/*
+ * Pixels of roi with lo <= y16 <= hi
+ */
+static unsigned int plug417_alarm_band(const struct plug417_video_frame *f,
+		const struct plug417_roi *roi, int16_t lo, int16_t hi)
+{
+	unsigned int x, y, n = 0;
+	const int16_t *p;
+
+	for (y = roi->y; y < roi->y + roi->height; y++) {
+		p = (const int16_t *)f->y16 + (size_t)y * f->stride + roi->x;
+		x = 0;
+#if defined(PLUG417_SSE2)
+		{
+			__m128i vlo = _mm_set1_epi16(lo - 1), vhi = _mm_set1_epi16(hi);
+			__m128i v, in;
+
+			/* lo - 1 would wrap, such a band is left to the scalar loop */
+			for (; lo > INT16_MIN && x + 8 <= roi->width; x += 8) {
+				v = _mm_loadu_si128((const __m128i *)(p + x));
+				in = _mm_andnot_si128(_mm_cmpgt_epi16(v, vhi),
+						_mm_cmpgt_epi16(v, vlo));
+				n += __builtin_popcount(_mm_movemask_epi8(in)) / 2;
+			}
+		}
+#elif defined(PLUG417_NEON)
+		{
+			int16x8_t vlo = vdupq_n_s16(lo), vhi = vdupq_n_s16(hi);
+			uint16x8_t in, acc = vdupq_n_u16(0);
+			uint64x2_t sum;
+
+			for (; x + 8 <= roi->width; x += 8) {
+				int16x8_t v = vld1q_s16(p + x);
+				in = vandq_u16(vcgeq_s16(v, vlo), vcleq_s16(v, vhi));
+				acc = vsubq_u16(acc, in);
+			}
+			sum = vpaddlq_u32(vpaddlq_u16(acc));
+			n += vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1);
+		}
+#endif
+		for (; x < roi->width; x++)
+			n += p[x] >= lo && p[x] <= hi;
+	}
+	return n;
+}
+
+/*
+ *
+ */
+static int32_t plug417_alarm_value(const struct plug417_video_frame *f,
+		struct plug417_alarm_rule *r, const struct plug417_area_result *res,
+		unsigned int *x, unsigned int *y)
+{
+	int64_t dt, v = 0;
+
+	*x = res->hottest_x;
+	*y = res->hottest_y;
+
+	switch (r->type) {
+		case PLUG417_ALARM_MAX:
+			return res->hottest_y16;
+		case PLUG417_ALARM_MIN:
+			*x = res->coldest_x;
+			*y = res->coldest_y;
+			return res->coldest_y16;
+		case PLUG417_ALARM_MEAN:
+			*x = res->cursor_x;
+			*y = res->cursor_y;
+			return res->regional_y16;
+		case PLUG417_ALARM_ISOTHERM:
+			*x = res->cursor_x;
+			*y = res->cursor_y;
+			return plug417_alarm_band(f, &r->roi, r->band_lo, r->band_hi);
+		case PLUG417_ALARM_RISE:
+			/* First frame has no rate */
+			dt = f->timestamp - r->last_timestamp;
+			if (r->last_timestamp && dt > 0)
+				v = (res->hottest_y16 - r->last_hottest) * 1000000000LL / dt;
+			r->last_hottest = res->hottest_y16;
+			r->last_timestamp = f->timestamp;
+			return v;
+	}
+	return 0;
+}
+
+/*
+ * Debounce counts consecutive frames asking for the state change
+ */
+static int plug417_alarm_update(struct plug417_alarm_rule *r, int32_t v)
+{
+	int change;
+
+	if (r->type == PLUG417_ALARM_MIN)
+		change = r->active ? v >= r->threshold + r->hysteresis : v < r->threshold;
+	else
+		change = r->active ? v <= r->threshold - r->hysteresis : v > r->threshold;
+
+	r->value = v;
+	if (!change) {
+		r->pending = 0;
+		return 0;
+	}
+
+	if (++r->pending < r->debounce)
+		return 0;
+
+	r->pending = 0;
+	r->active = !r->active;
+	return 1;
+}
+
+/*
+ * Callbacks run from here, in rule order, for every raised or cleared
+ * alarm. Returns the number of active alarms.
+ */
+int plug417_alarm_process(struct plug417_alarm *a, const struct plug417_video_frame *f)
+{
+	struct plug417_alarm_event ev;
+	struct plug417_alarm_rule *r;
+	unsigned int i;
+	int active = 0;
+	int32_t v;
+
+	if (plug417_area_update(a->area, f) < 0 ||
+			plug417_area_analyze(a->area, a->areas, a->results, a->count) < 0)
+		return -1;
+
+	for (i = 0; i < a->count; i++) {
+		r = &a->rules[i];
+		v = plug417_alarm_value(f, r, &a->results[i], &ev.x, &ev.y);
+
+		if (plug417_alarm_update(r, v) && r->callback) {
+			ev.rule = i;
+			ev.active = r->active;
+			ev.value = v;
+			ev.sequence = f->sequence;
+			ev.timestamp = f->timestamp;
+			r->callback(r->arg, &ev);
+		}
+		active += r->active;
+	}
+	return active;
+}
@@ -0,0 +1,292 @@
+/*
+ * plug417 host side area analysis
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+
+#include "plug417area.h"
+#include "plug417extrema.h"
+
+#define B	PLUG417_AREA_BLOCK
+
+/*
+ *
+ */
+struct plug417_area_engine *plug417_area_alloc(unsigned int width, unsigned int height)
+{
+	struct plug417_area_engine *e;
+	size_t blocks;
+
+	if (!width || !height)
+		return NULL;
+
+	e = malloc(sizeof(struct plug417_area_engine));
+	if (!e)
+		return NULL;
+
+	memset(e, 0, sizeof(struct plug417_area_engine));
+	e->width = width;
+	e->height = height;
+	e->blocks_x = (width + B - 1) / B;
+	e->blocks_y = (height + B - 1) / B;
+	blocks = (size_t)e->blocks_x * e->blocks_y;
+
+	/* First row and column stay zero */
+	e->sat = calloc((size_t)(width + 1) * (height + 1), sizeof(int64_t));
+	e->block_min = malloc(blocks * sizeof(int16_t));
+	e->block_max = malloc(blocks * sizeof(int16_t));
+	if (!e->sat || !e->block_min || !e->block_max) {
+		plug417_area_free(e);
+		return NULL;
+	}
+	return e;
+}
+
+/*
+ *
+ */
+void plug417_area_free(struct plug417_area_engine *e)
+{
+	free(e->sat);
+	free(e->block_min);
+	free(e->block_max);
+	free(e);
+}
+
+/*
+ * Frame must stay valid until the areas are analyzed
+ */
+int plug417_area_update(struct plug417_area_engine *e, const struct plug417_video_frame *f)
+{
+	const unsigned int w = e->width, sw = e->width + 1;
+	unsigned int x, y, bx, by, n;
+	const int16_t *p;
+	int64_t *s, *above, row;
+	int16_t mn, mx, *bmin, *bmax;
+
+	if (!f->y16 || f->width != e->width || f->height != e->height)
+		return -1;
+
+	e->frame = f;
+
+	for (y = 0; y < e->height; y++) {
+		p = (const int16_t *)f->y16 + (size_t)y * f->stride;
+		s = e->sat + (size_t)(y + 1) * sw + 1;
+		above = s - sw;
+		row = 0;
+		for (x = 0; x < w; x++) {
+			row += p[x];
+			s[x] = above[x] + row;
+		}
+	}
+
+	for (by = 0; by < e->blocks_y; by++) {
+		bmin = e->block_min + (size_t)by * e->blocks_x;
+		bmax = e->block_max + (size_t)by * e->blocks_x;
+		for (bx = 0; bx < e->blocks_x; bx++) {
+			bmin[bx] = INT16_MAX;
+			bmax[bx] = INT16_MIN;
+		}
+
+		for (y = by * B; y < (by + 1) * B && y < e->height; y++) {
+			p = (const int16_t *)f->y16 + (size_t)y * f->stride;
+			for (bx = 0; bx < e->blocks_x; bx++) {
+				n = w - bx * B < B ? w - bx * B : B;
+				plug417_extrema_row(p + bx * B, n, &mn, &mx);
+				if (mn < bmin[bx])
+					bmin[bx] = mn;
+				if (mx > bmax[bx])
+					bmax[bx] = mx;
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * Best value so far and the rectangle it was seen in
+ */
+struct plug417_area_best {
+	int16_t value;
+	struct plug417_roi where;
+};
+
+/*
+ *
+ */
+static void plug417_area_rect(struct plug417_area_best *b, int16_t v, int max,
+		unsigned int x, unsigned int y, unsigned int w, unsigned int h)
+{
+	if (max ? v <= b->value : v >= b->value)
+		return;
+
+	b->value = v;
+	b->where.x = x;
+	b->where.y = y;
+	b->where.width = w;
+	b->where.height = h;
+}
+
+/*
+ *
+ */
+static void plug417_area_segment(const struct plug417_area_engine *e,
+		struct plug417_area_best *mn, struct plug417_area_best *mx,
+		unsigned int x, unsigned int y, unsigned int w)
+{
+	const struct plug417_video_frame *f = e->frame;
+	int16_t lo, hi;
+
+	if (!w)
+		return;
+
+	plug417_extrema_row((const int16_t *)f->y16 + (size_t)y * f->stride + x, w, &lo, &hi);
+	plug417_area_rect(mn, lo, 0, x, y, w, 1);
+	plug417_area_rect(mx, hi, 1, x, y, w, 1);
+}
+
+/*
+ * First pixel holding value inside the rectangle it was found in
+ */
+static void plug417_area_locate(const struct plug417_area_engine *e,
+		const struct plug417_area_best *b, unsigned int *px, unsigned int *py)
+{
+	const struct plug417_video_frame *f = e->frame;
+	const int16_t *p;
+	unsigned int x, y;
+
+	for (y = b->where.y; y < b->where.y + b->where.height; y++) {
+		p = (const int16_t *)f->y16 + (size_t)y * f->stride;
+		for (x = b->where.x; x < b->where.x + b->where.width; x++) {
+			if (p[x] == b->value) {
+				*px = x;
+				*py = y;
+				return;
+			}
+		}
+	}
+}
+
+/*
+ * Blocks fully covered by the area use the block extremes, only the
+ * uncovered border is scanned
+ */
+static void plug417_area_one(const struct plug417_area_engine *e,
+		const struct plug417_area *a, struct plug417_area_result *r)
+{
+	const struct plug417_roi *roi = &a->roi;
+	const struct plug417_video_frame *f = e->frame;
+	const unsigned int sw = e->width + 1;
+	unsigned int x0 = roi->x, x1 = roi->x + roi->width;
+	unsigned int y0 = roi->y, y1 = roi->y + roi->height;
+	unsigned int bx0, bx1, by0, by1, bx, by, y, ix0, ix1, iy0, iy1;
+	struct plug417_area_best mn, mx;
+	const int64_t *s = e->sat;
+	int64_t sum;
+	size_t i;
+
+	bx0 = (x0 + B - 1) / B;
+	bx1 = x1 == e->width ? e->blocks_x : x1 / B;
+	by0 = (y0 + B - 1) / B;
+	by1 = y1 == e->height ? e->blocks_y : y1 / B;
+	if (bx0 >= bx1 || by0 >= by1)
+		bx0 = bx1 = by0 = by1 = 0;
+
+	ix0 = bx0 * B;
+	ix1 = bx1 * B < x1 ? bx1 * B : x1;
+	iy0 = by0 * B;
+	iy1 = by1 * B < y1 ? by1 * B : y1;
+
+	mn.value = INT16_MAX;
+	mx.value = INT16_MIN;
+	mn.where = mx.where = *roi;
+
+	for (by = by0; by < by1; by++) {
+		for (bx = bx0; bx < bx1; bx++) {
+			i = (size_t)by * e->blocks_x + bx;
+			plug417_area_rect(&mn, e->block_min[i], 0, bx * B, by * B,
+					(bx + 1) * B < e->width ? B : e->width - bx * B,
+					(by + 1) * B < e->height ? B : e->height - by * B);
+			plug417_area_rect(&mx, e->block_max[i], 1, bx * B, by * B,
+					(bx + 1) * B < e->width ? B : e->width - bx * B,
+					(by + 1) * B < e->height ? B : e->height - by * B);
+		}
+	}
+
+	for (y = y0; y < y1; y++) {
+		if (y >= iy0 && y < iy1) {
+			plug417_area_segment(e, &mn, &mx, x0, y, ix0 - x0);
+			plug417_area_segment(e, &mn, &mx, ix1, y, x1 - ix1);
+		} else {
+			plug417_area_segment(e, &mn, &mx, x0, y, x1 - x0);
+		}
+	}
+
+	memset(r, 0, sizeof(struct plug417_area_result));
+	r->coldest_y16 = mn.value;
+	plug417_area_locate(e, &mn, &r->coldest_x, &r->coldest_y);
+	r->hottest_y16 = mx.value;
+	plug417_area_locate(e, &mx, &r->hottest_x, &r->hottest_y);
+
+	r->cursor_x = x0 + roi->width / 2;
+	r->cursor_y = y0 + roi->height / 2;
+	r->cursor_y16 = f->y16[(size_t)r->cursor_y * f->stride + r->cursor_x];
+
+	sum = s[(size_t)y1 * sw + x1] - s[(size_t)y0 * sw + x1] -
+		s[(size_t)y1 * sw + x0] + s[(size_t)y0 * sw + x0];
+	r->count = roi->width * roi->height;
+	r->regional_y16 = sum >= 0 ? (sum + r->count / 2) / r->count :
+		(sum - (int64_t)(r->count / 2)) / (int64_t)r->count;
+
+	r->exceeds = a->alarm && r->hottest_y16 > a->alarm_threshold;
+}
+
+/*
+ *
+ */
+int plug417_area_analyze(struct plug417_area_engine *e, const struct plug417_area *areas,
+		struct plug417_area_result *results, unsigned int count)
+{
+	struct plug417_roi r;
+	unsigned int i;
+
+	if (!e->frame)
+		return -1;
+
+	for (i = 0; i < count; i++) {
+		if (plug417_video_roi(e->frame, &areas[i].roi, &r) < 0)
+			return -1;
+	}
+
+	for (i = 0; i < count; i++)
+		plug417_area_one(e, &areas[i], &results[i]);
+
+	return 0;
+}
+
+/*
+ * Page fields are big endian, as received from the sensor
+ */
+void plug417_area_to_page(const struct plug417_area *a, const struct plug417_area_result *r,
+		struct plug417_area_analysis_page *page)
+{
+	memset(page, 0, sizeof(struct plug417_area_analysis_page));
+	page->x = htobe16(a->roi.x);
+	page->y = htobe16(a->roi.y);
+	page->width = htobe16(a->roi.width);
+	page->height = htobe16(a->roi.height);
+	page->high_temperature_alarm = a->alarm ? 1 : 0;
+	page->high_temperature_alarm_threshold = htobe16(a->alarm_threshold);
+	page->temperature_exceeds_alarm_threshold = r->exceeds ? 1 : 0;
+	page->coldest_x = htobe16(r->coldest_x);
+	page->coldest_y = htobe16(r->coldest_y);
+	page->coldest_temperature_y16 = htobe16(r->coldest_y16);
+	page->hottest_x = htobe16(r->hottest_x);
+	page->hottest_y = htobe16(r->hottest_y);
+	page->hottest_temperature_y16 = htobe16(r->hottest_y16);
+	page->cursor_x = htobe16(r->cursor_x);
+	page->cursor_y = htobe16(r->cursor_y);
+	page->cursor_temperature_y16 = htobe16(r->cursor_y16);
+	page->regional_temperature_y16 = htobe16(r->regional_y16);
+}
@@ -0,0 +1,359 @@
+/*
+ * plug417 blackbody calibration
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "plug417calib.h"
+
+/*
+ * NULL roi averages the whole frame, frames per point 0 uses 16
+ */
+struct plug417_calib *plug417_calib_alloc(const struct plug417_roi *roi, unsigned int frames)
+{
+	struct plug417_calib *c;
+
+	c = malloc(sizeof(struct plug417_calib));
+	if (!c)
+		return NULL;
+
+	memset(c, 0, sizeof(struct plug417_calib));
+	if (roi)
+		c->roi = *roi;
+	else
+		c->whole = 1;
+	c->frames = frames ? frames : 16;
+	c->skip = PLUG417_CALIB_SKIP;
+	return c;
+}
+
+/*
+ *
+ */
+void plug417_calib_free(struct plug417_calib *c)
+{
+	free(c);
+}
+
+/*
+ * Points are measured in the order added
+ */
+int plug417_calib_point(struct plug417_calib *c, int16_t reference, unsigned int range)
+{
+	struct plug417_calib_point *p;
+
+	if (c->count == PLUG417_CALIB_POINTS_MAX || range >= PLUG417_CALIB_RANGES)
+		return -1;
+
+	p = &c->points[c->count++];
+	memset(p, 0, sizeof(struct plug417_calib_point));
+	p->reference = reference;
+	p->range = range;
+	return 0;
+}
+
+/*
+ * Sent before every point, e.g. emissivity 100 and distance 0 so that
+ * the sensor reports the blackbody temperature uncompensated
+ */
+int plug417_calib_setting(struct plug417_calib *c, uint8_t functional, uint8_t page,
+		uint8_t option, uint32_t command)
+{
+	struct plug417_batch *b;
+
+	if (c->settings == PLUG417_CALIB_SETTINGS_MAX)
+		return -1;
+
+	b = &c->setup[c->settings++];
+	b->functional = functional;
+	b->page = page;
+	b->option = option;
+	b->command = command;
+	return 0;
+}
+
+/*
+ *
+ */
+void plug417_calib_set_blackbody(struct plug417_calib *c, plug417_calib_blackbody blackbody,
+		void *arg)
+{
+	c->blackbody = blackbody;
+	c->arg = arg;
+}
+
+/*
+ * Adds a frame to the current point. Returns 1 when the point is
+ * complete, 0 when more frames are needed, -1 when all points are done
+ * or the ROI does not fit the frame.
+ */
+int plug417_calib_frame(struct plug417_calib *c, const struct plug417_video_frame *f)
+{
+	struct plug417_calib_point *p;
+	struct plug417_roi r;
+	const int16_t *row;
+	unsigned int x, y;
+	int64_t sum = 0;
+	double mean;
+
+	if (c->current >= c->count || !f->y16)
+		return -1;
+
+	if (plug417_video_roi(f, c->whole ? NULL : &c->roi, &r) < 0)
+		return -1;
+
+	if (c->skipped < c->skip) {
+		c->skipped++;
+		return 0;
+	}
+
+	for (y = r.y; y < r.y + r.height; y++) {
+		row = (const int16_t *)f->y16 + (size_t)y * f->stride + r.x;
+		for (x = 0; x < r.width; x++)
+			sum += row[x];
+	}
+	mean = (double)sum / ((double)r.width * r.height);
+
+	p = &c->points[c->current];
+	p->sum += mean;
+	p->sum2 += mean * mean;
+	p->frames++;
+	if (p->frames < c->frames)
+		return 0;
+
+	p->mean = p->sum / p->frames;
+	p->noise = p->sum2 / p->frames - p->mean * p->mean;
+	p->noise = p->noise > 0.0 ? sqrt(p->noise) : 0.0;
+	c->current++;
+	c->skipped = 0;
+	return 1;
+}
+
+/*
+ * Range, zero correction and the user settings in one batch
+ */
+static int plug417_calib_prepare(struct plug417_calib *c, struct plug417_serial *s,
+		unsigned int range)
+{
+	struct plug417_batch b[PLUG417_CALIB_SETTINGS_MAX + 2];
+	unsigned int n;
+
+	memcpy(b, c->setup, c->settings * sizeof(struct plug417_batch));
+	n = c->settings;
+
+	memset(&b[n], 0, 2 * sizeof(struct plug417_batch));
+	b[n].functional = PLUG417_TEMPERATURE_MEASUREMENT_PAGE;
+	b[n].page = PLUG417_PARAMETER_SETTING_PAGE;
+	b[n].option = PLUG417_OPTION_TEMPERATURE_MEASUREMENT_RANGE;
+	b[n].command = range;
+	n++;
+	b[n].functional = PLUG417_TEMPERATURE_MEASUREMENT_PAGE;
+	b[n].page = PLUG417_PARAMETER_SETTING_PAGE;
+	b[n].option = PLUG417_OPTION_TEMPERATURE_CALIBRATION;
+	b[n].command = 0;
+	n++;
+
+	return plug417_send_batch(s, b, n, 0) == (int)n ? 0 : -1;
+}
+
+/*
+ * Measures every point not measured yet: blackbody, sensor settings,
+ * then frames from v until the point is complete
+ */
+int plug417_calib_run(struct plug417_calib *c, struct plug417_serial *s,
+		struct plug417_video *v)
+{
+	struct plug417_calib_point *p;
+	struct plug417_video_frame *f;
+	int err;
+
+	while (c->current < c->count) {
+		p = &c->points[c->current];
+		if (c->blackbody && c->blackbody(c->arg, p->reference) < 0)
+			return -1;
+
+		if (s && plug417_calib_prepare(c, s, p->range) < 0)
+			return -1;
+
+		p->sum = 0.0;
+		p->sum2 = 0.0;
+		p->frames = 0;
+		c->skipped = 0;
+		do {
+			if (plug417_video_dequeue(v, &f, 1000) != 0)
+				return -1;
+			err = plug417_calib_frame(c, f);
+			plug417_video_queue(v, f);
+		} while (err == 0);
+
+		if (err < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * Least squares per range over the measured points
+ */
+int plug417_calib_fit(struct plug417_calib *c)
+{
+	struct plug417_calib_point *p;
+	struct plug417_calib_fit *fit;
+	double sx, sy, sxx, sxy, d, e;
+	unsigned int i, r;
+	int fitted = 0;
+
+	for (r = 0; r < PLUG417_CALIB_RANGES; r++) {
+		fit = &c->fit[r];
+		memset(fit, 0, sizeof(struct plug417_calib_fit));
+		fit->gain = 1.0;
+		sx = sy = sxx = sxy = 0.0;
+
+		for (i = 0; i < c->current; i++) {
+			p = &c->points[i];
+			if (p->range != r)
+				continue;
+			sx += p->mean;
+			sy += p->reference;
+			sxx += p->mean * p->mean;
+			sxy += p->mean * p->reference;
+			fit->points++;
+		}
+		if (!fit->points)
+			continue;
+
+		fit->shift = (sy - sx) / fit->points;
+		d = fit->points * sxx - sx * sx;
+		if (fit->points > 1 && fabs(d) > 1e-9) {
+			fit->gain = (fit->points * sxy - sx * sy) / d;
+			fit->offset = (sy - fit->gain * sx) / fit->points;
+		} else {
+			fit->offset = fit->shift;
+		}
+
+		for (i = 0; i < c->current; i++) {
+			p = &c->points[i];
+			if (p->range != r)
+				continue;
+			e = fabs(fit->gain * p->mean + fit->offset - p->reference);
+			if (e > fit->residual)
+				fit->residual = e;
+			e = fabs(p->mean + fit->shift - p->reference);
+			if (e > fit->residual_shift)
+				fit->residual_shift = e;
+		}
+		fitted++;
+	}
+	return fitted ? 0 : -1;
+}
+
+/*
+ * Host side correction with the full linear fit
+ */
+int16_t plug417_calib_correct(const struct plug417_calib *c, unsigned int range, int16_t y16)
+{
+	const struct plug417_calib_fit *fit;
+	double v;
+
+	if (range >= PLUG417_CALIB_RANGES || !c->fit[range].points)
+		return y16;
+
+	fit = &c->fit[range];
+	v = fit->gain * y16 + fit->offset;
+	if (v > INT16_MAX)
+		return INT16_MAX;
+	if (v < INT16_MIN)
+		return INT16_MIN;
+	return (int16_t)lrint(v);
+}
+
+/*
+ * The correction of every fitted range and optionally saving them, all
+ * in one batch. The sensor ends up in the last fitted range.
+ */
+int plug417_calib_write(struct plug417_calib *c, struct plug417_serial *s, int save)
+{
+	struct plug417_batch b[2 * PLUG417_CALIB_RANGES + 1];
+	unsigned int n = 0, r;
+	long v;
+
+	memset(b, 0, sizeof(b));
+	for (r = 0; r < PLUG417_CALIB_RANGES; r++) {
+		if (!c->fit[r].points)
+			continue;
+
+		v = lrint(c->fit[r].shift);
+		if (v > INT16_MAX)
+			v = INT16_MAX;
+		if (v < INT16_MIN)
+			v = INT16_MIN;
+
+		b[n].functional = PLUG417_TEMPERATURE_MEASUREMENT_PAGE;
+		b[n].page = PLUG417_PARAMETER_SETTING_PAGE;
+		b[n].option = PLUG417_OPTION_TEMPERATURE_MEASUREMENT_RANGE;
+		b[n].command = r;
+		n++;
+		b[n].functional = PLUG417_TEMPERATURE_MEASUREMENT_PAGE;
+		b[n].page = PLUG417_PARAMETER_SETTING_PAGE;
+		b[n].option = PLUG417_OPTION_TEMPERATURE_CALIBRATION;
+		b[n].command = (uint32_t)v;
+		n++;
+	}
+	if (!n)
+		return -1;
+
+	if (save) {
+		b[n].functional = PLUG417_TEMPERATURE_MEASUREMENT_PAGE;
+		b[n].page = PLUG417_PARAMETER_SETTING_PAGE;
+		b[n].option = PLUG417_OPTION_TM_SAVE_SETTINGS;
+		b[n].command = 1;
+		n++;
+	}
+
+	return plug417_send_batch(s, b, n, 0) == (int)n ? 0 : -1;
+}
+
+/*
+ * One record per point, the fits as text
+ */
+int plug417_calib_report(struct plug417_calib *c, struct plug417_output *o)
+{
+	int passes = o->format == PLUG417_FORMAT_CSV ? 2 : 1;
+	struct plug417_calib_point *p;
+	struct plug417_calib_fit *fit;
+	unsigned int i, r;
+
+	for (r = 0; r < PLUG417_CALIB_RANGES; r++) {
+		fit = &c->fit[r];
+		if (!fit->points)
+			continue;
+		plug417_out_text(o, "Range %u: %u points, gain %.5f offset %.2f residual %.2f C, "
+				"sensor correction %.0f residual %.2f C\n", r, fit->points,
+				fit->gain, fit->offset, fit->residual / 10.0,
+				fit->shift, fit->residual_shift / 10.0);
+	}
+
+	for (o->pass = 0; o->pass < passes; o->pass++) {
+		for (i = 0; i < c->current; i++) {
+			/* CSV header once */
+			if (o->pass == 0 && passes == 2 && i)
+				break;
+			p = &c->points[i];
+			fit = &c->fit[p->range];
+			plug417_out_begin(o, PLUG417_FUNCTIONAL_HOST, PLUG417_HOST_CALIB_POINT,
+					"Calibration point");
+			plug417_out_field(o, "point", "Point", i, NULL);
+			plug417_out_field(o, "range", "Range", p->range, NULL);
+			plug417_out_fixed(o, "reference", "Reference", p->reference, 0.1);
+			plug417_out_fixed(o, "measured", "Measured", llrint(p->mean * 10), 0.01);
+			plug417_out_fixed(o, "noise", "Noise", llrint(p->noise * 10), 0.01);
+			plug417_out_fixed(o, "corrected", "Corrected",
+					llrint((fit->gain * p->mean + fit->offset) * 10), 0.01);
+			plug417_out_field(o, "frames", "Frames", p->frames, NULL);
+			plug417_out_end(o, PLUG417_FUNCTIONAL_HOST, PLUG417_HOST_CALIB_POINT);
+		}
+	}
+	return o->overflow ? -1 : 0;
+}
@@ -132,6 +132,11 @@ static const struct plug417_sub_cmd plug417_cmd_digital_video[] = {
 	{NULL},
 };
 
+static const struct plug417_sub_cmd plug417_cmd_setup[] = {
+	{"shutter", "s", plug417_set_shutter_control, NULL, 1, "Shutter control, run shutter compensation now"},
+	{NULL},
+};
+
 static const struct plug417_sub_cmd plug417_cmd_small_icon[] = {
 	{"num", "n", NULL, NULL, -1, "Small icon number"
 			PARAM_PREFIX"0 or 1"},
@@ -264,6 +269,7 @@ static const struct plug417_cmd plug417_cmd[] = {
 	{"Area Analysis", "area", plug417_cmd_area_analisys},
 	{"Hotspot tracking", "hptrack", plug417_cmd_hotspot_tracking},
 	{"Temperature measurement", "temp", plug417_cmd_temperature_measurement},
+	{"Setup", "setup", plug417_cmd_setup},
 	{NULL},
 };
 
@@ -370,7 +376,7 @@ int plug417_set_command(struct plug417_serial *s, const char *cmd)
 {
 	char parm[64];
 	char val[64];
-	int err;
+	int err = -1;
 	const struct plug417_cmd *c = plug417_cmd;
 
 	cmd = parse_elm(cmd, parm, val, sizeof(parm));
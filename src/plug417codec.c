@@ -0,0 +1,458 @@
+/*
+ * plug417 lossless Y16 codec
+ *
+ * Each pixel is predicted from its left, upper and upper left neighbours
+ * with the LOCO-I median edge detector, in inter frames on the difference
+ * to the previous frame. Residuals are folded to unsigned and Rice coded
+ * in blocks of 32 with one parameter per block.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "plug417codec.h"
+#include "plug417simd.h"
+
+#define PLUG417_CODEC_MAGIC0	'Y'
+#define PLUG417_CODEC_MAGIC1	'C'
+
+#define BLOCK			32
+#define ESCAPE			24	/* unary length for raw 16 bit values */
+#define SAMPLE			16	/* row step for inter/intra estimation */
+
+struct plug417_bit_writer {
+	uint8_t *p;
+	uint8_t *end;
+	uint64_t acc;
+	int bits;
+	int overflow;
+};
+
+struct plug417_bit_reader {
+	const uint8_t *start;
+	const uint8_t *p;
+	const uint8_t *end;
+	uint64_t acc;
+	int bits;
+};
+
+/*
+ * Up to 32 bits, most significant first
+ */
+static inline void plug417_bit_put(struct plug417_bit_writer *w, uint32_t v, int n)
+{
+	w->acc = (w->acc << n) | v;
+	w->bits += n;
+	while (w->bits >= 8) {
+		w->bits -= 8;
+		if (w->p < w->end)
+			*w->p++ = w->acc >> w->bits;
+		else
+			w->overflow = 1;
+	}
+}
+
+/*
+ *
+ */
+static inline void plug417_bit_flush(struct plug417_bit_writer *w)
+{
+	if (w->bits)
+		plug417_bit_put(w, 0, 8 - w->bits);
+}
+
+/*
+ * Keeps more than 56 bits left aligned in acc, zeros past the end
+ */
+static inline void plug417_bit_refill(struct plug417_bit_reader *r)
+{
+	while (r->bits <= 56) {
+		r->acc |= (uint64_t)(r->p < r->end ? *r->p : 0) << (56 - r->bits);
+		r->p++;
+		r->bits += 8;
+	}
+}
+
+/*
+ *
+ */
+static inline uint32_t plug417_bit_get(struct plug417_bit_reader *r, int n)
+{
+	uint32_t v;
+
+	if (!n)
+		return 0;
+
+	plug417_bit_refill(r);
+	v = r->acc >> (64 - n);
+	r->acc <<= n;
+	r->bits -= n;
+	return v;
+}
+
+/*
+ * Leading ones, up to ESCAPE, terminating zero consumed
+ */
+static inline unsigned int plug417_bit_unary(struct plug417_bit_reader *r)
+{
+	unsigned int q;
+
+	plug417_bit_refill(r);
+	q = ~r->acc ? __builtin_clzll(~r->acc) : 64;
+	if (q >= ESCAPE) {
+		r->acc <<= ESCAPE;
+		r->bits -= ESCAPE;
+		return ESCAPE;
+	}
+	r->acc <<= q + 1;
+	r->bits -= q + 1;
+	return q;
+}
+
+/*
+ * Read past the end of input
+ */
+static inline int plug417_bit_overrun(const struct plug417_bit_reader *r)
+{
+	return (size_t)(r->p - r->start) * 8 - r->bits > (size_t)(r->end - r->start) * 8;
+}
+
+/*
+ *
+ */
+static inline uint16_t plug417_codec_fold(uint16_t v)
+{
+	int16_t r = v;
+
+	return (uint16_t)(r << 1) ^ (uint16_t)(r >> 15);
+}
+
+/*
+ *
+ */
+static inline uint16_t plug417_codec_unfold(uint16_t z)
+{
+	return (z >> 1) ^ (uint16_t)-(z & 1);
+}
+
+/*
+ * Median edge detector
+ */
+static inline uint16_t plug417_codec_med(uint16_t a, uint16_t b, uint16_t c)
+{
+	uint16_t mn = a < b ? a : b, mx = a < b ? b : a;
+
+	if (c >= mx)
+		return mn;
+	if (c <= mn)
+		return mx;
+	return a + b - c;
+}
+
+/*
+ * Folded residuals of one row, up is NULL for the first row
+ */
+static void plug417_codec_predict(const uint16_t *s, const uint16_t *up, uint16_t *z,
+		unsigned int w)
+{
+	unsigned int x = 1;
+
+	if (!up) {
+		z[0] = plug417_codec_fold(s[0]);
+		for (; x < w; x++)
+			z[x] = plug417_codec_fold(s[x] - s[x - 1]);
+		return;
+	}
+
+	z[0] = plug417_codec_fold(s[0] - up[0]);
+
+#if defined(PLUG417_SSE2)
+	{
+		/* Biased to signed, SSE2 has no unsigned 16 bit min/max */
+		const __m128i bias = _mm_set1_epi16((short)0x8000);
+		__m128i a, b, c, mn, mx, p, r;
+
+		for (; x + 8 <= w; x += 8) {
+			a = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(s + x - 1)), bias);
+			b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(up + x)), bias);
+			c = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(up + x - 1)), bias);
+			mn = _mm_min_epi16(a, b);
+			mx = _mm_max_epi16(a, b);
+
+			/* Bias cancels except once, gradient stays biased */
+			p = _mm_sub_epi16(_mm_add_epi16(a, b), c);
+			r = _mm_cmpgt_epi16(c, mn);
+			p = _mm_or_si128(_mm_and_si128(r, p), _mm_andnot_si128(r, mx));
+			r = _mm_cmplt_epi16(c, mx);
+			p = _mm_or_si128(_mm_and_si128(r, p), _mm_andnot_si128(r, mn));
+
+			r = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)(s + x)),
+					_mm_xor_si128(p, bias));
+			r = _mm_xor_si128(_mm_slli_epi16(r, 1), _mm_srai_epi16(r, 15));
+			_mm_storeu_si128((__m128i *)(z + x), r);
+		}
+	}
+#endif
+	for (; x < w; x++)
+		z[x] = plug417_codec_fold(s[x] - plug417_codec_med(s[x - 1], up[x], up[x - 1]));
+}
+
+/*
+ *
+ */
+static void plug417_codec_rice(struct plug417_bit_writer *bw, const uint16_t *z,
+		unsigned int w)
+{
+	unsigned int i, j, n, k, q;
+	uint32_t sum;
+
+	for (i = 0; i < w; i += n) {
+		n = w - i < BLOCK ? w - i : BLOCK;
+
+		for (sum = 0, j = 0; j < n; j++)
+			sum += z[i + j];
+		for (k = 0; k < 15 && (n << (k + 1)) <= sum; k++)
+			;
+		plug417_bit_put(bw, k, 4);
+
+		for (j = i; j < i + n; j++) {
+			q = z[j] >> k;
+			if (q < ESCAPE) {
+				plug417_bit_put(bw, ((1U << q) - 1) << 1, q + 1);
+				plug417_bit_put(bw, z[j] & ((1U << k) - 1), k);
+			} else {
+				plug417_bit_put(bw, (1U << ESCAPE) - 1, ESCAPE);
+				plug417_bit_put(bw, z[j], 16);
+			}
+		}
+	}
+}
+
+/*
+ *
+ */
+static void plug417_codec_unrice(struct plug417_bit_reader *br, uint16_t *z,
+		unsigned int w)
+{
+	unsigned int i, j, n, k, q;
+
+	for (i = 0; i < w; i += n) {
+		n = w - i < BLOCK ? w - i : BLOCK;
+		k = plug417_bit_get(br, 4);
+
+		for (j = i; j < i + n; j++) {
+			q = plug417_bit_unary(br);
+			if (q < ESCAPE)
+				z[j] = (q << k) | plug417_bit_get(br, k);
+			else
+				z[j] = plug417_bit_get(br, 16);
+		}
+	}
+}
+
+/*
+ *
+ */
+struct plug417_codec *plug417_codec_alloc(unsigned int width, unsigned int height,
+		unsigned int keyframe)
+{
+	struct plug417_codec *c;
+
+	if (!width || !height || width > UINT16_MAX || height > UINT16_MAX)
+		return NULL;
+
+	c = malloc(sizeof(struct plug417_codec));
+	if (!c)
+		return NULL;
+
+	memset(c, 0, sizeof(struct plug417_codec));
+	c->width = width;
+	c->height = height;
+	c->keyframe = keyframe ? keyframe : PLUG417_CODEC_KEYFRAME;
+	c->prev = malloc((size_t)width * height * sizeof(uint16_t));
+	c->rows[0] = malloc(width * sizeof(uint16_t));
+	c->rows[1] = malloc(width * sizeof(uint16_t));
+	c->residual = malloc(width * sizeof(uint16_t));
+	if (!c->prev || !c->rows[0] || !c->rows[1] || !c->residual) {
+		plug417_codec_free(c);
+		return NULL;
+	}
+	return c;
+}
+
+/*
+ *
+ */
+void plug417_codec_free(struct plug417_codec *c)
+{
+	free(c->prev);
+	free(c->rows[0]);
+	free(c->rows[1]);
+	free(c->residual);
+	free(c);
+}
+
+/*
+ * Worst case compressed size, every value escaped
+ */
+size_t plug417_codec_bound(unsigned int width, unsigned int height)
+{
+	return sizeof(struct plug417_codec_header) + (size_t)width * height * 5 +
+		(size_t)height * ((width + BLOCK - 1) / BLOCK) + 8;
+}
+
+/*
+ * Row predicted from, the frame itself or its difference to the previous
+ */
+static const uint16_t *plug417_codec_source(struct plug417_codec *c,
+		const struct plug417_video_frame *f, unsigned int y, int mode, uint16_t *s)
+{
+	const uint16_t *src = f->y16 + (size_t)y * f->stride;
+	const uint16_t *prev = c->prev + (size_t)y * c->width;
+	unsigned int x;
+
+	if (mode == PLUG417_CODEC_INTRA)
+		return src;
+
+	for (x = 0; x < c->width; x++)
+		s[x] = src[x] - prev[x];
+	return s;
+}
+
+/*
+ * Estimated code length over a sample of rows, bit length of each
+ * folded residual
+ */
+static uint64_t plug417_codec_cost(struct plug417_codec *c,
+		const struct plug417_video_frame *f, int mode)
+{
+	const uint16_t *s, *up;
+	uint64_t sum = 0;
+	unsigned int x, y;
+
+	for (y = 1; y < c->height; y += SAMPLE) {
+		up = plug417_codec_source(c, f, y - 1, mode, c->rows[0]);
+		s = plug417_codec_source(c, f, y, mode, c->rows[1]);
+		plug417_codec_predict(s, up, c->residual, c->width);
+		for (x = 0; x < c->width; x++)
+			sum += 32 - __builtin_clz(c->residual[x] | 1);
+	}
+	return sum;
+}
+
+/*
+ * Returns the compressed size
+ */
+int plug417_codec_encode(struct plug417_codec *c, const struct plug417_video_frame *f,
+		uint8_t *out, size_t size)
+{
+	struct plug417_codec_header *h = (struct plug417_codec_header *)out;
+	struct plug417_bit_writer bw;
+	const uint16_t *s, *up = NULL;
+	unsigned int y;
+	int mode = PLUG417_CODEC_INTRA;
+
+	if (!f->y16 || f->width != c->width || f->height != c->height ||
+			size < sizeof(struct plug417_codec_header))
+		return -1;
+
+	if (c->reference && c->frames % c->keyframe &&
+			plug417_codec_cost(c, f, PLUG417_CODEC_INTER) <
+			plug417_codec_cost(c, f, PLUG417_CODEC_INTRA))
+		mode = PLUG417_CODEC_INTER;
+
+	bw.p = out + sizeof(struct plug417_codec_header);
+	bw.end = out + size;
+	bw.acc = 0;
+	bw.bits = 0;
+	bw.overflow = 0;
+
+	for (y = 0; y < c->height; y++) {
+		s = plug417_codec_source(c, f, y, mode, c->rows[y & 1]);
+		plug417_codec_predict(s, up, c->residual, c->width);
+		plug417_codec_rice(&bw, c->residual, c->width);
+		up = s;
+	}
+	plug417_bit_flush(&bw);
+
+	if (bw.overflow)
+		return -1;
+
+	for (y = 0; y < c->height; y++)
+		memcpy(c->prev + (size_t)y * c->width, f->y16 + (size_t)y * f->stride,
+				c->width * sizeof(uint16_t));
+	c->reference = 1;
+	c->frames++;
+
+	h->magic[0] = PLUG417_CODEC_MAGIC0;
+	h->magic[1] = PLUG417_CODEC_MAGIC1;
+	h->version = PLUG417_CODEC_VERSION;
+	h->mode = mode;
+	h->width = c->width;
+	h->height = c->height;
+	h->size = bw.p - out - sizeof(struct plug417_codec_header);
+	return bw.p - out;
+}
+
+/*
+ * Output is width * height Y16 without line padding
+ */
+int plug417_codec_decode(struct plug417_codec *c, const uint8_t *in, size_t len,
+		uint16_t *y16)
+{
+	const struct plug417_codec_header *h = (const struct plug417_codec_header *)in;
+	struct plug417_bit_reader br;
+	const uint16_t *up = NULL, *prev;
+	uint16_t *s, *z = c->residual;
+	unsigned int x, y, w = c->width;
+
+	if (len < sizeof(struct plug417_codec_header) ||
+			h->magic[0] != PLUG417_CODEC_MAGIC0 || h->magic[1] != PLUG417_CODEC_MAGIC1 ||
+			h->version != PLUG417_CODEC_VERSION || h->width != c->width ||
+			h->height != c->height || h->mode > PLUG417_CODEC_INTER ||
+			h->size > len - sizeof(struct plug417_codec_header))
+		return -1;
+
+	/* Inter frames need the previous frame decoded */
+	if (h->mode == PLUG417_CODEC_INTER && !c->reference)
+		return -1;
+
+	br.start = br.p = in + sizeof(struct plug417_codec_header);
+	br.end = br.start + h->size;
+	br.acc = 0;
+	br.bits = 0;
+
+	for (y = 0; y < c->height; y++) {
+		s = c->rows[y & 1];
+		plug417_codec_unrice(&br, z, w);
+
+		if (!up) {
+			s[0] = plug417_codec_unfold(z[0]);
+			for (x = 1; x < w; x++)
+				s[x] = s[x - 1] + plug417_codec_unfold(z[x]);
+		} else {
+			s[0] = up[0] + plug417_codec_unfold(z[0]);
+			for (x = 1; x < w; x++)
+				s[x] = plug417_codec_med(s[x - 1], up[x], up[x - 1]) +
+					plug417_codec_unfold(z[x]);
+		}
+		up = s;
+
+		prev = c->prev + (size_t)y * w;
+		if (h->mode == PLUG417_CODEC_INTER) {
+			for (x = 0; x < w; x++)
+				y16[(size_t)y * w + x] = s[x] + prev[x];
+		} else {
+			memcpy(y16 + (size_t)y * w, s, w * sizeof(uint16_t));
+		}
+	}
+
+	if (plug417_bit_overrun(&br)) {
+		c->reference = 0;
+		return -1;
+	}
+
+	memcpy(c->prev, y16, (size_t)w * c->height * sizeof(uint16_t));
+	c->reference = 1;
+	c->frames++;
+	return 0;
+}
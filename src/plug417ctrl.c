@@ -13,6 +13,10 @@
 
 #include "plug417serial.h"
 #include "plug417cmd.h"
+#include "plug417format.h"
+#include "plug417schema.h"
+#include "plug417trace.h"
+#include "plug417sweep.h"
 
 #define DEFAULT_DEVICE_NAME		"/dev/ttyACM0"
 
@@ -25,8 +29,15 @@ struct plug417 {
 	int cmos_content;
 	int cmos_interace;
 	int brightness;
+	int format;
+	int changes;
 	const char *device;
 	const char *command;
+	const char *trace;
+	const char *dump_trace;
+	const char *metrics;
+	unsigned int settle;
+	struct plug417_sweep *sweep;
 };
 
 static void fatal(const char *fmt, ...)
@@ -55,6 +66,13 @@ static void usage(char **argv)
 	printf("\t-m --mirror <0..%d>\tSet/Reset image mirroring\n", PLUG417_COMMAND_MIRROR_MAX);
 	printf("\t-t --test <0..%d>\tSet test screen\n", PLUG417_COMMAND_TEST_SCREEN_MAX);
 	printf("\t-r --command <command>\tType help for extended help usage for this switch\n");
+	printf("\t-o --format <text|json|csv|bin>\tQuery output format, default text\n");
+	printf("\t-C --changes\tPrint only the fields of the queried page changed by the settings\n");
+	printf("\t-T --trace <file>\tRecord binary trace of serial link into file\n");
+	printf("\t-D --dump-trace <file>\tFormat binary trace file and exit\n");
+	printf("\t-M --metrics <file>\tWrite link metrics in Prometheus text format on exit\n");
+	printf("\t-w --sweep <name=values>\tSweep option over values, repeat for a grid, help lists names\n");
+	printf("\t-W --settle <ms>\tSettle time of every sweep point, default 0\n");
 	printf("\t-v --verbose <0..99>\tPrint verbose debug information\n");
 	printf("\t-h --help\tUsage help\n");
 	exit(EXIT_SUCCESS);
@@ -72,10 +90,17 @@ static struct option plug417_options[] = {
 	{"cmos_c",     required_argument, 0,  'f' },
 	{"get",        required_argument, 0,  'g' },
 	{"mirror",     required_argument, 0,  'm' },
+	{"format",     required_argument, 0,  'o' },
+	{"changes",    no_argument,       0,  'C' },
 	{"page",       required_argument, 0,  'p' },
 	{"command",    required_argument, 0,  'r' },
 	{"set",        required_argument, 0,  's' },
 	{"test",       required_argument, 0,  't' },
+	{"trace",      required_argument, 0,  'T' },
+	{"dump-trace", required_argument, 0,  'D' },
+	{"metrics",    required_argument, 0,  'M' },
+	{"sweep",      required_argument, 0,  'w' },
+	{"settle",     required_argument, 0,  'W' },
 	{"verbose",    required_argument, 0,  'v' },
 	{"help",       no_argument,       0,  'h' },
 	{0,            0,                 0,   0  }
@@ -89,7 +114,7 @@ static int parse_opt(int argc, char **argv, struct plug417 *plug)
 	int c;
 	int optindex = 0;
 
-	while ((c = getopt_long(argc, argv, "b:c:d:e:f:g:m:p:r:t:v:h", plug417_options, &optindex)) != -1) {
+	while ((c = getopt_long(argc, argv, "b:c:d:e:f:g:m:o:p:r:t:v:w:CD:M:T:W:h", plug417_options, &optindex)) != -1) {
 		switch (c) {
 			case 'v':
 				plug417serial_debug_level_set(strtol(optarg, NULL, 0));
@@ -118,12 +143,44 @@ static int parse_opt(int argc, char **argv, struct plug417 *plug)
 			case 'm':
 				plug->mirror = strtol(optarg, NULL, 0);
 				break;
+			case 'o':
+				plug->format = plug417_format_parse(optarg);
+				if (plug->format < 0)
+					usage(argv);
+				break;
 			case 't':
 				plug->test_screen = strtol(optarg, NULL, 0);
 				break;
+			case 'C':
+				plug->changes = 1;
+				break;
 			case 'r':
 				plug->command = optarg;
 				break;
+			case 'T':
+				plug->trace = optarg;
+				break;
+			case 'D':
+				plug->dump_trace = optarg;
+				break;
+			case 'M':
+				plug->metrics = optarg;
+				break;
+			case 'w':
+				if (!strcmp(optarg, "help")) {
+					plug417_sweep_help();
+					exit(EXIT_SUCCESS);
+				}
+				if (!plug->sweep && !(plug->sweep = plug417_sweep_alloc()))
+					fatal("Memory low\n");
+				if (plug417_sweep_axis(plug->sweep, optarg) < 0) {
+					fprintf(stderr, "Invalid sweep axis '%s'\n", optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'W':
+				plug->settle = strtol(optarg, NULL, 0);
+				break;
 			case 'h':
 				usage(argv);
 				break;
@@ -146,6 +203,31 @@ static int parse_opt(int argc, char **argv, struct plug417 *plug)
 	return 0;
 }
 
+/*
+ * Queried page decoded into values, NULL when there is no reply
+ */
+static const struct plug417_page_schema *query_values(struct plug417_serial *ps,
+		struct plug417 *plug, int32_t *values)
+{
+	const struct plug417_page_schema *sc;
+	struct plug417_status st;
+
+	if (plug->query == 0) {
+		if (plug417_query_status(ps, &st) < 0)
+			return NULL;
+		sc = plug417_schema_find(PLUG417_STATUS_PAGE, 0);
+		plug417_schema_decode(sc, &st, sizeof(struct plug417_status), values);
+		return sc;
+	}
+
+	if (plug417_query(ps, plug->query, plug->page) < 0)
+		return NULL;
+	sc = plug417_schema_find(ps->frame.query.functional, ps->frame.query.page);
+	if (sc)
+		plug417_schema_decode(sc, ps->frame.raw, ps->frame.length, values);
+	return sc;
+}
+
 /*
  *
  */
@@ -154,6 +236,10 @@ int main(int argc, char **argv)
 	struct plug417_serial *ps = NULL;
 	struct plug417_status st;
 	struct plug417 *plug;
+	struct plug417_output out;
+	char outbuf[PLUG417_OUTPUT_SIZE];
+	const struct plug417_page_schema *sc = NULL;
+	int32_t prev[PLUG417_SCHEMA_FIELDS_MAX], values[PLUG417_SCHEMA_FIELDS_MAX];
 
 	plug = malloc(sizeof(struct plug417));
 	if (!plug)
@@ -175,11 +261,29 @@ int main(int argc, char **argv)
 		plug->query = 0;
 
 	parse_opt(argc, argv, plug);
+
+#ifdef DEBUG
+	/* Page tables are written by hand, catch a field outside its page */
+	if (plug417_schema_check() < 0) {
+		fprintf(stderr, "Page schema inconsistent\n");
+		exit(EXIT_FAILURE);
+	}
+#endif
+
 	if (plug->command && !strncmp(plug->command, "help", 4)) {
 		plug417_set_command(ps, plug->command);
 		exit(EXIT_SUCCESS);
 	}
 
+	if (plug->dump_trace) {
+		if (plug417_trace_dump(plug->dump_trace, stdout) < 0)
+			fatal("Cannot read trace %s", plug->dump_trace);
+		exit(EXIT_SUCCESS);
+	}
+
+	if (plug->trace && plug417_trace_open(plug->trace, 0) < 0)
+		fatal("Cannot create trace %s", plug->trace);
+
 	ps = plug417_open(plug->device);
 
 	if (!ps)
@@ -188,14 +292,24 @@ int main(int argc, char **argv)
 	/* Timeout 1 sec */
 	ps->timeout = 1000000;
 
-	if (plug->query >= 0) {
+	/* Page before the settings, printed as the fields they changed */
+	if (plug->changes) {
+		if (plug->query < 0)
+			plug->query = 0;
+		sc = query_values(ps, plug, prev);
+		if (!sc)
+			fprintf(stderr, "Query failed, changes not shown\n");
+	} else if (plug->query >= 0 && !plug->sweep) {
+		plug417_output_init(&out, plug->format, outbuf, sizeof(outbuf));
 		if (plug->query == 0) {
 			if (plug417_query_status(ps, &st) == 0)
-				plug417_print_status(ps, &st);
+				plug417_status_format(&st, &out);
 		} else {
-			plug417_query(ps, plug->query, plug->page);
-			plug417_query_reply_print(ps);
+			if (plug417_query(ps, plug->query, plug->page) == 0)
+				plug417_query_reply_format(ps, &out);
 		}
+		fflush(stdout);
+		plug417_output_write(&out, STDOUT_FILENO);
 	}
 
 	if (plug->color >= 0)
@@ -219,8 +333,39 @@ int main(int argc, char **argv)
 	if (plug->command)
 		plug417_set_command(ps, plug->command);
 
+	if (sc) {
+		plug417_output_init(&out, plug->format, outbuf, sizeof(outbuf));
+		if (query_values(ps, plug, values) != sc)
+			fprintf(stderr, "Query failed, changes not shown\n");
+		else if (plug417_schema_diff(sc, prev, values, &out) == 0)
+			plug417_out_text(&out, "No fields changed\n");
+		fflush(stdout);
+		plug417_output_write(&out, STDOUT_FILENO);
+	}
+
+	/* Sweep records the queried page with the status at every point */
+	if (plug->sweep) {
+		plug->sweep->settle_ms = plug->settle;
+		if (plug->query > 0)
+			plug417_sweep_query(plug->sweep, plug->query, plug->page);
+		fflush(stdout);
+		if (plug417_sweep_run(plug->sweep, ps, plug->format, STDOUT_FILENO) < 0)
+			fprintf(stderr, "Sweep failed\n");
+		plug417_sweep_free(plug->sweep);
+	}
+
+	if (plug->metrics) {
+		char labels[256];
+
+		snprintf(labels, sizeof(labels), "device=\"%s\"", plug->device);
+		if (plug417_metrics_write_file(&ps->metrics, labels, plug->metrics) < 0)
+			fprintf(stderr, "Cannot write metrics %s\n", plug->metrics);
+	}
+
 	plug417_close(ps);
 
+	plug417_trace_close();
+
 	free(plug);
 
 	exit(EXIT_SUCCESS);
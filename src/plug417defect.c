@@ -0,0 +1,447 @@
+/*
+ * plug417 host side defective pixel detection and correction
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "plug417defect.h"
+#include "plug417simd.h"
+
+static const struct plug417_defect_thresholds plug417_defect_default = {
+	.hot = 50.0f,
+	.cold = 50.0f,
+	.stuck = 0.1f,
+	.noisy = 5.0f,
+};
+
+/*
+ *
+ */
+struct plug417_defect_map *plug417_defect_alloc(unsigned int width, unsigned int height)
+{
+	struct plug417_defect_map *m;
+
+	if (!width || !height)
+		return NULL;
+
+	m = malloc(sizeof(struct plug417_defect_map));
+	if (!m)
+		return NULL;
+
+	memset(m, 0, sizeof(struct plug417_defect_map));
+	m->width = width;
+	m->height = height;
+	m->mask = calloc(((size_t)width * height + 7) / 8, 1);
+	if (!m->mask) {
+		free(m);
+		return NULL;
+	}
+	return m;
+}
+
+/*
+ *
+ */
+void plug417_defect_free(struct plug417_defect_map *m)
+{
+	free(m->pixels);
+	free(m->mask);
+	free(m);
+}
+
+/*
+ *
+ */
+int plug417_defect_is(const struct plug417_defect_map *m, unsigned int x, unsigned int y)
+{
+	size_t i = (size_t)y * m->width + x;
+
+	if (x >= m->width || y >= m->height)
+		return 0;
+
+	return (m->mask[i >> 3] >> (i & 7)) & 1;
+}
+
+/*
+ * Adding a known pixel again only adds to its type
+ */
+int plug417_defect_add(struct plug417_defect_map *m, unsigned int x, unsigned int y,
+		unsigned int type)
+{
+	struct plug417_defect_pixel *p;
+	size_t i = (size_t)y * m->width + x;
+	unsigned int n;
+
+	if (x >= m->width || y >= m->height)
+		return -1;
+
+	if (plug417_defect_is(m, x, y)) {
+		for (n = 0; n < m->count; n++) {
+			if (m->pixels[n].x == x && m->pixels[n].y == y)
+				m->pixels[n].type |= type;
+		}
+		return 0;
+	}
+
+	if (m->count == m->size) {
+		n = m->size ? m->size * 2 : 64;
+		p = realloc(m->pixels, n * sizeof(struct plug417_defect_pixel));
+		if (!p)
+			return -1;
+		m->pixels = p;
+		m->size = n;
+	}
+
+	p = &m->pixels[m->count++];
+	memset(p, 0, sizeof(struct plug417_defect_pixel));
+	p->x = x;
+	p->y = y;
+	p->type = type;
+	m->mask[i >> 3] |= 1 << (i & 7);
+	m->dirty = 1;
+	return 0;
+}
+
+/*
+ *
+ */
+static int plug417_defect_pixel_cmp(const void *a, const void *b)
+{
+	const struct plug417_defect_pixel *pa = a, *pb = b;
+
+	if (pa->y != pb->y)
+		return pa->y < pb->y ? -1 : 1;
+	return pa->x < pb->x ? -1 : pa->x > pb->x;
+}
+
+/*
+ * Nearest good pixel from x, y in direction dx, dy, 0 when none is in range
+ */
+static int plug417_defect_search(const struct plug417_defect_map *m,
+		const struct plug417_defect_pixel *p, int dx, int dy)
+{
+	int r, x, y;
+
+	for (r = 1; r <= PLUG417_DEFECT_RADIUS; r++) {
+		x = p->x + dx * r;
+		y = p->y + dy * r;
+		if (x < 0 || y < 0 || x >= (int)m->width || y >= (int)m->height)
+			return 0;
+		if (!plug417_defect_is(m, x, y))
+			return r;
+	}
+	return 0;
+}
+
+/*
+ * Sorts the map in memory order and picks the neighbours. Directions
+ * without a good pixel borrow one of the others so the mean always has
+ * four terms.
+ */
+int plug417_defect_build(struct plug417_defect_map *m)
+{
+	static const int dir[4][2] = { {-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+	struct plug417_defect_pixel *p;
+	unsigned int i, k, found;
+	int r, fx[4], fy[4];
+
+	qsort(m->pixels, m->count, sizeof(struct plug417_defect_pixel),
+			plug417_defect_pixel_cmp);
+
+	for (i = 0; i < m->count; i++) {
+		p = &m->pixels[i];
+		for (k = 0, found = 0; k < 4; k++) {
+			r = plug417_defect_search(m, p, dir[k][0], dir[k][1]);
+			if (r) {
+				fx[found] = dir[k][0] * r;
+				fy[found] = dir[k][1] * r;
+				found++;
+			}
+		}
+		if (!found) {
+			/* Left in place, a cluster too large to fill */
+			fx[0] = 0;
+			fy[0] = 0;
+			found = 1;
+		}
+		for (k = 0; k < 4; k++) {
+			p->dx[k] = fx[k % found];
+			p->dy[k] = fy[k % found];
+		}
+	}
+	m->dirty = 0;
+	return 0;
+}
+
+/*
+ * Text file, one "x y type" line per pixel, # starts a comment
+ */
+int plug417_defect_load(struct plug417_defect_map *m, const char *path)
+{
+	unsigned int x, y, type;
+	char line[128];
+	FILE *fp;
+	int n;
+
+	fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (line[0] == '#')
+			continue;
+		n = sscanf(line, "%u %u %u", &x, &y, &type);
+		if (n < 2)
+			continue;
+		if (plug417_defect_add(m, x, y, n == 3 ? type : PLUG417_DEFECT_MANUAL) < 0) {
+			fclose(fp);
+			return -1;
+		}
+	}
+	fclose(fp);
+	return plug417_defect_build(m);
+}
+
+/*
+ *
+ */
+int plug417_defect_save(const struct plug417_defect_map *m, const char *path)
+{
+	unsigned int i;
+	FILE *fp;
+
+	fp = fopen(path, "w");
+	if (!fp)
+		return -1;
+
+	fprintf(fp, "# plug417 defective pixels %ux%u: x y type\n", m->width, m->height);
+	for (i = 0; i < m->count; i++)
+		fprintf(fp, "%u %u %u\n", m->pixels[i].x, m->pixels[i].y, m->pixels[i].type);
+
+	return fclose(fp) ? -1 : 0;
+}
+
+/*
+ * Neighbours are never defective, so pixels can be corrected in any
+ * order and the map may be shared by threads once built
+ */
+int plug417_defect_correct(const struct plug417_defect_map *m, struct plug417_video_frame *f)
+{
+	const struct plug417_defect_pixel *p;
+	const long stride = f->stride;
+	int16_t *y16 = (int16_t *)f->y16, *c;
+	unsigned int i;
+	int sum;
+
+	if (!y16 || f->width != m->width || f->height != m->height || m->dirty)
+		return -1;
+
+	for (i = 0, p = m->pixels; i < m->count; i++, p++) {
+		c = y16 + p->y * stride + p->x;
+		sum = c[p->dy[0] * stride + p->dx[0]] + c[p->dy[1] * stride + p->dx[1]] +
+				c[p->dy[2] * stride + p->dx[2]] + c[p->dy[3] * stride + p->dx[3]];
+		*c = (sum + 2) >> 2;
+	}
+	return 0;
+}
+
+/*
+ * Pipeline stage, may run in parallel
+ */
+int plug417_defect_process(void *arg, struct plug417_video_frame *f)
+{
+	return plug417_defect_correct(arg, f);
+}
+
+/*
+ *
+ */
+struct plug417_defect_detect *plug417_defect_detect_alloc(unsigned int width,
+		unsigned int height)
+{
+	struct plug417_defect_detect *d;
+	size_t n = (size_t)width * height;
+
+	d = malloc(sizeof(struct plug417_defect_detect));
+	if (!d)
+		return NULL;
+
+	memset(d, 0, sizeof(struct plug417_defect_detect));
+	d->width = width;
+	d->height = height;
+	if (posix_memalign((void **)&d->mean, PLUG417_CACHE_LINE, n * sizeof(float)) ||
+			posix_memalign((void **)&d->m2, PLUG417_CACHE_LINE, n * sizeof(float))) {
+		plug417_defect_detect_free(d);
+		return NULL;
+	}
+	memset(d->mean, 0, n * sizeof(float));
+	memset(d->m2, 0, n * sizeof(float));
+	return d;
+}
+
+/*
+ *
+ */
+void plug417_defect_detect_free(struct plug417_defect_detect *d)
+{
+	free(d->mean);
+	free(d->m2);
+	free(d);
+}
+
+/*
+ * Welford update of mean and squared deviations, best fed with frames of
+ * a uniform scene such as the closed shutter
+ */
+int plug417_defect_detect_frame(struct plug417_defect_detect *d,
+		const struct plug417_video_frame *f)
+{
+	const int16_t *row;
+	float *mean, *m2, inv, v, delta;
+	unsigned int x, y;
+
+	if (!f->y16 || f->width != d->width || f->height != d->height)
+		return -1;
+
+	d->frames++;
+	inv = 1.0f / d->frames;
+
+	for (y = 0; y < d->height; y++) {
+		row = (const int16_t *)f->y16 + (size_t)y * f->stride;
+		mean = d->mean + (size_t)y * d->width;
+		m2 = d->m2 + (size_t)y * d->width;
+		x = 0;
+#if defined(PLUG417_SSE2)
+		{
+			const __m128 vinv = _mm_set1_ps(inv);
+			__m128i in;
+			__m128 c, mn, dl;
+
+			for (; x + 4 <= d->width; x += 4) {
+				in = _mm_loadl_epi64((const __m128i *)(row + x));
+				c = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16));
+				mn = _mm_loadu_ps(mean + x);
+				dl = _mm_sub_ps(c, mn);
+				mn = _mm_add_ps(mn, _mm_mul_ps(dl, vinv));
+				_mm_storeu_ps(mean + x, mn);
+				_mm_storeu_ps(m2 + x, _mm_add_ps(_mm_loadu_ps(m2 + x),
+						_mm_mul_ps(dl, _mm_sub_ps(c, mn))));
+			}
+		}
+#elif defined(PLUG417_NEON)
+		{
+			float32x4_t c, mn, dl;
+
+			for (; x + 4 <= d->width; x += 4) {
+				c = vcvtq_f32_s32(vmovl_s16(vld1_s16(row + x)));
+				mn = vld1q_f32(mean + x);
+				dl = vsubq_f32(c, mn);
+				mn = vmlaq_n_f32(mn, dl, inv);
+				vst1q_f32(mean + x, mn);
+				vst1q_f32(m2 + x, vmlaq_f32(vld1q_f32(m2 + x), dl, vsubq_f32(c, mn)));
+			}
+		}
+#endif
+		for (; x < d->width; x++) {
+			v = row[x];
+			delta = v - mean[x];
+			mean[x] += delta * inv;
+			m2[x] += delta * (v - mean[x]);
+		}
+	}
+	return 0;
+}
+
+/*
+ *
+ */
+static int plug417_defect_float_cmp(const void *a, const void *b)
+{
+	float fa = *(const float *)a, fb = *(const float *)b;
+
+	return fa < fb ? -1 : fa > fb;
+}
+
+/*
+ * Median of the 3x3 neighbourhood of the mean image, clamped at borders
+ */
+static float plug417_defect_median3(const struct plug417_defect_detect *d,
+		unsigned int x, unsigned int y)
+{
+	float v[9];
+	int i, j, n = 0, xx, yy;
+
+	for (j = -1; j <= 1; j++) {
+		yy = (int)y + j < 0 ? 0 : (int)y + j >= (int)d->height ? d->height - 1 : y + j;
+		for (i = -1; i <= 1; i++) {
+			xx = (int)x + i < 0 ? 0 : (int)x + i >= (int)d->width ? d->width - 1 : x + i;
+			v[n++] = d->mean[(size_t)yy * d->width + xx];
+		}
+	}
+	qsort(v, 9, sizeof(float), plug417_defect_float_cmp);
+	return v[4];
+}
+
+/*
+ * Classifies the pixels seen so far into the map and builds it.
+ * Returns the number of defects found, NULL thresholds take defaults.
+ * Stuck pixels are only found when the median noise reaches
+ * PLUG417_DEFECT_NOISE_MIN.
+ */
+int plug417_defect_detect_finish(struct plug417_defect_detect *d,
+		const struct plug417_defect_thresholds *t, struct plug417_defect_map *m)
+{
+	const size_t n = (size_t)d->width * d->height;
+	float *noise, median, dev, sd;
+	unsigned int x, y, type;
+	size_t i;
+	int found = 0, quiet;
+
+	if (d->frames < 2 || m->width != d->width || m->height != d->height)
+		return -1;
+	if (!t)
+		t = &plug417_defect_default;
+
+	noise = malloc(n * sizeof(float));
+	if (!noise)
+		return -1;
+
+	for (i = 0; i < n; i++)
+		noise[i] = sqrtf(d->m2[i] / (d->frames - 1));
+	qsort(noise, n, sizeof(float), plug417_defect_float_cmp);
+	median = noise[n / 2];
+	free(noise);
+
+	/* A quantized, quiet scene has no noise at all on most pixels */
+	quiet = median < PLUG417_DEFECT_NOISE_MIN;
+	if (quiet)
+		median = PLUG417_DEFECT_NOISE_MIN;
+
+	for (y = 0; y < d->height; y++) {
+		for (x = 0; x < d->width; x++) {
+			i = (size_t)y * d->width + x;
+			sd = sqrtf(d->m2[i] / (d->frames - 1));
+			dev = d->mean[i] - plug417_defect_median3(d, x, y);
+			type = 0;
+			if (!quiet && sd < t->stuck * median)
+				type |= PLUG417_DEFECT_STUCK;
+			if (sd > t->noisy * median)
+				type |= PLUG417_DEFECT_NOISY;
+			if (dev > t->hot)
+				type |= PLUG417_DEFECT_HOT;
+			if (dev < -t->cold)
+				type |= PLUG417_DEFECT_COLD;
+			if (!type)
+				continue;
+			if (plug417_defect_add(m, x, y, type) < 0)
+				return -1;
+			found++;
+		}
+	}
+
+	if (plug417_defect_build(m) < 0)
+		return -1;
+	return found;
+}
@@ -0,0 +1,253 @@
+/*
+ * plug417 host side temporal noise filter for Y16
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "plug417denoise.h"
+#include "plug417simd.h"
+
+/*
+ * Per level weight of the new frame and motion threshold in Y16 units,
+ * level 0 is the lightest filtering as on the sensor
+ */
+static const struct {
+	float weight;
+	float threshold;
+} plug417_denoise_levels[] = {
+	[PLUG417_ALGORITHM_LEVEL_0] = { 0.50f, 2.0f },
+	[PLUG417_ALGORITHM_LEVEL_1] = { 0.35f, 3.0f },
+	[PLUG417_ALGORITHM_LEVEL_2] = { 0.25f, 4.0f },
+	[PLUG417_ALGORITHM_LEVEL_3] = { 0.18f, 5.0f },
+	[PLUG417_ALGORITHM_LEVEL_4] = { 0.12f, 6.0f },
+};
+
+/*
+ *
+ */
+struct plug417_denoise *plug417_denoise_alloc(unsigned int width, unsigned int height,
+		int level)
+{
+	struct plug417_denoise *d;
+
+	d = malloc(sizeof(struct plug417_denoise));
+	if (!d)
+		return NULL;
+
+	memset(d, 0, sizeof(struct plug417_denoise));
+	d->width = width;
+	d->height = height;
+
+	if (posix_memalign((void **)&d->acc, PLUG417_CACHE_LINE,
+			(size_t)width * height * sizeof(float))) {
+		free(d);
+		return NULL;
+	}
+
+	if (plug417_denoise_set(d, level, 1) < 0) {
+		plug417_denoise_free(d);
+		return NULL;
+	}
+	return d;
+}
+
+/*
+ *
+ */
+void plug417_denoise_free(struct plug417_denoise *d)
+{
+	free(d->acc);
+	free(d);
+}
+
+/*
+ *
+ */
+int plug417_denoise_set(struct plug417_denoise *d, int level, int motion)
+{
+	if (level < PLUG417_DENOISE_OFF || level > PLUG417_ALGORITHM_LEVEL_MAX)
+		return -1;
+
+	d->level = level;
+	d->motion = motion;
+	if (level != PLUG417_DENOISE_OFF) {
+		d->weight = plug417_denoise_levels[level].weight;
+		d->threshold = plug417_denoise_levels[level].threshold;
+	}
+	return 0;
+}
+
+/*
+ * Same switch and strength as the sensor's time domain filter
+ */
+int plug417_denoise_from_page(struct plug417_denoise *d,
+		const struct plug417_alorithm_control_page_1 *page)
+{
+	if (!page->time_domain_filering)
+		return plug417_denoise_set(d, PLUG417_DENOISE_OFF, d->motion);
+
+	return plug417_denoise_set(d, page->filtering_strength, d->motion);
+}
+
+/*
+ * Next frame restarts the filter, after a shutter or NUC
+ */
+void plug417_denoise_reset(struct plug417_denoise *d)
+{
+	d->primed = 0;
+}
+
+/*
+ *
+ */
+static void plug417_denoise_prime(struct plug417_denoise *d, const uint16_t *y16,
+		unsigned int stride)
+{
+	unsigned int x, y;
+	float *a;
+
+	for (y = 0; y < d->height; y++, y16 += stride) {
+		a = d->acc + (size_t)y * d->width;
+		for (x = 0; x < d->width; x++)
+			a[x] = (int16_t)y16[x];
+	}
+	d->primed = 1;
+}
+
+#if defined(PLUG417_NEON)
+/*
+ * Nearest, ARMv7 rounds halves away from zero
+ */
+static inline int32x4_t plug417_denoise_round(float32x4_t v)
+{
+#if defined(__aarch64__)
+	return vcvtnq_s32_f32(v);
+#else
+	uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(v), vdupq_n_u32(0x80000000));
+	float32x4_t half = vreinterpretq_f32_u32(vorrq_u32(sign,
+			vreinterpretq_u32_f32(vdupq_n_f32(0.5f))));
+
+	return vcvtq_s32_f32(vaddq_f32(v, half));
+#endif
+}
+#endif
+
+/*
+ * acc += (y16 - acc) * k, k grows from weight to 1 as the difference
+ * goes from threshold to three times threshold
+ */
+static void plug417_denoise_row(struct plug417_denoise *d, uint16_t *p, float *a,
+		unsigned int n)
+{
+	const float w = d->weight, t = d->threshold;
+	const float slope = d->motion ? (1.0f - w) / (2.0f * t) : 0.0f;
+	unsigned int x = 0;
+	float diff, m;
+	long v;
+
+#if defined(PLUG417_SSE2)
+	const __m128 vw = _mm_set1_ps(w), vt = _mm_set1_ps(t), vs = _mm_set1_ps(slope);
+	const __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	__m128i in, lo, hi;
+	__m128 c0, c1, a0, a1, d0, d1, k0, k1;
+
+	for (; x + 8 <= n; x += 8) {
+		in = _mm_loadu_si128((const __m128i *)(p + x));
+		lo = _mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16);
+		hi = _mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16);
+		c0 = _mm_cvtepi32_ps(lo);
+		c1 = _mm_cvtepi32_ps(hi);
+		a0 = _mm_loadu_ps(a + x);
+		a1 = _mm_loadu_ps(a + x + 4);
+		d0 = _mm_sub_ps(c0, a0);
+		d1 = _mm_sub_ps(c1, a1);
+
+		k0 = _mm_mul_ps(_mm_sub_ps(_mm_andnot_ps(sign, d0), vt), vs);
+		k1 = _mm_mul_ps(_mm_sub_ps(_mm_andnot_ps(sign, d1), vt), vs);
+		k0 = _mm_min_ps(_mm_add_ps(_mm_max_ps(k0, zero), vw), one);
+		k1 = _mm_min_ps(_mm_add_ps(_mm_max_ps(k1, zero), vw), one);
+
+		a0 = _mm_add_ps(a0, _mm_mul_ps(d0, k0));
+		a1 = _mm_add_ps(a1, _mm_mul_ps(d1, k1));
+		_mm_storeu_ps(a + x, a0);
+		_mm_storeu_ps(a + x + 4, a1);
+
+		_mm_storeu_si128((__m128i *)(p + x),
+				_mm_packs_epi32(_mm_cvtps_epi32(a0), _mm_cvtps_epi32(a1)));
+	}
+#elif defined(PLUG417_NEON)
+	const float32x4_t vw = vdupq_n_f32(w), vt = vdupq_n_f32(t), vs = vdupq_n_f32(slope);
+	const float32x4_t one = vdupq_n_f32(1.0f), zero = vdupq_n_f32(0.0f);
+	int16x8_t in;
+	float32x4_t c0, c1, a0, a1, d0, d1, k0, k1;
+
+	for (; x + 8 <= n; x += 8) {
+		in = vreinterpretq_s16_u16(vld1q_u16(p + x));
+		c0 = vcvtq_f32_s32(vmovl_s16(vget_low_s16(in)));
+		c1 = vcvtq_f32_s32(vmovl_s16(vget_high_s16(in)));
+		a0 = vld1q_f32(a + x);
+		a1 = vld1q_f32(a + x + 4);
+		d0 = vsubq_f32(c0, a0);
+		d1 = vsubq_f32(c1, a1);
+
+		k0 = vmulq_f32(vsubq_f32(vabsq_f32(d0), vt), vs);
+		k1 = vmulq_f32(vsubq_f32(vabsq_f32(d1), vt), vs);
+		k0 = vminq_f32(vaddq_f32(vmaxq_f32(k0, zero), vw), one);
+		k1 = vminq_f32(vaddq_f32(vmaxq_f32(k1, zero), vw), one);
+
+		a0 = vmlaq_f32(a0, d0, k0);
+		a1 = vmlaq_f32(a1, d1, k1);
+		vst1q_f32(a + x, a0);
+		vst1q_f32(a + x + 4, a1);
+
+		vst1q_u16(p + x, vreinterpretq_u16_s16(vcombine_s16(
+				vqmovn_s32(plug417_denoise_round(a0)),
+				vqmovn_s32(plug417_denoise_round(a1)))));
+	}
+#endif
+	for (; x < n; x++) {
+		diff = (int16_t)p[x] - a[x];
+		m = (fabsf(diff) - t) * slope;
+		m = (m > 0.0f ? m : 0.0f) + w;
+		a[x] += diff * (m < 1.0f ? m : 1.0f);
+		v = lrintf(a[x]);
+		p[x] = (uint16_t)(int16_t)(v < -32768 ? -32768 : v > 32767 ? 32767 : v);
+	}
+}
+
+/*
+ * Filters the Y16 image in place, the same work for every frame
+ */
+int plug417_denoise_frame(struct plug417_denoise *d, struct plug417_video_frame *f)
+{
+	uint16_t *p = f->y16;
+	unsigned int y;
+
+	if (!p || f->width != d->width || f->height != d->height)
+		return -1;
+
+	if (d->level == PLUG417_DENOISE_OFF) {
+		d->primed = 0;
+		return 0;
+	}
+
+	d->frames++;
+	if (!d->primed) {
+		plug417_denoise_prime(d, p, f->stride);
+		return 0;
+	}
+
+	for (y = 0; y < d->height; y++, p += f->stride)
+		plug417_denoise_row(d, p, d->acc + (size_t)y * d->width, d->width);
+	return 0;
+}
+
+/*
+ * Pipeline stage, add it as ordered so frames are filtered in sequence
+ */
+int plug417_denoise_process(void *arg, struct plug417_video_frame *f)
+{
+	return plug417_denoise_frame(arg, f);
+}
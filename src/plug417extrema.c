@@ -0,0 +1,220 @@
+/*
+ * plug417 host side hottest and coldest point search
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "plug417extrema.h"
+#include "plug417simd.h"
+
+/*
+ * Minimum and maximum of one row, Y16 is signed
+ */
+void plug417_extrema_row(const int16_t *p, unsigned int n,
+		int16_t *min, int16_t *max)
+{
+	int16_t mn = INT16_MAX, mx = INT16_MIN;
+	unsigned int i = 0;
+
+#if defined(PLUG417_SSE2)
+	if (n >= 8) {
+		__m128i vmn = _mm_set1_epi16(INT16_MAX), vmx = _mm_set1_epi16(INT16_MIN);
+		int16_t a[8], b[8];
+		int j;
+
+		for (; i + 8 <= n; i += 8) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+			vmn = _mm_min_epi16(vmn, v);
+			vmx = _mm_max_epi16(vmx, v);
+		}
+		_mm_storeu_si128((__m128i *)a, vmn);
+		_mm_storeu_si128((__m128i *)b, vmx);
+		for (j = 0; j < 8; j++) {
+			if (a[j] < mn)
+				mn = a[j];
+			if (b[j] > mx)
+				mx = b[j];
+		}
+	}
+#elif defined(PLUG417_NEON)
+	if (n >= 8) {
+		int16x8_t vmn = vdupq_n_s16(INT16_MAX), vmx = vdupq_n_s16(INT16_MIN);
+		int16_t a[8], b[8];
+		int j;
+
+		for (; i + 8 <= n; i += 8) {
+			int16x8_t v = vld1q_s16(p + i);
+			vmn = vminq_s16(vmn, v);
+			vmx = vmaxq_s16(vmx, v);
+		}
+		vst1q_s16(a, vmn);
+		vst1q_s16(b, vmx);
+		for (j = 0; j < 8; j++) {
+			if (a[j] < mn)
+				mn = a[j];
+			if (b[j] > mx)
+				mx = b[j];
+		}
+	}
+#endif
+	for (; i < n; i++) {
+		if (p[i] < mn)
+			mn = p[i];
+		if (p[i] > mx)
+			mx = p[i];
+	}
+
+	*min = mn;
+	*max = mx;
+}
+
+/*
+ *
+ */
+static unsigned int plug417_extrema_locate(const int16_t *p, unsigned int n, int16_t v)
+{
+	unsigned int i;
+
+	for (i = 0; i < n && p[i] != v; i++)
+		;
+	return i;
+}
+
+/*
+ * Rows are reduced with SIMD, the position is only searched in rows
+ * holding a new extreme
+ */
+int plug417_extrema_find(const struct plug417_video_frame *f,
+		const struct plug417_roi *roi, struct plug417_extrema *e)
+{
+	struct plug417_roi r;
+	const int16_t *p;
+	int16_t mn, mx;
+	unsigned int y;
+
+	if (!f->y16 || plug417_video_roi(f, roi, &r) < 0)
+		return -1;
+
+	e->max_value = INT16_MIN;
+	e->min_value = INT16_MAX;
+	e->max_x = e->min_x = r.x;
+	e->max_y = e->min_y = r.y;
+
+	for (y = r.y; y < r.y + r.height; y++) {
+		p = (const int16_t *)f->y16 + (size_t)y * f->stride + r.x;
+		plug417_extrema_row(p, r.width, &mn, &mx);
+
+		if (mx > e->max_value) {
+			e->max_value = mx;
+			e->max_x = r.x + plug417_extrema_locate(p, r.width, mx);
+			e->max_y = y;
+		}
+		if (mn < e->min_value) {
+			e->min_value = mn;
+			e->min_x = r.x + plug417_extrema_locate(p, r.width, mn);
+			e->min_y = y;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Parabola through three samples, offset of its vertex from the center
+ */
+static float plug417_extrema_vertex(int l, int c, int r)
+{
+	int d = l - 2 * c + r;
+
+	if (d >= 0)
+		return 0.0f;
+	return 0.5f * (l - r) / d;
+}
+
+/*
+ * Plateaus count once: ties only win against right and lower neighbours
+ */
+static int plug417_extrema_is_peak(const int16_t *p, unsigned int stride)
+{
+	const int16_t *u = p - stride, *d = p + stride;
+	int16_t v = *p;
+
+	return v > u[-1] && v > u[0] && v > u[1] && v > p[-1] &&
+		v >= p[1] && v >= d[-1] && v >= d[0] && v >= d[1];
+}
+
+/*
+ * Insert into the list sorted by value, peaks closer than radius to a
+ * higher one are dropped
+ */
+static unsigned int plug417_extrema_insert(struct plug417_peak *peaks, unsigned int n,
+		unsigned int k, int16_t v, unsigned int x, unsigned int y, unsigned int radius)
+{
+	unsigned int i, j, r2 = radius * radius;
+	int dx, dy;
+
+	for (i = 0; i < n; i++) {
+		dx = (int)peaks[i].x - (int)x;
+		dy = (int)peaks[i].y - (int)y;
+		if ((unsigned int)(dx * dx + dy * dy) > r2)
+			continue;
+		if (peaks[i].value >= v)
+			return n;
+		memmove(&peaks[i], &peaks[i + 1], (n - i - 1) * sizeof(struct plug417_peak));
+		n--;
+		i--;
+	}
+
+	for (i = 0; i < n && peaks[i].value >= v; i++)
+		;
+	if (i == k)
+		return n;
+
+	if (n == k)
+		n--;
+	for (j = n; j > i; j--)
+		peaks[j] = peaks[j - 1];
+
+	peaks[i].value = v;
+	peaks[i].x = x;
+	peaks[i].y = y;
+	return n + 1;
+}
+
+/*
+ * Up to k highest local maxima inside roi, returns how many were found.
+ * Frame border pixels are skipped, they lack neighbours.
+ */
+int plug417_extrema_peaks(const struct plug417_video_frame *f,
+		const struct plug417_roi *roi, struct plug417_peak *peaks,
+		unsigned int k, unsigned int radius)
+{
+	struct plug417_roi r;
+	const int16_t *base = (const int16_t *)f->y16, *p;
+	unsigned int x, y, x0, x1, y0, y1, n = 0, i;
+	unsigned int s = f->stride;
+
+	if (!f->y16 || !k || plug417_video_roi(f, roi, &r) < 0)
+		return -1;
+
+	x0 = r.x ? r.x : 1;
+	y0 = r.y ? r.y : 1;
+	x1 = r.x + r.width < f->width ? r.x + r.width : f->width - 1;
+	y1 = r.y + r.height < f->height ? r.y + r.height : f->height - 1;
+
+	for (y = y0; y < y1; y++) {
+		p = base + (size_t)y * s;
+		for (x = x0; x < x1; x++) {
+			if (n == k && p[x] <= peaks[k - 1].value)
+				continue;
+			if (plug417_extrema_is_peak(p + x, s))
+				n = plug417_extrema_insert(peaks, n, k, p[x], x, y, radius);
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		p = base + (size_t)peaks[i].y * s + peaks[i].x;
+		peaks[i].cx = peaks[i].x + plug417_extrema_vertex(p[-1], p[0], p[1]);
+		peaks[i].cy = peaks[i].y + plug417_extrema_vertex(*(p - s), p[0], *(p + s));
+	}
+	return n;
+}
@@ -0,0 +1,258 @@
+/*
+ * plug417 output buffer rendering
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <endian.h>
+
+#include "plug417serial.h"
+#include "plug417format.h"
+
+static const char *plug417_format_name[] = {
+	"text",
+	"json",
+	"csv",
+	"bin",
+};
+
+/*
+ *
+ */
+int plug417_format_parse(const char *name)
+{
+	int i;
+
+	for (i = 0; i <= PLUG417_FORMAT_MAX; i++) {
+		if (!strcmp(name, plug417_format_name[i]))
+			return i;
+	}
+	return -1;
+}
+
+/*
+ *
+ */
+void plug417_output_init(struct plug417_output *o, int format, void *buf, int size)
+{
+	memset(o, 0, sizeof(struct plug417_output));
+	o->format = format;
+	o->buf = buf;
+	o->size = size;
+}
+
+/*
+ * Write whole rendered buffer at once
+ */
+int plug417_output_write(struct plug417_output *o, int fd)
+{
+	if (o->overflow)
+		return -1;
+
+	return write(fd, o->buf, o->len);
+}
+
+/*
+ *
+ */
+void plug417_out_printf(struct plug417_output *o, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (o->overflow)
+		return;
+
+	va_start(ap, fmt);
+	n = vsnprintf(o->buf + o->len, o->size - o->len, fmt, ap);
+	va_end(ap);
+
+	if (n < 0 || n >= o->size - o->len) {
+		o->overflow = 1;
+		return;
+	}
+	o->len += n;
+}
+
+/*
+ *
+ */
+void plug417_out_raw(struct plug417_output *o, const void *buf, int size)
+{
+	if (o->overflow)
+		return;
+
+	if (size > o->size - o->len) {
+		o->overflow = 1;
+		return;
+	}
+	memcpy(o->buf + o->len, buf, size);
+	o->len += size;
+}
+
+/*
+ *
+ */
+void plug417_out_begin(struct plug417_output *o, unsigned int functional,
+		unsigned int page, const char *title)
+{
+	struct plug417_record_header h;
+
+	o->count = 0;
+	o->start = o->len;
+
+	switch (o->format) {
+		case PLUG417_FORMAT_TEXT:
+			plug417_out_printf(o, "%s\n", title);
+			break;
+		case PLUG417_FORMAT_JSON:
+			plug417_out_printf(o, "{\"functional\":%u,\"page\":%u,"
+					"\"name\":\"%s\",\"fields\":{",
+					functional, page, title);
+			break;
+		case PLUG417_FORMAT_CSV:
+			if (o->pass == 0)
+				plug417_out_printf(o, "functional,page");
+			else
+				plug417_out_printf(o, "%u,%u", functional, page);
+			break;
+		case PLUG417_FORMAT_BIN:
+			/* Header is filled in plug417_out_end */
+			memset(&h, 0, sizeof(h));
+			plug417_out_raw(o, &h, sizeof(h));
+			break;
+	}
+}
+
+/*
+ *
+ */
+void plug417_out_end(struct plug417_output *o, unsigned int functional,
+		unsigned int page)
+{
+	struct plug417_record_header *h;
+
+	switch (o->format) {
+		case PLUG417_FORMAT_JSON:
+			plug417_out_printf(o, "}}\n");
+			break;
+		case PLUG417_FORMAT_CSV:
+			plug417_out_printf(o, "\n");
+			break;
+		case PLUG417_FORMAT_BIN:
+			if (o->overflow)
+				break;
+			h = (struct plug417_record_header *)(o->buf + o->start);
+			h->magic[0] = PLUG417_RECORD_MAGIC0;
+			h->magic[1] = PLUG417_RECORD_MAGIC1;
+			h->version = PLUG417_RECORD_VERSION;
+			h->functional = functional;
+			h->page = page;
+			h->count = o->count;
+			h->length = htole16(o->len - o->start);
+			break;
+	}
+}
+
+/*
+ * Text only output, skipped by machine readable formats
+ */
+void plug417_out_text(struct plug417_output *o, const char *fmt, ...)
+{
+	va_list ap;
+	char line[128];
+
+	if (o->format != PLUG417_FORMAT_TEXT)
+		return;
+
+	va_start(ap, fmt);
+	vsnprintf(line, sizeof(line), fmt, ap);
+	va_end(ap);
+	plug417_out_printf(o, "%s", line);
+}
+
+/*
+ * Emit one field, str is the rendered value for enumerations or NULL
+ */
+void plug417_out_field(struct plug417_output *o, const char *key,
+		const char *label, int64_t value, const char *str)
+{
+	int32_t v;
+
+	switch (o->format) {
+		case PLUG417_FORMAT_TEXT:
+			if (str)
+				plug417_out_printf(o, "%s: %s\n", label, str);
+			else
+				plug417_out_printf(o, "%s: %" PRId64 "\n", label, value);
+			break;
+		case PLUG417_FORMAT_JSON:
+			plug417_out_printf(o, "%s\"%s\":", o->count ? "," : "", key);
+			if (str)
+				plug417_out_printf(o, "\"%s\"", str);
+			else
+				plug417_out_printf(o, "%" PRId64, value);
+			break;
+		case PLUG417_FORMAT_CSV:
+			if (o->pass == 0)
+				plug417_out_printf(o, ",%s", key);
+			else if (str)
+				plug417_out_printf(o, ",\"%s\"", str);
+			else
+				plug417_out_printf(o, ",%" PRId64, value);
+			break;
+		case PLUG417_FORMAT_BIN:
+			v = htole32((int32_t)value);
+			plug417_out_raw(o, &v, sizeof(v));
+			break;
+	}
+	o->count++;
+}
+
+/*
+ * Fixed point value, binary format keeps the raw integer
+ */
+void plug417_out_fixed(struct plug417_output *o, const char *key,
+		const char *label, int64_t value, double scale)
+{
+	int32_t v;
+
+	switch (o->format) {
+		case PLUG417_FORMAT_TEXT:
+			plug417_out_printf(o, "%s: %.2f\n", label, value * scale);
+			break;
+		case PLUG417_FORMAT_JSON:
+			plug417_out_printf(o, "%s\"%s\":%.2f", o->count ? "," : "",
+					key, value * scale);
+			break;
+		case PLUG417_FORMAT_CSV:
+			if (o->pass == 0)
+				plug417_out_printf(o, ",%s", key);
+			else
+				plug417_out_printf(o, ",%.2f", value * scale);
+			break;
+		case PLUG417_FORMAT_BIN:
+			v = htole32((int32_t)value);
+			plug417_out_raw(o, &v, sizeof(v));
+			break;
+	}
+	o->count++;
+}
+
+
+/*
+ * Hexadecimal in text format, decimal in the others
+ */
+void plug417_out_hex(struct plug417_output *o, const char *key,
+		const char *label, uint32_t value, int digits)
+{
+	if (o->format == PLUG417_FORMAT_TEXT) {
+		plug417_out_printf(o, "%s: %0*" PRIx32 "\n", label, digits, value);
+		o->count++;
+		return;
+	}
+	plug417_out_field(o, key, label, value, NULL);
+}
@@ -0,0 +1,222 @@
+/*
+ * plug417 link and sensor health metrics export
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "plug417metrics.h"
+
+#define PLUG417_METRICS_WORDS	(sizeof(struct plug417_metrics) / sizeof(uint64_t))
+
+/*
+ *
+ */
+static void plug417_metrics_load(const struct plug417_metrics *src,
+		struct plug417_metrics *m)
+{
+	const uint64_t *s = (const uint64_t *)src;
+	uint64_t *d = (uint64_t *)m;
+	int i;
+
+	for (i = 0; i < PLUG417_METRICS_WORDS; i++)
+		d[i] = __atomic_load_n(&s[i], __ATOMIC_RELAXED);
+}
+
+/*
+ *
+ */
+static void plug417_metrics_store(struct plug417_metrics *dst,
+		const struct plug417_metrics *m)
+{
+	const uint64_t *s = (const uint64_t *)m;
+	uint64_t *d = (uint64_t *)dst;
+	int i;
+
+	for (i = 0; i < PLUG417_METRICS_WORDS; i++)
+		__atomic_store_n(&d[i], s[i], __ATOMIC_RELAXED);
+}
+
+/*
+ * Counters may be updated concurrently, each one is read atomically
+ */
+void plug417_metrics_snapshot(const struct plug417_metrics *src,
+		struct plug417_metrics *m)
+{
+	plug417_metrics_load(src, m);
+}
+
+/*
+ * Prometheus text exposition format
+ */
+int plug417_metrics_prometheus(const struct plug417_metrics *m,
+		const char *labels, char *buf, int size)
+{
+	char l[256];
+	const char *c = labels ? "," : "";
+	int n;
+
+	if (labels)
+		snprintf(l, sizeof(l), "{%s}", labels);
+	else
+		l[0] = '\0';
+
+	n = snprintf(buf, size,
+		"# TYPE plug417_frames_sent_total counter\n"
+		"plug417_frames_sent_total%s %" PRIu64 "\n"
+		"# TYPE plug417_frames_received_total counter\n"
+		"plug417_frames_received_total%s %" PRIu64 "\n"
+		"# TYPE plug417_bytes_sent_total counter\n"
+		"plug417_bytes_sent_total%s %" PRIu64 "\n"
+		"# TYPE plug417_bytes_received_total counter\n"
+		"plug417_bytes_received_total%s %" PRIu64 "\n"
+		"# TYPE plug417_handshakes_total counter\n"
+		"plug417_handshakes_total{%s%sresult=\"ok\"} %" PRIu64 "\n"
+		"plug417_handshakes_total{%s%sresult=\"error\"} %" PRIu64 "\n"
+		"# TYPE plug417_timeouts_total counter\n"
+		"plug417_timeouts_total%s %" PRIu64 "\n"
+		"# TYPE plug417_checksum_errors_total counter\n"
+		"plug417_checksum_errors_total%s %" PRIu64 "\n"
+		"# TYPE plug417_resyncs_total counter\n"
+		"plug417_resyncs_total%s %" PRIu64 "\n",
+		l, m->frames_tx, l, m->frames_rx, l, m->bytes_tx, l, m->bytes_rx,
+		labels ? labels : "", c, m->handshake_ok,
+		labels ? labels : "", c, m->handshake_error,
+		l, m->timeouts, l, m->checksum_errors, l, m->resyncs);
+
+	if (n < 0 || n >= size)
+		return -1;
+
+	/* Temperature is only exported once it was queried */
+	if (m->focal_spot_timestamp) {
+		n += snprintf(buf + n, size - n,
+			"# TYPE plug417_focal_spot_temperature_celsius gauge\n"
+			"plug417_focal_spot_temperature_celsius%s %.2f\n",
+			l, m->focal_spot_temperature * 0.01);
+		if (n >= size)
+			return -1;
+	}
+	return n;
+}
+
+/*
+ * Written to a temporary file and renamed, scrapers never see a partial file
+ */
+int plug417_metrics_write_file(const struct plug417_metrics *m,
+		const char *labels, const char *path)
+{
+	char buf[2048];
+	char tmp[512];
+	int fd, n;
+
+	n = plug417_metrics_prometheus(m, labels, buf, sizeof(buf));
+	if (n < 0)
+		return -1;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= sizeof(tmp))
+		return -1;
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return -1;
+
+	if (write(fd, buf, n) != n) {
+		close(fd);
+		unlink(tmp);
+		return -1;
+	}
+	close(fd);
+
+	return rename(tmp, path);
+}
+
+/*
+ * Snapshot file, typically placed on tmpfs such as /dev/shm
+ */
+struct plug417_metrics_shm *plug417_metrics_shm_open(const char *path, int create)
+{
+	struct plug417_metrics_shm *shm;
+	int fd;
+
+	fd = open(path, create ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+	if (fd < 0)
+		return NULL;
+
+	if (create && ftruncate(fd, sizeof(struct plug417_metrics_shm)) < 0) {
+		close(fd);
+		return NULL;
+	}
+
+	shm = mmap(NULL, sizeof(struct plug417_metrics_shm),
+			create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED)
+		return NULL;
+
+	if (create) {
+		memcpy(shm->magic, PLUG417_METRICS_MAGIC, sizeof(shm->magic));
+		shm->version = PLUG417_METRICS_VERSION;
+	} else if (memcmp(shm->magic, PLUG417_METRICS_MAGIC, sizeof(shm->magic)) ||
+			shm->version != PLUG417_METRICS_VERSION) {
+		munmap(shm, sizeof(struct plug417_metrics_shm));
+		return NULL;
+	}
+	return shm;
+}
+
+/*
+ *
+ */
+void plug417_metrics_shm_close(struct plug417_metrics_shm *shm)
+{
+	munmap(shm, sizeof(struct plug417_metrics_shm));
+}
+
+/*
+ * Single writer sequence lock, readers never block the writer
+ */
+void plug417_metrics_shm_publish(struct plug417_metrics_shm *shm,
+		const struct plug417_metrics *m)
+{
+	struct plug417_metrics v;
+	uint32_t seq;
+
+	plug417_metrics_load(m, &v);
+
+	seq = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+	__atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	plug417_metrics_store(&shm->metrics, &v);
+
+	__atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*
+ *
+ */
+int plug417_metrics_shm_read(const struct plug417_metrics_shm *shm,
+		struct plug417_metrics *m)
+{
+	uint32_t seq;
+	int retry;
+
+	for (retry = 0; retry < 1000; retry++) {
+		seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		plug417_metrics_load(&shm->metrics, m);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) == seq)
+			return 0;
+	}
+	return -1;
+}
@@ -0,0 +1,246 @@
+/*
+ * plug417 shutter and NUC event detection
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "plug417nuc.h"
+#include "plug417param.h"
+#include "plug417trace.h"
+
+static const struct plug417_nuc_settings plug417_nuc_default = {
+	.frozen = 0.05f,
+	.jump = 20.0f,
+	.recover = 3,
+	.limit = 100,
+	.expected = 1000000000ULL,
+	.mode = PLUG417_NUC_GATE,
+	.causes = PLUG417_NUC_CAUSES_DEFAULT,
+};
+
+/*
+ * NULL settings use the defaults
+ */
+struct plug417_nuc *plug417_nuc_alloc(unsigned int width, unsigned int height,
+		const struct plug417_nuc_settings *settings)
+{
+	struct plug417_nuc *n;
+
+	if (!width || !height)
+		return NULL;
+
+	n = malloc(sizeof(struct plug417_nuc));
+	if (!n)
+		return NULL;
+
+	memset(n, 0, sizeof(struct plug417_nuc));
+	n->width = width;
+	n->height = height;
+	n->settings = settings ? *settings : plug417_nuc_default;
+	n->count = ((width + PLUG417_NUC_STEP - 1) / PLUG417_NUC_STEP) *
+		((height + PLUG417_NUC_STEP - 1) / PLUG417_NUC_STEP);
+	n->sample = malloc(n->count * sizeof(int16_t));
+	n->held = malloc((size_t)width * height * sizeof(uint16_t));
+	if (!n->sample || !n->held) {
+		plug417_nuc_free(n);
+		return NULL;
+	}
+	return n;
+}
+
+/*
+ *
+ */
+void plug417_nuc_free(struct plug417_nuc *n)
+{
+	free(n->sample);
+	free(n->held);
+	free(n);
+}
+
+/*
+ *
+ */
+void plug417_nuc_set(struct plug417_nuc *n, const struct plug417_nuc_settings *settings)
+{
+	n->settings = *settings;
+}
+
+/*
+ * Called when an event begins and when it ends, e.g. to reset temporal
+ * filters and AGC that would otherwise smear the step
+ */
+void plug417_nuc_set_callback(struct plug417_nuc *n, plug417_nuc_callback callback, void *arg)
+{
+	n->callback = callback;
+	n->arg = arg;
+}
+
+/*
+ *
+ */
+void plug417_nuc_reset(struct plug417_nuc *n)
+{
+	memset(&n->event, 0, sizeof(struct plug417_nuc_event));
+	n->recover = 0;
+	n->suppress = 0;
+	n->expect_until = 0;
+	n->have_prev = 0;
+	n->have_held = 0;
+}
+
+/*
+ * Frames from timestamp on, for the expected duration, are inside an
+ * event whatever their statistics
+ */
+int plug417_nuc_expect(struct plug417_nuc *n, uint64_t timestamp)
+{
+	n->expect_until = timestamp + n->settings.expected;
+	return 0;
+}
+
+/*
+ * Runs shutter compensation now, at a time the application chose
+ */
+int plug417_nuc_trigger(struct plug417_nuc *n, struct plug417_serial *s)
+{
+	uint64_t now = plug417_clock_ns();
+
+	if (plug417_set_shutter_control(s, 1) < 0)
+		return -1;
+
+	return plug417_nuc_expect(n, now);
+}
+
+/*
+ * Causes found in the frame
+ */
+static unsigned int plug417_nuc_detect(struct plug417_nuc *n, const struct plug417_video_frame *f)
+{
+	const int16_t *row;
+	unsigned int x, y, i = 0, cause = 0;
+	int64_t sum = 0, diff = 0;
+	double mean;
+	int v;
+
+	for (y = 0; y < f->height; y += PLUG417_NUC_STEP) {
+		row = (const int16_t *)f->y16 + (size_t)y * f->stride;
+		for (x = 0; x < f->width; x += PLUG417_NUC_STEP, i++) {
+			v = row[x];
+			sum += v;
+			diff += abs(v - n->sample[i]);
+			n->sample[i] = v;
+		}
+	}
+	mean = (double)sum / n->count;
+
+	if (n->have_prev) {
+		if ((double)diff / n->count < n->settings.frozen)
+			cause |= PLUG417_NUC_FROZEN;
+		if (fabs(mean - n->mean) > n->settings.jump)
+			cause |= PLUG417_NUC_JUMP;
+	}
+	n->mean = mean;
+	n->have_prev = 1;
+
+	if (f->info.valid && f->info.shutter == PLUG417_PARAM_SHUTTER_CLOSED)
+		cause |= PLUG417_NUC_SHUTTER;
+	if (f->timestamp < n->expect_until)
+		cause |= PLUG417_NUC_TRIGGERED;
+
+	cause &= n->settings.causes;
+
+	/* A cause that ran into the limit counts again once it cleared */
+	n->suppress &= cause;
+	return cause & ~n->suppress;
+}
+
+/*
+ *
+ */
+static void plug417_nuc_end(struct plug417_nuc *n, const struct plug417_video_frame *f)
+{
+	n->event.active = 0;
+	n->event.sequence = f->sequence;
+	n->event.timestamp = f->timestamp;
+	n->recover = 0;
+	if (n->callback)
+		n->callback(n->arg, &n->event);
+}
+
+/*
+ * Returns the causes of the event the frame is inside of, 0 for a good
+ * frame. In hold mode frames inside an event are overwritten with the
+ * last good frame once there is one.
+ */
+int plug417_nuc_frame(struct plug417_nuc *n, struct plug417_video_frame *f)
+{
+	unsigned int cause, y;
+
+	if (!f->y16 || f->width != n->width || f->height != n->height)
+		return -1;
+
+	n->frames++;
+	cause = plug417_nuc_detect(n, f);
+
+	if (cause) {
+		if (!n->event.active) {
+			n->event.active = 1;
+			n->event.cause = cause;
+			n->event.sequence = f->sequence;
+			n->event.timestamp = f->timestamp;
+			n->event.frames = 0;
+			n->events++;
+			if (n->callback)
+				n->callback(n->arg, &n->event);
+		}
+		n->event.cause |= cause;
+		n->recover = n->settings.recover;
+	} else if (n->event.active) {
+		if (n->recover)
+			n->recover--;
+		else
+			plug417_nuc_end(n, f);
+	}
+
+	if (n->event.active && n->settings.limit && n->event.frames >= n->settings.limit) {
+		/* Static scene or stuck flag, not a compensation */
+		n->suppress = cause;
+		plug417_nuc_end(n, f);
+	}
+
+	if (!n->event.active) {
+		for (y = 0; y < f->height; y++)
+			memcpy(n->held + (size_t)y * n->width, f->y16 + (size_t)y * f->stride,
+					n->width * sizeof(uint16_t));
+		n->have_held = 1;
+		return 0;
+	}
+
+	n->event.frames++;
+	n->gated++;
+	if (n->settings.mode == PLUG417_NUC_HOLD && n->have_held) {
+		for (y = 0; y < f->height; y++)
+			memcpy(f->y16 + (size_t)y * f->stride, n->held + (size_t)y * n->width,
+					n->width * sizeof(uint16_t));
+	}
+	return n->event.cause;
+}
+
+/*
+ * Pipeline stage, ordered. Gates frames inside an event unless they
+ * were replaced in hold mode.
+ */
+int plug417_nuc_process(void *arg, struct plug417_video_frame *f)
+{
+	struct plug417_nuc *n = (struct plug417_nuc *)arg;
+	int ret;
+
+	ret = plug417_nuc_frame(n, f);
+	if (ret <= 0)
+		return ret;
+
+	return n->settings.mode == PLUG417_NUC_HOLD && n->have_held ? 0 : 1;
+}
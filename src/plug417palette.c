@@ -0,0 +1,309 @@
+/*
+ * plug417 host side pseudo color
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "plug417palette.h"
+#include "plug417simd.h"
+
+#define PLUG417_PALETTE_STOPS_MAX	16
+#define PLUG417_PALETTE_BLOCK		64
+
+struct plug417_palette_stops {
+	unsigned int count;
+	uint8_t rgb[PLUG417_PALETTE_STOPS_MAX][3];
+};
+
+/*
+ * Key colors of the sensor palettes, indexed by PLUG417_COMMAND_COLOR_*
+ */
+static const struct plug417_palette_stops plug417_palette_stops[] = {
+	[PLUG417_COMMAND_COLOR_WHITE_HOT] = {2, {
+		{0, 0, 0}, {255, 255, 255}}},
+	[PLUG417_COMMAND_COLOR_FULGURITE] = {5, {
+		{0, 0, 0}, {60, 0, 120}, {0, 90, 230}, {150, 220, 255},
+		{255, 255, 255}}},
+	[PLUG417_COMMAND_COLOR_IRON_RED] = {6, {
+		{0, 0, 0}, {32, 0, 140}, {204, 0, 119}, {255, 100, 0},
+		{255, 200, 0}, {255, 255, 255}}},
+	[PLUG417_COMMAND_COLOR_HOT_IRON] = {5, {
+		{0, 0, 0}, {160, 0, 0}, {255, 80, 0}, {255, 220, 0},
+		{255, 255, 255}}},
+	[PLUG417_COMMAND_COLOR_MEDICAL] = {7, {
+		{0, 0, 80}, {0, 0, 255}, {0, 200, 200}, {0, 220, 0},
+		{255, 255, 0}, {255, 0, 0}, {255, 255, 255}}},
+	[PLUG417_COMMAND_COLOR_ARCTIC] = {5, {
+		{0, 0, 40}, {0, 80, 200}, {120, 200, 255}, {255, 200, 0},
+		{255, 255, 200}}},
+	[PLUG417_COMMAND_COLOR_RAINBOW_1] = {5, {
+		{0, 0, 255}, {0, 255, 255}, {0, 255, 0}, {255, 255, 0},
+		{255, 0, 0}}},
+	[PLUG417_COMMAND_COLOR_RAINBOW_2] = {8, {
+		{0, 0, 0}, {0, 0, 255}, {0, 255, 255}, {0, 255, 0},
+		{255, 255, 0}, {255, 0, 0}, {255, 0, 255}, {255, 255, 255}}},
+	[PLUG417_COMMAND_COLOR_TINT] = {4, {
+		{0, 0, 0}, {200, 200, 200}, {255, 120, 0}, {255, 0, 0}}},
+	[PLUG417_COMMAND_COLOR_BLACK_HOT] = {2, {
+		{255, 255, 255}, {0, 0, 0}}},
+};
+
+/*
+ * BT.601 studio range
+ */
+static void plug417_palette_yuv(struct plug417_palette *p)
+{
+	int i, r, g, b;
+
+	for (i = 0; i < PLUG417_PALETTE_SIZE; i++) {
+		r = p->rgba[i][0];
+		g = p->rgba[i][1];
+		b = p->rgba[i][2];
+		p->yuv[i][0] = 16 + ((66 * r + 129 * g + 25 * b + 128) >> 8);
+		p->yuv[i][1] = 128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8);
+		p->yuv[i][2] = 128 + ((112 * r - 94 * g - 18 * b + 128) >> 8);
+		p->yuv[i][3] = 0;
+	}
+}
+
+/*
+ * Stops are spread evenly over the table, linear in between
+ */
+int plug417_palette_custom(struct plug417_palette *p, const uint8_t (*stops)[3],
+		unsigned int count)
+{
+	unsigned int i, k, s, f;
+
+	if (count < 2)
+		return -1;
+
+	for (i = 0; i < PLUG417_PALETTE_SIZE; i++) {
+		s = i * (count - 1) / (PLUG417_PALETTE_SIZE - 1);
+		if (s >= count - 1)
+			s = count - 2;
+		/* Position between stop s and s + 1, 0..255 */
+		f = i * (count - 1) - s * (PLUG417_PALETTE_SIZE - 1);
+		for (k = 0; k < 3; k++)
+			p->rgba[i][k] = (stops[s][k] * (255 - f) + stops[s + 1][k] * f +
+					127) / 255;
+		p->rgba[i][3] = 255;
+	}
+
+	plug417_palette_yuv(p);
+	return 0;
+}
+
+/*
+ *
+ */
+int plug417_palette_init(struct plug417_palette *p, unsigned int color)
+{
+	if (color > PLUG417_COMMAND_COLOR_MAX)
+		return -1;
+
+	return plug417_palette_custom(p, plug417_palette_stops[color].rgb,
+			plug417_palette_stops[color].count);
+}
+
+/*
+ * Text file, one "r g b" line per color, '#' starts a comment.
+ * 256 lines are a full table, fewer are key colors.
+ */
+int plug417_palette_load(struct plug417_palette *p, const char *path)
+{
+	uint8_t (*rgb)[3];
+	unsigned int r, g, b, n = 0;
+	char line[128];
+	FILE *f;
+	int err = -1;
+
+	rgb = malloc(PLUG417_PALETTE_SIZE * sizeof(*rgb));
+	if (!rgb)
+		return -1;
+
+	f = fopen(path, "r");
+	if (!f) {
+		free(rgb);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0')
+			continue;
+		if (n == PLUG417_PALETTE_SIZE || sscanf(line, "%u %u %u", &r, &g, &b) != 3 ||
+				r > 255 || g > 255 || b > 255)
+			goto out;
+		rgb[n][0] = r;
+		rgb[n][1] = g;
+		rgb[n][2] = b;
+		n++;
+	}
+
+	if (n == PLUG417_PALETTE_SIZE) {
+		for (n = 0; n < PLUG417_PALETTE_SIZE; n++) {
+			memcpy(p->rgba[n], rgb[n], 3);
+			p->rgba[n][3] = 255;
+		}
+		plug417_palette_yuv(p);
+		err = 0;
+	} else {
+		err = plug417_palette_custom(p, (const uint8_t (*)[3])rgb, n);
+	}
+out:
+	fclose(f);
+	free(rgb);
+	return err;
+}
+
+/*
+ * Linear AGC, index = clamp(y16 * k + bias) with bias holding -lo * k
+ * and the rounding
+ */
+static void plug417_palette_index(const uint16_t *src, uint8_t *idx,
+		unsigned int n, float k, float bias)
+{
+	unsigned int i = 0;
+	float x;
+
+#if defined(PLUG417_SSE2)
+	__m128 vk = _mm_set1_ps(k), vb = _mm_set1_ps(bias);
+	__m128 zero = _mm_setzero_ps(), max = _mm_set1_ps(255.0f);
+	__m128i v, a, b;
+	__m128 fa, fb;
+
+	for (; i + 8 <= n; i += 8) {
+		v = _mm_loadu_si128((const __m128i *)(src + i));
+		a = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		b = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		fa = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(a), vk), vb);
+		fb = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(b), vk), vb);
+		fa = _mm_min_ps(_mm_max_ps(fa, zero), max);
+		fb = _mm_min_ps(_mm_max_ps(fb, zero), max);
+		v = _mm_packs_epi32(_mm_cvttps_epi32(fa), _mm_cvttps_epi32(fb));
+		_mm_storel_epi64((__m128i *)(idx + i), _mm_packus_epi16(v, v));
+	}
+#elif defined(PLUG417_NEON)
+	float32x4_t vk = vdupq_n_f32(k), vb = vdupq_n_f32(bias);
+	float32x4_t zero = vdupq_n_f32(0.0f), max = vdupq_n_f32(255.0f);
+	float32x4_t fa, fb;
+	int16x8_t v;
+
+	for (; i + 8 <= n; i += 8) {
+		v = vreinterpretq_s16_u16(vld1q_u16(src + i));
+		fa = vcvtq_f32_s32(vmovl_s16(vget_low_s16(v)));
+		fb = vcvtq_f32_s32(vmovl_s16(vget_high_s16(v)));
+		fa = vminq_f32(vmaxq_f32(vmlaq_f32(vb, fa, vk), zero), max);
+		fb = vminq_f32(vmaxq_f32(vmlaq_f32(vb, fb, vk), zero), max);
+		vst1_u8(idx + i, vqmovn_u16(vcombine_u16(
+				vqmovun_s32(vcvtq_s32_f32(fa)),
+				vqmovun_s32(vcvtq_s32_f32(fb)))));
+	}
+#endif
+	for (; i < n; i++) {
+		x = (int16_t)src[i] * k + bias;
+		if (x < 0.0f)
+			x = 0.0f;
+		if (x > 255.0f)
+			x = 255.0f;
+		idx[i] = x;
+	}
+}
+
+/*
+ *
+ */
+static void plug417_palette_write(const struct plug417_palette *p,
+		const uint8_t *idx, unsigned int n, unsigned int format, uint8_t *out)
+{
+	unsigned int i;
+
+	switch (format) {
+		case PLUG417_PALETTE_RGB24:
+			for (i = 0; i < n; i++, out += 3)
+				memcpy(out, p->rgba[idx[i]], 3);
+			break;
+		case PLUG417_PALETTE_RGBA:
+			for (i = 0; i < n; i++, out += 4)
+				memcpy(out, p->rgba[idx[i]], 4);
+			break;
+		case PLUG417_PALETTE_YUV422:
+			/* YUYV, chroma of the pixel pair is averaged */
+			for (i = 0; i + 1 < n; i += 2, out += 4) {
+				out[0] = p->yuv[idx[i]][0];
+				out[1] = (p->yuv[idx[i]][1] + p->yuv[idx[i + 1]][1] + 1) >> 1;
+				out[2] = p->yuv[idx[i + 1]][0];
+				out[3] = (p->yuv[idx[i]][2] + p->yuv[idx[i + 1]][2] + 1) >> 1;
+			}
+			break;
+	}
+}
+
+/*
+ * Y16 between lo and hi is stretched over the palette. Rows are done in
+ * blocks so the indexes stay in L1 between the two steps.
+ */
+int plug417_palette_colorize(const struct plug417_palette *p,
+		const struct plug417_video_frame *f, int lo, int hi,
+		unsigned int format, uint8_t *out, unsigned int out_stride)
+{
+	static const unsigned int bpp[] = {3, 4, 2};
+	uint8_t idx[PLUG417_PALETTE_BLOCK];
+	unsigned int x, y, n;
+	float k, bias;
+
+	if (!f->y16 || format > PLUG417_PALETTE_FORMAT_MAX ||
+			(format == PLUG417_PALETTE_YUV422 && (f->width & 1)))
+		return -1;
+
+	if (hi <= lo)
+		hi = lo + 1;
+	k = (PLUG417_PALETTE_SIZE - 1) / (float)(hi - lo);
+	bias = 0.5f - lo * k;
+
+	for (y = 0; y < f->height; y++) {
+		const uint16_t *src = f->y16 + (size_t)y * f->stride;
+		uint8_t *dst = out + (size_t)y * out_stride;
+
+		for (x = 0; x < f->width; x += n) {
+			n = f->width - x;
+			if (n > PLUG417_PALETTE_BLOCK)
+				n = PLUG417_PALETTE_BLOCK;
+			plug417_palette_index(src + x, idx, n, k, bias);
+			plug417_palette_write(p, idx, n, format, dst + x * bpp[format]);
+		}
+	}
+	return 0;
+}
+
+/*
+ * Palette index from a 65536 entry table indexed by Y16, such as the one
+ * built by plug417_agc_update()
+ */
+int plug417_palette_colorize_lut(const struct plug417_palette *p,
+		const struct plug417_video_frame *f, const uint8_t *lut,
+		unsigned int format, uint8_t *out, unsigned int out_stride)
+{
+	static const unsigned int bpp[] = {3, 4, 2};
+	uint8_t idx[PLUG417_PALETTE_BLOCK];
+	unsigned int x, y, n, i;
+
+	if (!f->y16 || format > PLUG417_PALETTE_FORMAT_MAX ||
+			(format == PLUG417_PALETTE_YUV422 && (f->width & 1)))
+		return -1;
+
+	for (y = 0; y < f->height; y++) {
+		const uint16_t *src = f->y16 + (size_t)y * f->stride;
+		uint8_t *dst = out + (size_t)y * out_stride;
+
+		for (x = 0; x < f->width; x += n) {
+			n = f->width - x;
+			if (n > PLUG417_PALETTE_BLOCK)
+				n = PLUG417_PALETTE_BLOCK;
+			for (i = 0; i < n; i++)
+				idx[i] = lut[src[x + i]];
+			plug417_palette_write(p, idx, n, format, dst + x * bpp[format]);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,40 @@
+/*
+ * plug417 digital video parameter line decoder
+ */
+#include <string.h>
+
+#include "plug417param.h"
+
+/*
+ * Line is already in host order. Returns -1 and clears valid when the
+ * line is not consistent with the frame geometry.
+ */
+int plug417_param_decode(const uint16_t *line, unsigned int width,
+		unsigned int height, struct plug417_param *p)
+{
+	memset(p, 0, sizeof(struct plug417_param));
+
+	if (width < PLUG417_PARAM_WORDS)
+		return -1;
+
+	p->frame_counter = (uint32_t)line[PLUG417_PARAM_WORD_FRAME_COUNTER_HI] << 16 |
+		line[PLUG417_PARAM_WORD_FRAME_COUNTER_LO];
+	p->focal_spot_temperature = (int16_t)line[PLUG417_PARAM_WORD_FOCAL_SPOT];
+	p->max_x = line[PLUG417_PARAM_WORD_MAX_X];
+	p->max_y = line[PLUG417_PARAM_WORD_MAX_Y];
+	p->max_value = (int16_t)line[PLUG417_PARAM_WORD_MAX_VALUE];
+	p->min_x = line[PLUG417_PARAM_WORD_MIN_X];
+	p->min_y = line[PLUG417_PARAM_WORD_MIN_Y];
+	p->min_value = (int16_t)line[PLUG417_PARAM_WORD_MIN_VALUE];
+	p->center_value = (int16_t)line[PLUG417_PARAM_WORD_CENTER_VALUE];
+	p->shutter = line[PLUG417_PARAM_WORD_SHUTTER] ?
+		PLUG417_PARAM_SHUTTER_CLOSED : PLUG417_PARAM_SHUTTER_OPEN;
+
+	if (p->max_x >= width || p->max_y >= height ||
+			p->min_x >= width || p->min_y >= height ||
+			p->min_value > p->max_value)
+		return -1;
+
+	p->valid = 1;
+	return 0;
+}
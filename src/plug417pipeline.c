@@ -0,0 +1,793 @@
+/*
+ * plug417 parallel frame pipeline on a work-stealing scheduler
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "plug417trace.h"
+#include "plug417pipeline.h"
+
+static __thread struct plug417_sched_worker *plug417_sched_self;
+
+/*
+ * Size is rounded up to a power of two
+ */
+static int plug417_ring_init(struct plug417_ring *r, unsigned int size)
+{
+	unsigned int n = 1, i;
+
+	while (n < size)
+		n <<= 1;
+
+	r->slots = malloc(n * sizeof(struct plug417_ring_slot));
+	if (!r->slots)
+		return -1;
+
+	memset(r->slots, 0, n * sizeof(struct plug417_ring_slot));
+	for (i = 0; i < n; i++)
+		r->slots[i].seq = i;
+	r->mask = n - 1;
+	r->head = 0;
+	r->tail = 0;
+	return 0;
+}
+
+/*
+ *
+ */
+static int plug417_ring_push(struct plug417_ring *r, void *data)
+{
+	struct plug417_ring_slot *slot;
+	uint64_t pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED), seq;
+	int64_t dif;
+
+	for (;;) {
+		slot = &r->slots[pos & r->mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		dif = (int64_t)(seq - pos);
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&r->tail, &pos, pos + 1, 1,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			return -1;
+		} else {
+			pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+		}
+	}
+
+	slot->data = data;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/*
+ *
+ */
+static void *plug417_ring_pop(struct plug417_ring *r)
+{
+	struct plug417_ring_slot *slot;
+	uint64_t pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED), seq;
+	int64_t dif;
+	void *data;
+
+	for (;;) {
+		slot = &r->slots[pos & r->mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		dif = (int64_t)(seq - (pos + 1));
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&r->head, &pos, pos + 1, 1,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			return NULL;
+		} else {
+			pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+		}
+	}
+
+	data = slot->data;
+	__atomic_store_n(&slot->seq, pos + r->mask + 1, __ATOMIC_RELEASE);
+	return data;
+}
+
+/*
+ * Owner only
+ */
+static int plug417_deque_push(struct plug417_deque *d, struct plug417_task *t)
+{
+	int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+	int64_t top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+
+	if (b - top >= PLUG417_SCHED_DEQUE)
+		return -1;
+
+	__atomic_store_n(&d->tasks[b & (PLUG417_SCHED_DEQUE - 1)], t, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/*
+ * Owner only, newest task first
+ */
+static struct plug417_task *plug417_deque_pop(struct plug417_deque *d)
+{
+	int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1, top;
+	struct plug417_task *t = NULL;
+
+	__atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	top = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+
+	if (top <= b) {
+		t = __atomic_load_n(&d->tasks[b & (PLUG417_SCHED_DEQUE - 1)], __ATOMIC_RELAXED);
+		if (top != b)
+			return t;
+		/* Last task, race against thieves */
+		if (!__atomic_compare_exchange_n(&d->top, &top, top + 1, 0,
+				__ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+			t = NULL;
+	}
+	__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+	return t;
+}
+
+/*
+ * Any thread, oldest task first
+ */
+static struct plug417_task *plug417_deque_steal(struct plug417_deque *d)
+{
+	int64_t top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE), b;
+	struct plug417_task *t;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+	if (top >= b)
+		return NULL;
+
+	t = __atomic_load_n(&d->tasks[top & (PLUG417_SCHED_DEQUE - 1)], __ATOMIC_RELAXED);
+	if (!__atomic_compare_exchange_n(&d->top, &top, top + 1, 0,
+			__ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+		return NULL;
+	return t;
+}
+
+/*
+ *
+ */
+static struct plug417_task *plug417_sched_find(struct plug417_sched_worker *w)
+{
+	struct plug417_sched *s = w->sched;
+	struct plug417_task *t;
+	unsigned int i, victim;
+
+	t = plug417_deque_pop(&w->deque);
+	if (t)
+		return t;
+
+	t = plug417_ring_pop(&s->inject);
+	if (t)
+		return t;
+
+	/* Random start spreads thieves over the victims */
+	w->seed = w->seed * 1103515245 + 12345;
+	victim = (w->seed >> 16) % s->threads;
+	for (i = 0; i < s->threads; i++, victim = victim + 1 == s->threads ? 0 : victim + 1) {
+		if (victim == w->id)
+			continue;
+		t = plug417_deque_steal(&s->workers[victim].deque);
+		if (t) {
+			w->stolen++;
+			return t;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Sleeps unless work was submitted since signal was sampled
+ */
+static void plug417_sched_sleep(struct plug417_sched *s, unsigned int signal)
+{
+	struct timespec ts;
+
+	pthread_mutex_lock(&s->lock);
+	__atomic_add_fetch(&s->sleepers, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&s->signal, __ATOMIC_SEQ_CST) == signal &&
+			!__atomic_load_n(&s->stop, __ATOMIC_RELAXED)) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += 10000000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&s->wake, &s->lock, &ts);
+	}
+	__atomic_sub_fetch(&s->sleepers, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&s->lock);
+}
+
+/*
+ *
+ */
+static void *plug417_sched_worker(void *arg)
+{
+	struct plug417_sched_worker *w = arg;
+	struct plug417_sched *s = w->sched;
+	struct plug417_task *t;
+	unsigned int idle = 0, signal;
+
+	plug417_sched_self = w;
+
+	for (;;) {
+		signal = __atomic_load_n(&s->signal, __ATOMIC_SEQ_CST);
+		t = plug417_sched_find(w);
+		if (t) {
+			t->run(t);
+			w->executed++;
+			idle = 0;
+			continue;
+		}
+
+		if (__atomic_load_n(&s->stop, __ATOMIC_ACQUIRE))
+			break;
+
+		/* Spin a little before sleeping, frames come in bursts */
+		if (++idle < 64) {
+			sched_yield();
+			continue;
+		}
+		plug417_sched_sleep(s, signal);
+		idle = 0;
+	}
+	return NULL;
+}
+
+/*
+ * Zero threads starts one per online CPU
+ */
+struct plug417_sched *plug417_sched_alloc(unsigned int threads)
+{
+	struct plug417_sched *s;
+	long cpus;
+	unsigned int i;
+
+	if (!threads) {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus > 0 ? cpus : 1;
+	}
+	if (threads > PLUG417_SCHED_THREADS_MAX)
+		threads = PLUG417_SCHED_THREADS_MAX;
+
+	s = malloc(sizeof(struct plug417_sched));
+	if (!s)
+		return NULL;
+
+	memset(s, 0, sizeof(struct plug417_sched));
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->wake, NULL);
+
+	if (plug417_ring_init(&s->inject, PLUG417_SCHED_INJECT) < 0)
+		goto err;
+
+	if (posix_memalign((void **)&s->workers, 64,
+			threads * sizeof(struct plug417_sched_worker)))
+		goto err_ring;
+
+	memset(s->workers, 0, threads * sizeof(struct plug417_sched_worker));
+	for (i = 0; i < threads; i++) {
+		s->workers[i].sched = s;
+		s->workers[i].id = i;
+		s->workers[i].seed = i + 1;
+	}
+
+	/* Thieves look at all deques, started or not */
+	s->threads = threads;
+	for (i = 0; i < threads; i++) {
+		if (pthread_create(&s->workers[i].thread, NULL, plug417_sched_worker,
+				&s->workers[i]))
+			break;
+	}
+	if (i < threads) {
+		__atomic_store_n(&s->stop, 1, __ATOMIC_RELEASE);
+		while (i--)
+			pthread_join(s->workers[i].thread, NULL);
+		free(s->workers);
+		goto err_ring;
+	}
+	return s;
+
+err_ring:
+	free(s->inject.slots);
+err:
+	free(s);
+	return NULL;
+}
+
+/*
+ * Waits for running tasks, queued tasks are dropped
+ */
+void plug417_sched_free(struct plug417_sched *s)
+{
+	unsigned int i;
+
+	__atomic_store_n(&s->stop, 1, __ATOMIC_RELEASE);
+	pthread_mutex_lock(&s->lock);
+	pthread_cond_broadcast(&s->wake);
+	pthread_mutex_unlock(&s->lock);
+
+	for (i = 0; i < s->threads; i++)
+		pthread_join(s->workers[i].thread, NULL);
+
+	pthread_mutex_destroy(&s->lock);
+	pthread_cond_destroy(&s->wake);
+	free(s->workers);
+	free(s->inject.slots);
+	free(s);
+}
+
+/*
+ * Workers push to their own deque, other threads to the shared queue
+ */
+int plug417_sched_submit(struct plug417_sched *s, struct plug417_task *t)
+{
+	struct plug417_sched_worker *w = plug417_sched_self;
+	int ret;
+
+	if (w && w->sched == s)
+		ret = plug417_deque_push(&w->deque, t);
+	else
+		ret = plug417_ring_push(&s->inject, t);
+	if (ret < 0)
+		return -1;
+
+	__atomic_add_fetch(&s->signal, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&s->sleepers, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&s->lock);
+		pthread_cond_signal(&s->wake);
+		pthread_mutex_unlock(&s->lock);
+	}
+	return 0;
+}
+
+/*
+ *
+ */
+static void plug417_pipeline_max(uint64_t *max, uint64_t v)
+{
+	uint64_t cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+	while (v > cur && !__atomic_compare_exchange_n(max, &cur, v, 1,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/*
+ *
+ */
+static void plug417_pipeline_account(struct plug417_pipeline_stage *st,
+		struct plug417_pipeline_job *job, uint64_t ns)
+{
+	uint64_t latency = plug417_clock_ns() - job->ready;
+
+	__atomic_add_fetch(&st->frames, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&st->ns, ns, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&st->latency, latency, __ATOMIC_RELAXED);
+	plug417_pipeline_max(&st->latency_max, latency);
+}
+
+static void plug417_pipeline_enter(struct plug417_pipeline_job *job);
+
+/*
+ * Negative result is an error, positive gates the frame: neither is
+ * passed to the stages after
+ */
+static void plug417_pipeline_result(struct plug417_pipeline_stage *st,
+		struct plug417_pipeline_job *job, int ret)
+{
+	if (ret < 0) {
+		job->error = 1;
+		__atomic_add_fetch(&st->errors, 1, __ATOMIC_RELAXED);
+	} else if (ret > 0) {
+		job->gated = 1;
+		__atomic_add_fetch(&st->gated, 1, __ATOMIC_RELAXED);
+	}
+}
+
+/*
+ *
+ */
+static void plug417_pipeline_next(struct plug417_pipeline_job *job)
+{
+	job->stage++;
+	plug417_pipeline_enter(job);
+}
+
+/*
+ * Jobs enter in ticket order, whoever holds busy runs them
+ */
+static void plug417_pipeline_ordered(struct plug417_pipeline_stage *st, unsigned int depth)
+{
+	struct plug417_pipeline_job *job, **slot;
+	uint64_t start;
+	int ret;
+
+	for (;;) {
+		if (__atomic_test_and_set(&st->busy, __ATOMIC_ACQUIRE))
+			return;
+
+		for (;;) {
+			slot = &st->order[st->next % depth];
+			job = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+			if (!job)
+				break;
+			__atomic_store_n(slot, NULL, __ATOMIC_RELAXED);
+			__atomic_store_n(&st->next, st->next + 1, __ATOMIC_RELAXED);
+
+			/* Failed and gated frames only keep their place in the order */
+			if (!job->error && !job->gated) {
+				start = plug417_clock_ns();
+				ret = st->process(st->arg, job->frame);
+				plug417_pipeline_account(st, job, plug417_clock_ns() - start);
+				plug417_pipeline_result(st, job, ret);
+			}
+			plug417_pipeline_next(job);
+		}
+
+		__atomic_clear(&st->busy, __ATOMIC_SEQ_CST);
+		slot = &st->order[__atomic_load_n(&st->next, __ATOMIC_SEQ_CST) % depth];
+		if (!__atomic_load_n(slot, __ATOMIC_SEQ_CST))
+			return;
+	}
+}
+
+/*
+ *
+ */
+static void plug417_pipeline_tile_run(struct plug417_task *t)
+{
+	struct plug417_pipeline_tile *tile = (struct plug417_pipeline_tile *)t;
+	struct plug417_pipeline_job *job = tile->job;
+	struct plug417_pipeline_stage *st = &job->pipeline->stages[job->stage];
+	uint64_t start = plug417_clock_ns();
+
+	st->rows(st->arg, job->frame, tile->y0, tile->y1);
+	__atomic_add_fetch(&job->tile_ns, plug417_clock_ns() - start, __ATOMIC_RELAXED);
+
+	/* Last tile moves the frame on */
+	if (__atomic_sub_fetch(&job->remaining, 1, __ATOMIC_ACQ_REL))
+		return;
+
+	plug417_pipeline_account(st, job, job->tile_ns);
+	plug417_pipeline_next(job);
+}
+
+/*
+ *
+ */
+static void plug417_pipeline_job_run(struct plug417_task *t)
+{
+	struct plug417_pipeline_job *job = (struct plug417_pipeline_job *)t;
+	struct plug417_pipeline *p = job->pipeline;
+	struct plug417_pipeline_stage *st = &p->stages[job->stage];
+	struct plug417_video_frame *f = job->frame;
+	unsigned int n, i;
+	uint64_t start;
+	int ret;
+
+	if (st->flags & PLUG417_PIPELINE_ORDERED) {
+		__atomic_store_n(&st->order[job->ticket % p->depth], job, __ATOMIC_SEQ_CST);
+		plug417_pipeline_ordered(st, p->depth);
+		return;
+	}
+
+	if (st->rows) {
+		n = (f->height + st->tile - 1) / st->tile;
+		job->tile_ns = 0;
+		job->remaining = n;
+		for (i = 0; i < n; i++) {
+			job->tiles[i].task.run = plug417_pipeline_tile_run;
+			job->tiles[i].job = job;
+			job->tiles[i].y0 = i * st->tile;
+			job->tiles[i].y1 = i + 1 < n ? (i + 1) * st->tile : f->height;
+		}
+		/* Others are stolen, the first one runs here */
+		for (i = n - 1; i > 0; i--) {
+			if (plug417_sched_submit(p->sched, &job->tiles[i].task) < 0)
+				plug417_pipeline_tile_run(&job->tiles[i].task);
+		}
+		plug417_pipeline_tile_run(&job->tiles[0].task);
+		return;
+	}
+
+	start = plug417_clock_ns();
+	ret = st->process(st->arg, f);
+	plug417_pipeline_account(st, job, plug417_clock_ns() - start);
+	plug417_pipeline_result(st, job, ret);
+	plug417_pipeline_next(job);
+}
+
+/*
+ * Frames that failed or were gated skip to the next ordered stage
+ */
+static void plug417_pipeline_enter(struct plug417_pipeline_job *job)
+{
+	struct plug417_pipeline *p = job->pipeline;
+	uint64_t now = plug417_clock_ns(), latency;
+
+	while ((job->error || job->gated) && job->stage < p->count &&
+			!(p->stages[job->stage].flags & PLUG417_PIPELINE_ORDERED))
+		job->stage++;
+
+	if (job->stage < p->count) {
+		job->ready = now;
+		if (plug417_sched_submit(p->sched, &job->task) < 0)
+			plug417_pipeline_job_run(&job->task);
+		return;
+	}
+
+	latency = now - job->submitted;
+	__atomic_add_fetch(&p->frames, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&p->latency, latency, __ATOMIC_RELAXED);
+	plug417_pipeline_max(&p->latency_max, latency);
+	plug417_pipeline_max(&p->end, now);
+
+	/* Never full, there are depth jobs */
+	plug417_ring_push(&p->done, job);
+	__atomic_sub_fetch(&p->in_flight, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * At most depth frames are in flight or waiting to be collected
+ */
+struct plug417_pipeline *plug417_pipeline_alloc(struct plug417_sched *s, unsigned int depth)
+{
+	struct plug417_pipeline *p;
+	unsigned int i;
+
+	if (!depth)
+		depth = PLUG417_PIPELINE_DEPTH;
+
+	p = malloc(sizeof(struct plug417_pipeline));
+	if (!p)
+		return NULL;
+
+	memset(p, 0, sizeof(struct plug417_pipeline));
+	p->sched = s;
+	p->depth = depth;
+
+	p->jobs = malloc(depth * sizeof(struct plug417_pipeline_job));
+	if (!p->jobs)
+		goto err;
+	memset(p->jobs, 0, depth * sizeof(struct plug417_pipeline_job));
+
+	if (plug417_ring_init(&p->idle, depth) < 0)
+		goto err_jobs;
+	if (plug417_ring_init(&p->done, depth) < 0)
+		goto err_idle;
+
+	for (i = 0; i < depth; i++) {
+		p->jobs[i].task.run = plug417_pipeline_job_run;
+		p->jobs[i].pipeline = p;
+		plug417_ring_push(&p->idle, &p->jobs[i]);
+	}
+	return p;
+
+err_idle:
+	free(p->idle.slots);
+err_jobs:
+	free(p->jobs);
+err:
+	free(p);
+	return NULL;
+}
+
+/*
+ * Frames must be drained first
+ */
+void plug417_pipeline_free(struct plug417_pipeline *p)
+{
+	unsigned int i;
+
+	for (i = 0; i < p->count; i++)
+		free(p->stages[i].order);
+	for (i = 0; i < p->depth; i++)
+		free(p->jobs[i].tiles);
+	free(p->done.slots);
+	free(p->idle.slots);
+	free(p->jobs);
+	free(p);
+}
+
+/*
+ *
+ */
+static struct plug417_pipeline_stage *plug417_pipeline_add(struct plug417_pipeline *p,
+		const char *name, void *arg)
+{
+	struct plug417_pipeline_stage *st;
+
+	if (p->count == PLUG417_PIPELINE_STAGES_MAX)
+		return NULL;
+
+	st = &p->stages[p->count];
+	memset(st, 0, sizeof(struct plug417_pipeline_stage));
+	st->name = name;
+	st->arg = arg;
+	return st;
+}
+
+/*
+ * Stages run in the order they were added
+ */
+int plug417_pipeline_stage(struct plug417_pipeline *p, const char *name, int flags,
+		plug417_pipeline_process process, void *arg)
+{
+	struct plug417_pipeline_stage *st = plug417_pipeline_add(p, name, arg);
+
+	if (!st)
+		return -1;
+
+	if (flags & PLUG417_PIPELINE_ORDERED) {
+		st->order = malloc(p->depth * sizeof(struct plug417_pipeline_job *));
+		if (!st->order)
+			return -1;
+		memset(st->order, 0, p->depth * sizeof(struct plug417_pipeline_job *));
+	}
+
+	st->flags = flags;
+	st->process = process;
+	p->count++;
+	return 0;
+}
+
+/*
+ * Data parallel stage over tiles of tile rows
+ */
+int plug417_pipeline_stage_rows(struct plug417_pipeline *p, const char *name,
+		plug417_pipeline_rows rows, void *arg, unsigned int tile)
+{
+	struct plug417_pipeline_stage *st;
+
+	if (!tile)
+		return -1;
+
+	st = plug417_pipeline_add(p, name, arg);
+	if (!st)
+		return -1;
+
+	st->rows = rows;
+	st->tile = tile;
+	p->count++;
+	return 0;
+}
+
+/*
+ * One thread submits per pipeline, -1 with EAGAIN when depth frames are
+ * not collected yet
+ */
+int plug417_pipeline_submit(struct plug417_pipeline *p, struct plug417_video_frame *f)
+{
+	struct plug417_pipeline_job *job;
+	struct plug417_pipeline_tile *tiles;
+	unsigned int i, n = 0;
+
+	job = plug417_ring_pop(&p->idle);
+	if (!job) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	for (i = 0; i < p->count; i++) {
+		if (p->stages[i].rows && (f->height + p->stages[i].tile - 1) / p->stages[i].tile > n)
+			n = (f->height + p->stages[i].tile - 1) / p->stages[i].tile;
+	}
+	if (n > job->tiles_size) {
+		tiles = realloc(job->tiles, n * sizeof(struct plug417_pipeline_tile));
+		if (!tiles) {
+			plug417_ring_push(&p->idle, job);
+			return -1;
+		}
+		job->tiles = tiles;
+		job->tiles_size = n;
+	}
+
+	job->frame = f;
+	job->ticket = p->ticket++;
+	job->stage = 0;
+	job->error = 0;
+	job->gated = 0;
+	job->submitted = plug417_clock_ns();
+	if (!p->start)
+		p->start = job->submitted;
+
+	__atomic_add_fetch(&p->in_flight, 1, __ATOMIC_RELAXED);
+	plug417_pipeline_enter(job);
+	return 0;
+}
+
+/*
+ * Returns 1 with a finished frame, 2 with a frame gated by a stage, -1
+ * with a frame a stage failed on, 0 when none is ready. The frame is set
+ * and has to be returned in all three cases. Frames may finish out of
+ * submit order unless the last stage is ordered.
+ */
+int plug417_pipeline_collect(struct plug417_pipeline *p, struct plug417_video_frame **f)
+{
+	struct plug417_pipeline_job *job = plug417_ring_pop(&p->done);
+	int ret;
+
+	if (!job)
+		return 0;
+
+	*f = job->frame;
+	ret = job->error ? -1 : job->gated ? 2 : 1;
+	plug417_ring_push(&p->idle, job);
+	return ret;
+}
+
+/*
+ * Waits until submitted frames are ready to be collected
+ */
+void plug417_pipeline_drain(struct plug417_pipeline *p)
+{
+	struct timespec ts = { 0, 100000 };
+
+	while (__atomic_load_n(&p->in_flight, __ATOMIC_ACQUIRE))
+		nanosleep(&ts, NULL);
+}
+
+/*
+ *
+ */
+static void plug417_pipeline_stage_format(const struct plug417_pipeline_stage *st,
+		unsigned int n, uint64_t elapsed, struct plug417_output *o)
+{
+	uint64_t frames = st->frames ? st->frames : 1;
+
+	plug417_out_begin(o, PLUG417_FUNCTIONAL_HOST, PLUG417_HOST_PIPELINE_STAGE, st->name);
+	plug417_out_field(o, "stage", "Stage", n, NULL);
+	plug417_out_field(o, "frames", "Frames", st->frames, NULL);
+	plug417_out_field(o, "errors", "Errors", st->errors, NULL);
+	plug417_out_field(o, "gated", "Gated", st->gated, NULL);
+	plug417_out_fixed(o, "frame_us", "Per frame us", st->ns * 100 / frames / 1000, 0.01);
+	plug417_out_fixed(o, "latency_us", "Latency us",
+			st->latency * 100 / frames / 1000, 0.01);
+	plug417_out_fixed(o, "latency_max_us", "Latency max us",
+			st->latency_max * 100 / 1000, 0.01);
+	plug417_out_fixed(o, "fps", "Frames per second",
+			elapsed ? st->frames * 100000000000ULL / elapsed : 0, 0.01);
+	plug417_out_end(o, PLUG417_FUNCTIONAL_HOST, PLUG417_HOST_PIPELINE_STAGE);
+}
+
+/*
+ * One record per stage. Per frame is time spent in the stage, latency
+ * includes waiting for a worker and for the tiles of other frames.
+ */
+int plug417_pipeline_report(struct plug417_pipeline *p, struct plug417_output *o)
+{
+	int passes = o->format == PLUG417_FORMAT_CSV ? 2 : 1;
+	uint64_t elapsed = p->end > p->start ? p->end - p->start : 0;
+	uint64_t frames = p->frames ? p->frames : 1;
+	unsigned int i;
+
+	plug417_out_text(o, "Pipeline %llu frames in %.3f s, %.2f fps, latency %.1f us, max %.1f us\n",
+			(unsigned long long)p->frames, elapsed / 1e9,
+			elapsed ? p->frames * 1e9 / elapsed : 0.0,
+			p->latency / frames / 1e3, p->latency_max / 1e3);
+
+	for (o->pass = 0; o->pass < passes; o->pass++) {
+		for (i = 0; i < p->count; i++) {
+			/* CSV header once */
+			if (o->pass == 0 && passes == 2 && i)
+				break;
+			plug417_pipeline_stage_format(&p->stages[i], i, elapsed, o);
+		}
+	}
+	return o->overflow ? -1 : 0;
+}
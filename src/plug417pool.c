@@ -0,0 +1,291 @@
+/*
+ * plug417 reference counted frame buffer pool
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "plug417pool.h"
+#include "plug417simd.h"
+
+/*
+ *
+ */
+size_t plug417_pool_frame_size(unsigned int resolution, int kind)
+{
+	static const uint8_t bpp[] = {
+		[PLUG417_POOL_Y16] = 2,
+		[PLUG417_POOL_TEMP] = sizeof(float),
+		[PLUG417_POOL_RGB24] = 3,
+		[PLUG417_POOL_RGBA] = 4,
+		[PLUG417_POOL_YUV422] = 2,
+	};
+	unsigned int w, h;
+
+	if (kind < 0 || kind >= (int)sizeof(bpp) ||
+			plug417_video_resolution(resolution, &w, &h) < 0)
+		return 0;
+
+	return (size_t)w * h * bpp[kind];
+}
+
+/*
+ *
+ */
+static void plug417_pool_push(struct plug417_pool *p, struct plug417_pool_shard *s,
+		struct plug417_pool_buffer *b)
+{
+	uint64_t old = __atomic_load_n(&s->head, __ATOMIC_RELAXED), new;
+
+	do {
+		__atomic_store_n(&b->next, (uint32_t)old, __ATOMIC_RELAXED);
+		new = ((old >> 32) + 1) << 32 | (b->index + 1);
+	} while (!__atomic_compare_exchange_n(&s->head, &old, new, 1,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+ * The tag makes a concurrent pop and push of the same buffer fail the
+ * compare and swap
+ */
+static struct plug417_pool_buffer *plug417_pool_pop(struct plug417_pool *p,
+		struct plug417_pool_shard *s)
+{
+	uint64_t old = __atomic_load_n(&s->head, __ATOMIC_ACQUIRE), new;
+	struct plug417_pool_buffer *b;
+
+	do {
+		if (!(uint32_t)old)
+			return NULL;
+		b = &p->buffers[(uint32_t)old - 1];
+		new = ((old >> 32) + 1) << 32 | __atomic_load_n(&b->next, __ATOMIC_RELAXED);
+	} while (!__atomic_compare_exchange_n(&s->head, &old, new, 1,
+			__ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+	return b;
+}
+
+/*
+ *
+ */
+static unsigned int plug417_pool_cpu(struct plug417_pool *p)
+{
+	int cpu = sched_getcpu();
+
+	return cpu < 0 ? 0 : (unsigned int)cpu % p->shards;
+}
+
+/*
+ * Buffers are cache line aligned in one huge page aligned mapping
+ */
+struct plug417_pool *plug417_pool_alloc(size_t size, unsigned int count, int flags)
+{
+	struct plug417_pool *p;
+	size_t stride, bytes;
+	long cpus;
+	unsigned int i;
+
+	if (!size || !count)
+		return NULL;
+
+	stride = (size + PLUG417_CACHE_LINE - 1) & ~(size_t)(PLUG417_CACHE_LINE - 1);
+	bytes = (stride * count + PLUG417_POOL_HUGE_PAGE - 1) & ~(PLUG417_POOL_HUGE_PAGE - 1);
+
+	p = malloc(sizeof(struct plug417_pool));
+	if (!p)
+		return NULL;
+
+	memset(p, 0, sizeof(struct plug417_pool));
+	p->size = stride;
+	p->count = count;
+	p->flags = flags;
+	cpus = sysconf(_SC_NPROCESSORS_CONF);
+	p->shards = cpus < 1 ? 1 : cpus > PLUG417_POOL_SHARDS_MAX ? PLUG417_POOL_SHARDS_MAX : cpus;
+
+	if (flags & PLUG417_POOL_HUGETLB) {
+		p->map = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (p->map != MAP_FAILED) {
+			p->map_size = bytes;
+			p->base = p->map;
+			p->stats.huge = 1;
+		}
+	}
+
+	if (!p->base) {
+		/* Over allocate to align, let the kernel back it with huge pages */
+		p->map_size = bytes + PLUG417_POOL_HUGE_PAGE;
+		p->map = mmap(NULL, p->map_size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p->map == MAP_FAILED)
+			goto err;
+		p->base = (uint8_t *)(((uintptr_t)p->map + PLUG417_POOL_HUGE_PAGE - 1) &
+				~(PLUG417_POOL_HUGE_PAGE - 1));
+		p->stats.huge = madvise(p->base, bytes, MADV_HUGEPAGE) == 0;
+	}
+
+	p->buffers = malloc(count * sizeof(struct plug417_pool_buffer));
+	if (!p->buffers)
+		goto err_map;
+
+	if (posix_memalign((void **)&p->local, PLUG417_CACHE_LINE,
+			p->shards * sizeof(struct plug417_pool_shard)))
+		goto err_buffers;
+	memset(p->local, 0, p->shards * sizeof(struct plug417_pool_shard));
+
+	memset(p->buffers, 0, count * sizeof(struct plug417_pool_buffer));
+	for (i = count; i-- > 0;) {
+		p->buffers[i].data = p->base + i * stride;
+		p->buffers[i].pool = p;
+		p->buffers[i].index = i;
+		p->buffers[i].home = -1;
+		plug417_pool_push(p, &p->untouched, &p->buffers[i]);
+	}
+
+	p->stats.size = stride;
+	p->stats.count = count;
+	return p;
+
+err_buffers:
+	free(p->buffers);
+err_map:
+	munmap(p->map, p->map_size);
+err:
+	free(p);
+	return NULL;
+}
+
+/*
+ * Buffers still referenced become invalid
+ */
+void plug417_pool_free(struct plug417_pool *p)
+{
+	munmap(p->map, p->map_size);
+	free(p->local);
+	free(p->buffers);
+	free(p);
+}
+
+/*
+ * Never allocates. Buffers are taken from the list of the calling CPU,
+ * then untouched ones, whose pages the caller faults in locally, then
+ * from other CPUs. With PLUG417_POOL_POPULATE an untouched buffer is
+ * faulted in here, on the calling CPU, rather than by its first user.
+ * NULL when all buffers are in use.
+ */
+struct plug417_pool_buffer *plug417_pool_get(struct plug417_pool *p)
+{
+	struct plug417_pool_buffer *b;
+	unsigned int cpu = plug417_pool_cpu(p), i, n, peak;
+
+	b = plug417_pool_pop(p, &p->local[cpu]);
+	if (!b) {
+		b = plug417_pool_pop(p, &p->untouched);
+		if (b) {
+			b->home = cpu;
+			if (p->flags & PLUG417_POOL_POPULATE)
+				memset(b->data, 0, p->size);
+		}
+	}
+	for (i = 1; !b && i < p->shards; i++) {
+		b = plug417_pool_pop(p, &p->local[(cpu + i) % p->shards]);
+		if (b)
+			__atomic_add_fetch(&p->stats.steals, 1, __ATOMIC_RELAXED);
+	}
+
+	if (!b) {
+		__atomic_add_fetch(&p->stats.empty, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	b->refs = 1;
+	__atomic_add_fetch(&p->stats.gets, 1, __ATOMIC_RELAXED);
+	n = __atomic_add_fetch(&p->stats.in_use, 1, __ATOMIC_RELAXED);
+	peak = __atomic_load_n(&p->stats.peak, __ATOMIC_RELAXED);
+	while (n > peak && !__atomic_compare_exchange_n(&p->stats.peak, &peak, n, 1,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+	return b;
+}
+
+/*
+ * Another consumer shares the buffer
+ */
+void plug417_pool_ref(struct plug417_pool_buffer *b)
+{
+	__atomic_add_fetch(&b->refs, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&b->pool->stats.refs, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * The last reference returns the buffer to the CPU that first used it
+ */
+void plug417_pool_put(struct plug417_pool_buffer *b)
+{
+	struct plug417_pool *p = b->pool;
+
+	if (__atomic_sub_fetch(&b->refs, 1, __ATOMIC_ACQ_REL))
+		return;
+
+	__atomic_add_fetch(&p->stats.puts, 1, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&p->stats.in_use, 1, __ATOMIC_RELAXED);
+	plug417_pool_push(p, &p->local[b->home], b);
+}
+
+/*
+ * Buffer holding data, NULL when data is not from this pool
+ */
+struct plug417_pool_buffer *plug417_pool_buffer(struct plug417_pool *p, const void *data)
+{
+	const uint8_t *d = data;
+
+	if (d < p->base || d >= p->base + (size_t)p->count * p->size)
+		return NULL;
+
+	return &p->buffers[(d - p->base) / p->size];
+}
+
+/*
+ *
+ */
+void plug417_pool_stats(struct plug417_pool *p, struct plug417_pool_stats *stats)
+{
+	stats->size = p->stats.size;
+	stats->count = p->stats.count;
+	stats->huge = p->stats.huge;
+	stats->in_use = __atomic_load_n(&p->stats.in_use, __ATOMIC_RELAXED);
+	stats->peak = __atomic_load_n(&p->stats.peak, __ATOMIC_RELAXED);
+	stats->gets = __atomic_load_n(&p->stats.gets, __ATOMIC_RELAXED);
+	stats->puts = __atomic_load_n(&p->stats.puts, __ATOMIC_RELAXED);
+	stats->refs = __atomic_load_n(&p->stats.refs, __ATOMIC_RELAXED);
+	stats->empty = __atomic_load_n(&p->stats.empty, __ATOMIC_RELAXED);
+	stats->steals = __atomic_load_n(&p->stats.steals, __ATOMIC_RELAXED);
+}
+
+/*
+ *
+ */
+int plug417_pool_report(struct plug417_pool *p, const char *name, struct plug417_output *o)
+{
+	int passes = o->format == PLUG417_FORMAT_CSV ? 2 : 1;
+	struct plug417_pool_stats st;
+
+	plug417_pool_stats(p, &st);
+
+	for (o->pass = 0; o->pass < passes; o->pass++) {
+		plug417_out_begin(o, PLUG417_FUNCTIONAL_HOST, PLUG417_HOST_POOL, name);
+		plug417_out_field(o, "size", "Buffer size", st.size, NULL);
+		plug417_out_field(o, "count", "Buffers", st.count, NULL);
+		plug417_out_field(o, "in_use", "In use", st.in_use, NULL);
+		plug417_out_field(o, "peak", "Peak in use", st.peak, NULL);
+		plug417_out_field(o, "huge", "Huge pages", st.huge, st.huge ? "yes" : "no");
+		plug417_out_field(o, "gets", "Gets", st.gets, NULL);
+		plug417_out_field(o, "puts", "Puts", st.puts, NULL);
+		plug417_out_field(o, "refs", "Shared", st.refs, NULL);
+		plug417_out_field(o, "empty", "Empty", st.empty, NULL);
+		plug417_out_field(o, "steals", "Other CPU", st.steals, NULL);
+		plug417_out_end(o, PLUG417_FUNCTIONAL_HOST, PLUG417_HOST_POOL);
+	}
+	return o->overflow ? -1 : 0;
+}
@@ -0,0 +1,599 @@
+/*
+ * plug417 recording container, Y16 frames and control link events
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "plug417serial.h"
+#include "plug417trace.h"
+#include "plug417record.h"
+
+#define PAD8(n)		(((n) + 7) & ~(size_t)7)
+
+_Static_assert(sizeof(struct plug417_record_file_header) == 64, "record file header size");
+_Static_assert(sizeof(struct plug417_record_frame) % 8 == 0, "record frame size");
+_Static_assert(sizeof(struct plug417_record_index) % 8 == 0, "record index size");
+
+/*
+ * Whole buffer, short writes are continued
+ */
+static int plug417_record_write(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	ssize_t err;
+
+	while (len) {
+		err = write(fd, p, len);
+		if (err < 0)
+			return -1;
+		p += err;
+		len -= err;
+	}
+	return 0;
+}
+
+/*
+ * Writes spare, the batch swapped out by plug417_record_reserve(). Called
+ * with the flush lock held and without the lock, releases the flush lock.
+ */
+static int plug417_record_drain(struct plug417_record_writer *w)
+{
+	int err;
+
+	if (plug417_record_write(w->fd, w->spare, w->pending) < 0)
+		w->failed = 1;
+	w->pending = 0;
+	err = w->failed ? -1 : 0;
+
+	pthread_mutex_unlock(&w->flush_lock);
+	return err;
+}
+
+/*
+ * Writes the whole buffer, only once there are no other writers
+ */
+static int plug417_record_flush(struct plug417_record_writer *w)
+{
+	pthread_mutex_lock(&w->flush_lock);
+	if (plug417_record_write(w->fd, w->buf, w->len) < 0)
+		w->failed = 1;
+	pthread_mutex_unlock(&w->flush_lock);
+
+	w->offset += w->len;
+	w->len = 0;
+	return w->failed ? -1 : 0;
+}
+
+/*
+ * Room for one chunk, returns its file offset. When the buffer is full
+ * its aligned part is swapped out, the tail moves to the start of the
+ * other buffer and swapped is set: the flush lock is then held and the
+ * caller has to call plug417_record_drain() once it dropped the lock.
+ */
+static uint8_t *plug417_record_reserve(struct plug417_record_writer *w, uint32_t type,
+		size_t size, uint64_t timestamp, uint64_t *offset, int *swapped)
+{
+	struct plug417_record_chunk *c;
+	size_t total = sizeof(struct plug417_record_chunk) + PAD8(size);
+	uint8_t *full;
+	size_t n;
+
+	*swapped = 0;
+
+	/* Up to an alignment block may stay behind after a swap */
+	if (total > PLUG417_RECORD_BATCH - PLUG417_RECORD_ALIGN)
+		return NULL;
+
+	if (w->len + total > PLUG417_RECORD_BATCH) {
+		/* Waits for the previous batch, spare is free after it */
+		pthread_mutex_lock(&w->flush_lock);
+		n = w->len & ~(size_t)(PLUG417_RECORD_ALIGN - 1);
+		full = w->buf;
+		memcpy(w->spare, full + n, w->len - n);
+		w->buf = w->spare;
+		w->spare = full;
+		w->pending = n;
+		w->len -= n;
+		w->offset += n;
+		*swapped = 1;
+	}
+
+	c = (struct plug417_record_chunk *)(w->buf + w->len);
+	c->type = type;
+	c->size = size;
+	c->timestamp = timestamp;
+	memset((uint8_t *)(c + 1) + size, 0, PAD8(size) - size);
+
+	if (offset)
+		*offset = w->offset + w->len;
+	w->len += total;
+	return (uint8_t *)(c + 1);
+}
+
+/*
+ *
+ */
+struct plug417_record_writer *plug417_record_create(const char *path,
+		unsigned int width, unsigned int height)
+{
+	struct plug417_record_writer *w;
+	struct plug417_record_file_header *h;
+	struct timespec ts;
+
+	w = malloc(sizeof(struct plug417_record_writer));
+	if (!w)
+		return NULL;
+
+	memset(w, 0, sizeof(struct plug417_record_writer));
+	if (posix_memalign((void **)&w->buf, PLUG417_RECORD_ALIGN, PLUG417_RECORD_BATCH)) {
+		free(w);
+		return NULL;
+	}
+	if (posix_memalign((void **)&w->spare, PLUG417_RECORD_ALIGN, PLUG417_RECORD_BATCH)) {
+		free(w->buf);
+		free(w);
+		return NULL;
+	}
+
+	w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (w->fd < 0) {
+		free(w->spare);
+		free(w->buf);
+		free(w);
+		return NULL;
+	}
+
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_mutex_init(&w->flush_lock, NULL);
+	pthread_mutex_init(&w->codec_lock, NULL);
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	h = &w->header;
+	memcpy(h->magic, PLUG417_RECORD_FILE_MAGIC, sizeof(h->magic));
+	h->version = PLUG417_RECORD_FILE_VERSION;
+	h->byte_order = PLUG417_RECORD_FILE_BYTE_ORDER;
+	h->width = width;
+	h->height = height;
+	h->frame_size = width * height * sizeof(uint16_t);
+	h->created = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+	/* Rewritten with the counters and index offset when finished */
+	memcpy(w->buf, h, sizeof(struct plug417_record_file_header));
+	w->len = sizeof(struct plug417_record_file_header);
+	return w;
+}
+
+/*
+ * Following frames are stored compressed. Every frame is intra coded so
+ * any of them can still be read on its own.
+ */
+int plug417_record_compress(struct plug417_record_writer *w)
+{
+	int err = 0;
+
+	pthread_mutex_lock(&w->codec_lock);
+	if (!w->codec) {
+		w->encoded = malloc(plug417_codec_bound(w->header.width, w->header.height));
+		w->codec = plug417_codec_alloc(w->header.width, w->header.height, 1);
+		if (!w->encoded || !w->codec) {
+			if (w->codec)
+				plug417_codec_free(w->codec);
+			free(w->encoded);
+			w->codec = NULL;
+			w->encoded = NULL;
+			err = -1;
+		}
+	}
+	pthread_mutex_unlock(&w->codec_lock);
+	return err;
+}
+
+/*
+ * Y16 is stored without line padding, parameter line decoded
+ */
+int plug417_record_write_frame(struct plug417_record_writer *w,
+		const struct plug417_video_frame *f)
+{
+	struct plug417_record_frame *rf;
+	struct plug417_record_index *index;
+	uint64_t offset;
+	uint16_t *y16;
+	unsigned int y;
+	size_t size;
+	int n = -1, swapped = 0, err = -1;
+
+	if (!f->y16 || f->width != w->header.width || f->height != w->header.height)
+		return -1;
+
+	/* Compressed outside the lock, the codec has a lock of its own */
+	pthread_mutex_lock(&w->codec_lock);
+	if (w->codec) {
+		n = plug417_codec_encode(w->codec, f, w->encoded,
+				plug417_codec_bound(f->width, f->height));
+		if (n < 0) {
+			pthread_mutex_unlock(&w->codec_lock);
+			return -1;
+		}
+	} else {
+		pthread_mutex_unlock(&w->codec_lock);
+	}
+
+	pthread_mutex_lock(&w->lock);
+
+	if (w->header.frames == w->index_size) {
+		index = realloc(w->index, (w->index_size + 4096) * sizeof(*index));
+		if (!index)
+			goto out;
+		w->index = index;
+		w->index_size += 4096;
+	}
+
+	size = n >= 0 ? (size_t)n : w->header.frame_size;
+	rf = (struct plug417_record_frame *)plug417_record_reserve(w, PLUG417_RECORD_CHUNK_FRAME,
+			sizeof(struct plug417_record_frame) + size, f->timestamp, &offset, &swapped);
+	if (!rf)
+		goto out;
+
+	memset(rf, 0, sizeof(struct plug417_record_frame));
+	rf->sequence = f->sequence;
+	rf->timestamp = f->timestamp;
+	rf->param = f->info;
+
+	y16 = (uint16_t *)(rf + 1);
+	if (n >= 0) {
+		rf->flags = PLUG417_RECORD_FRAME_COMPRESSED;
+		memcpy(y16, w->encoded, n);
+	} else if (f->stride == f->width) {
+		memcpy(y16, f->y16, w->header.frame_size);
+	} else {
+		for (y = 0; y < f->height; y++)
+			memcpy(y16 + (size_t)y * f->width, f->y16 + (size_t)y * f->stride,
+					f->width * sizeof(uint16_t));
+	}
+
+	w->index[w->header.frames].offset = offset;
+	w->index[w->header.frames].timestamp = f->timestamp;
+	w->header.frames++;
+	err = 0;
+out:
+	pthread_mutex_unlock(&w->lock);
+	if (n >= 0)
+		pthread_mutex_unlock(&w->codec_lock);
+	if (swapped && plug417_record_drain(w) < 0)
+		err = -1;
+	return err;
+}
+
+/*
+ *
+ */
+int plug417_record_write_event(struct plug417_record_writer *w, int direction,
+		const void *buf, int len, uint64_t timestamp)
+{
+	struct plug417_record_event *ev;
+	int swapped = 0, err = -1;
+
+	if (len < 0 || len > UINT16_MAX)
+		return -1;
+
+	pthread_mutex_lock(&w->lock);
+
+	ev = (struct plug417_record_event *)plug417_record_reserve(w,
+			PLUG417_RECORD_CHUNK_EVENT, sizeof(struct plug417_record_event) + len,
+			timestamp, NULL, &swapped);
+	if (ev) {
+		ev->direction = direction;
+		ev->reserved = 0;
+		ev->len = len;
+		memcpy(ev->data, buf, len);
+		w->header.events++;
+		err = 0;
+	}
+
+	pthread_mutex_unlock(&w->lock);
+	if (swapped && plug417_record_drain(w) < 0)
+		err = -1;
+	return err;
+}
+
+/*
+ * Serial monitor, see plug417_serial_monitor(), arg is the writer
+ */
+void plug417_record_monitor(void *arg, int direction, const void *buf, int len)
+{
+	plug417_record_write_event(arg, direction, buf, len, plug417_clock_ns());
+}
+
+/*
+ * Appends the index, updates the header and frees the writer. The index
+ * goes straight to the file, it is not limited by the batch size.
+ */
+int plug417_record_finish(struct plug417_record_writer *w)
+{
+	size_t size = w->header.frames * sizeof(struct plug417_record_index);
+	struct plug417_record_chunk c;
+	uint64_t offset;
+	int err = -1;
+
+	/* Frames first, they stay readable if the index cannot be written */
+	if (plug417_record_flush(w) == 0 && size <= UINT32_MAX) {
+		memset(&c, 0, sizeof(c));
+		c.type = PLUG417_RECORD_CHUNK_INDEX;
+		c.size = size;
+		offset = w->offset;
+
+		/* Entries are 16 bytes, no padding */
+		if (plug417_record_write(w->fd, &c, sizeof(c)) == 0 &&
+				plug417_record_write(w->fd, w->index, size) == 0)
+			w->header.index_offset = offset;
+	}
+
+	/* Without index_offset readers rebuild the index from the chunks */
+	if (pwrite(w->fd, &w->header, sizeof(w->header), 0) == sizeof(w->header) &&
+			w->header.index_offset)
+		err = 0;
+
+	close(w->fd);
+	if (w->codec)
+		plug417_codec_free(w->codec);
+	pthread_mutex_destroy(&w->lock);
+	pthread_mutex_destroy(&w->flush_lock);
+	pthread_mutex_destroy(&w->codec_lock);
+	free(w->encoded);
+	free(w->index);
+	free(w->spare);
+	free(w->buf);
+	free(w);
+	return err;
+}
+
+/*
+ * Index of a recording that was not finished is rebuilt from the chunks
+ */
+static int plug417_record_rebuild(struct plug417_record *r)
+{
+	const struct plug417_record_chunk *c;
+	const struct plug417_record_frame *rf;
+	struct plug417_record_index *index;
+	uint64_t offset = sizeof(struct plug417_record_file_header), at;
+	size_t size = 0;
+
+	for (;;) {
+		at = offset;
+		c = plug417_record_chunk(r, &offset);
+		if (!c)
+			break;
+		if (c->type != PLUG417_RECORD_CHUNK_FRAME ||
+				c->size < sizeof(struct plug417_record_frame))
+			continue;
+
+		rf = (const struct plug417_record_frame *)(c + 1);
+		if (!(rf->flags & PLUG417_RECORD_FRAME_COMPRESSED) &&
+				c->size < sizeof(struct plug417_record_frame) + r->header->frame_size)
+			continue;
+
+		if (r->frames == size) {
+			index = realloc(r->rebuilt, (size + 4096) * sizeof(*index));
+			if (!index)
+				return -1;
+			r->rebuilt = index;
+			size += 4096;
+		}
+		r->rebuilt[r->frames].offset = at;
+		r->rebuilt[r->frames].timestamp = c->timestamp;
+		r->frames++;
+	}
+
+	r->index = r->rebuilt;
+	return 0;
+}
+
+/*
+ * Frame chunk at offset fits the file and holds a whole frame
+ */
+int plug417_record_valid(const struct plug417_record *r, uint64_t offset)
+{
+	const struct plug417_record_chunk *c;
+	const struct plug417_record_frame *rf;
+
+	if (offset < sizeof(struct plug417_record_file_header) || (offset & 7) ||
+			offset + sizeof(*c) + sizeof(*rf) > r->size)
+		return 0;
+
+	c = (const struct plug417_record_chunk *)(r->map + offset);
+	if (c->type != PLUG417_RECORD_CHUNK_FRAME || c->size < sizeof(*rf) ||
+			c->size > r->size - offset - sizeof(*c))
+		return 0;
+
+	rf = (const struct plug417_record_frame *)(c + 1);
+	if (!(rf->flags & PLUG417_RECORD_FRAME_COMPRESSED) &&
+			c->size < sizeof(*rf) + r->header->frame_size)
+		return 0;
+	return 1;
+}
+
+/*
+ *
+ */
+struct plug417_record *plug417_record_open(const char *path)
+{
+	const struct plug417_record_file_header *h;
+	const struct plug417_record_chunk *c;
+	struct plug417_record *r;
+	struct stat st;
+
+	r = malloc(sizeof(struct plug417_record));
+	if (!r)
+		return NULL;
+
+	memset(r, 0, sizeof(struct plug417_record));
+	r->fd = open(path, O_RDONLY);
+	if (r->fd < 0) {
+		free(r);
+		return NULL;
+	}
+
+	if (fstat(r->fd, &st) < 0 || st.st_size < sizeof(struct plug417_record_file_header))
+		goto err;
+
+	r->size = st.st_size;
+	r->map = mmap(NULL, r->size, PROT_READ, MAP_SHARED, r->fd, 0);
+	if (r->map == MAP_FAILED) {
+		r->map = NULL;
+		goto err;
+	}
+
+	h = r->header = (const struct plug417_record_file_header *)r->map;
+	if (memcmp(h->magic, PLUG417_RECORD_FILE_MAGIC, sizeof(h->magic)) ||
+			h->version != PLUG417_RECORD_FILE_VERSION ||
+			h->byte_order != PLUG417_RECORD_FILE_BYTE_ORDER)
+		goto err;
+
+	if (h->index_offset && !(h->index_offset & 7) &&
+			h->index_offset + sizeof(*c) <= r->size) {
+		c = (const struct plug417_record_chunk *)(r->map + h->index_offset);
+		if (c->type == PLUG417_RECORD_CHUNK_INDEX &&
+				c->size == h->frames * sizeof(struct plug417_record_index) &&
+				h->index_offset + sizeof(*c) + c->size <= r->size) {
+			r->index = (const struct plug417_record_index *)(c + 1);
+			r->frames = h->frames;
+		}
+	}
+
+	if (!r->index && plug417_record_rebuild(r) < 0)
+		goto err;
+
+	return r;
+err:
+	plug417_record_close(r);
+	return NULL;
+}
+
+/*
+ *
+ */
+void plug417_record_close(struct plug417_record *r)
+{
+	if (r->map)
+		munmap(r->map, r->size);
+	close(r->fd);
+	if (r->codec)
+		plug417_codec_free(r->codec);
+	free(r->decoded);
+	free(r->rebuilt);
+	free(r);
+}
+
+/*
+ * Decoded into the reader buffer, valid until the next frame is read
+ */
+static uint16_t *plug417_record_decode(struct plug417_record *r,
+		const struct plug417_record_chunk *c)
+{
+	const struct plug417_record_frame *rf = (const struct plug417_record_frame *)(c + 1);
+
+	if (!r->codec) {
+		r->codec = plug417_codec_alloc(r->header->width, r->header->height, 1);
+		r->decoded = malloc(r->header->frame_size);
+		if (!r->codec || !r->decoded)
+			return NULL;
+	}
+
+	if (plug417_codec_decode(r->codec, (const uint8_t *)(rf + 1),
+			c->size - sizeof(struct plug417_record_frame), r->decoded) < 0)
+		return NULL;
+	return r->decoded;
+}
+
+/*
+ * Frame chunk at file offset, e.g. from plug417_record_chunk(). -1 when
+ * there is no whole frame there. Uncompressed frames point into the
+ * mapping and must not be written to.
+ */
+int plug417_record_frame_at(struct plug417_record *r, uint64_t offset,
+		struct plug417_video_frame *f)
+{
+	const struct plug417_record_chunk *c;
+	const struct plug417_record_frame *rf;
+	uint16_t *y16;
+
+	if (!plug417_record_valid(r, offset))
+		return -1;
+
+	c = (const struct plug417_record_chunk *)(r->map + offset);
+	rf = (const struct plug417_record_frame *)(c + 1);
+
+	if (rf->flags & PLUG417_RECORD_FRAME_COMPRESSED) {
+		y16 = plug417_record_decode(r, c);
+		if (!y16)
+			return -1;
+	} else {
+		y16 = (uint16_t *)(rf + 1);
+	}
+
+	memset(f, 0, sizeof(struct plug417_video_frame));
+	f->y16 = y16;
+	f->width = r->header->width;
+	f->height = r->header->height;
+	f->stride = f->width;
+	f->sequence = rf->sequence;
+	f->timestamp = rf->timestamp;
+	f->index = -1;
+	f->info = rf->param;
+	return 0;
+}
+
+/*
+ * Entries are checked when read, opening stays O(1)
+ */
+int plug417_record_frame(struct plug417_record *r, uint64_t n,
+		struct plug417_video_frame *f)
+{
+	if (n >= r->frames)
+		return -1;
+	return plug417_record_frame_at(r, r->index[n].offset, f);
+}
+
+/*
+ * First frame at or after timestamp, frames when there is none
+ */
+uint64_t plug417_record_seek(const struct plug417_record *r, uint64_t timestamp)
+{
+	uint64_t lo = 0, hi = r->frames, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (r->index[mid].timestamp < timestamp)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+ * Chunk at offset, offset moves to the next one. Start at
+ * sizeof(struct plug417_record_file_header), NULL at the end.
+ */
+const struct plug417_record_chunk *plug417_record_chunk(const struct plug417_record *r,
+		uint64_t *offset)
+{
+	const struct plug417_record_chunk *c;
+
+	if (*offset + sizeof(*c) > r->size)
+		return NULL;
+
+	c = (const struct plug417_record_chunk *)(r->map + *offset);
+	if (*offset + sizeof(*c) + PAD8(c->size) > r->size)
+		return NULL;
+
+	*offset += sizeof(*c) + PAD8(c->size);
+	return c;
+}
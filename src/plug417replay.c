@@ -0,0 +1,242 @@
+/*
+ * plug417 replay of recorded sessions and serial captures
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "plug417trace.h"
+#include "plug417replay.h"
+
+/*
+ * Replay without a recording only feeds serial captures
+ */
+struct plug417_replay *plug417_replay_open(const char *path)
+{
+	struct plug417_replay *r;
+
+	r = malloc(sizeof(struct plug417_replay));
+	if (!r)
+		return NULL;
+
+	memset(r, 0, sizeof(struct plug417_replay));
+	r->recv.name = "recv";
+
+	if (path) {
+		r->record = plug417_record_open(path);
+		if (!r->record) {
+			free(r);
+			return NULL;
+		}
+	}
+	return r;
+}
+
+/*
+ *
+ */
+void plug417_replay_close(struct plug417_replay *r)
+{
+	if (r->record)
+		plug417_record_close(r->record);
+	free(r);
+}
+
+/*
+ * Stages see every frame in the order they were added
+ */
+int plug417_replay_stage(struct plug417_replay *r, const char *name,
+		plug417_replay_process process, void *arg)
+{
+	struct plug417_replay_stage *st;
+
+	if (r->count == PLUG417_REPLAY_STAGES_MAX)
+		return -1;
+
+	st = &r->stages[r->count++];
+	memset(st, 0, sizeof(struct plug417_replay_stage));
+	st->name = name;
+	st->process = process;
+	st->arg = arg;
+	return 0;
+}
+
+/*
+ * Received serial frames are fed to plug417_recv() of s
+ */
+void plug417_replay_serial(struct plug417_replay *r, struct plug417_serial *s)
+{
+	r->serial = s;
+}
+
+/*
+ *
+ */
+static int plug417_replay_recv(struct plug417_replay *r, const void *buf, int len)
+{
+	const uint8_t *p = buf;
+	uint64_t start = plug417_clock_ns();
+	int i;
+
+	/* plug417_recv() drops what follows a complete frame, feed bytewise */
+	for (i = 0; i < len; i++) {
+		if (plug417_recv(r->serial, p + i, 1) > 0)
+			r->recv.frames++;
+	}
+
+	r->recv.ns += plug417_clock_ns() - start;
+	return 0;
+}
+
+/*
+ * Sleep until the recording time of ts, scaled by speed
+ */
+static void plug417_replay_pace(uint64_t start, uint64_t t0, uint64_t ts, double speed)
+{
+	struct timespec deadline;
+	uint64_t at;
+
+	if (speed <= 0.0 || ts <= t0)
+		return;
+
+	at = start + (uint64_t)((ts - t0) / speed);
+	deadline.tv_sec = at / 1000000000ULL;
+	deadline.tv_nsec = at % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+		;
+}
+
+/*
+ * Frames and serial events go out in recording order, so runs are
+ * repeatable whatever the speed
+ */
+int plug417_replay_run(struct plug417_replay *r, double speed)
+{
+	const struct plug417_record_chunk *c;
+	const struct plug417_record_event *ev;
+	struct plug417_video_frame f;
+	struct plug417_replay_stage *st;
+	uint64_t offset = sizeof(struct plug417_record_file_header), at;
+	uint64_t start, t0 = 0, t;
+	unsigned int i;
+
+	if (!r->record)
+		return -1;
+
+	start = plug417_clock_ns();
+
+	for (;;) {
+		at = offset;
+		c = plug417_record_chunk(r->record, &offset);
+		if (!c)
+			break;
+		if (c->type != PLUG417_RECORD_CHUNK_FRAME && c->type != PLUG417_RECORD_CHUNK_EVENT)
+			continue;
+
+		if (!t0)
+			t0 = c->timestamp;
+		plug417_replay_pace(start, t0, c->timestamp, speed);
+
+		if (c->type == PLUG417_RECORD_CHUNK_EVENT) {
+			/* Damaged events are skipped, data must lie in the chunk */
+			ev = (const struct plug417_record_event *)(c + 1);
+			if (c->size < sizeof(*ev) || sizeof(*ev) + ev->len > c->size)
+				continue;
+			r->events++;
+			if (r->serial && ev->direction == PLUG417_MONITOR_RX)
+				plug417_replay_recv(r, ev->data, ev->len);
+			continue;
+		}
+
+		/* Decoded from this chunk, short ones are skipped like the rebuild does */
+		if (!plug417_record_valid(r->record, at))
+			continue;
+		if (plug417_record_frame_at(r->record, at, &f) < 0)
+			return -1;
+		r->frames++;
+
+		for (i = 0; i < r->count; i++) {
+			st = &r->stages[i];
+			t = plug417_clock_ns();
+			if (st->process(st->arg, &f) < 0)
+				return -1;
+			st->ns += plug417_clock_ns() - t;
+			st->frames++;
+		}
+	}
+
+	r->elapsed += plug417_clock_ns() - start;
+	return 0;
+}
+
+/*
+ * Raw bytes as read from the serial port, fed as fast as possible
+ */
+int plug417_replay_capture(struct plug417_replay *r, const char *path)
+{
+	uint8_t buf[4096];
+	uint64_t start;
+	int fd, n;
+
+	if (!r->serial)
+		return -1;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	start = plug417_clock_ns();
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		r->events++;
+		plug417_replay_recv(r, buf, n);
+	}
+	r->elapsed += plug417_clock_ns() - start;
+
+	close(fd);
+	return n < 0 ? -1 : 0;
+}
+
+/*
+ *
+ */
+static void plug417_replay_stage_format(const struct plug417_replay_stage *st,
+		unsigned int n, struct plug417_output *o)
+{
+	plug417_out_begin(o, PLUG417_FUNCTIONAL_HOST, PLUG417_HOST_REPLAY_STAGE, st->name);
+	plug417_out_field(o, "stage", "Stage", n, NULL);
+	plug417_out_field(o, "frames", "Frames", st->frames, NULL);
+	plug417_out_field(o, "total_us", "Total us", st->ns / 1000, NULL);
+	plug417_out_fixed(o, "frame_us", "Per frame us",
+			st->frames ? st->ns * 100 / st->frames / 1000 : 0, 0.01);
+	plug417_out_fixed(o, "fps", "Frames per second",
+			st->ns ? st->frames * 100000000000ULL / st->ns : 0, 0.01);
+	plug417_out_end(o, PLUG417_FUNCTIONAL_HOST, PLUG417_HOST_REPLAY_STAGE);
+}
+
+/*
+ * One record per stage, serial receive path last
+ */
+int plug417_replay_report(struct plug417_replay *r, struct plug417_output *o)
+{
+	int passes = o->format == PLUG417_FORMAT_CSV ? 2 : 1;
+	unsigned int i;
+
+	plug417_out_text(o, "Replayed %llu frames, %llu serial events in %.3f s\n",
+			(unsigned long long)r->frames, (unsigned long long)r->events,
+			r->elapsed / 1e9);
+
+	for (o->pass = 0; o->pass < passes; o->pass++) {
+		for (i = 0; i <= r->count; i++) {
+			/* CSV header once */
+			if (o->pass == 0 && passes == 2 && i)
+				break;
+			plug417_replay_stage_format(i < r->count ? &r->stages[i] : &r->recv,
+					i, o);
+		}
+	}
+	return o->overflow ? -1 : 0;
+}
@@ -0,0 +1,607 @@
+/*
+ * plug417 page schema tables and generic decode engine
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <endian.h>
+
+#include "plug417serial.h"
+#include "plug417format.h"
+#include "plug417schema.h"
+
+static const char *plug417_pseudo_color[] = {
+	"White hot",
+	"Fulgurite",
+	"Iron Red",
+	"Hot Iron",
+	"Medical",
+	"Arctic",
+	"Rainbow 1",
+	"Rainbow 2",
+	"Tint",
+	"Black hot",
+};
+
+static const char *plug417_frame_rate[] = {
+	"50/60 Hz",
+	"25/30 Hz",
+	"9 Hz",
+};
+
+static const char *plug417_video_system[] = {
+	"384x288",
+	"320x240",
+	"360x288",
+	"360x240",
+};
+
+static const char *plug417_mirror[] = {
+	"No",
+	"in X direction",
+	"in Y direction",
+	"in X and Y direction",
+};
+
+static const char *plug417_digital_port[] ={
+	"OFF",
+	"BT.656",
+	"CMOS",
+};
+
+static const char *plug417_digital_format[] ={
+	"YUV422",
+	"YUV422 parameter line",
+	"YUV16",
+	"YUV16 parameter line",
+	"Y16 YUV422",
+	"Y16 parameter line YUV422",
+};
+
+static const char *plug417_digital_interface[] = {
+	"CMOS16",
+	"CMOS8 MSB",
+	"CMOS8 LSB",
+};
+
+static const char *plug417_alorithm_dimming_mode[] ={
+	"Linear",
+	"Platform",
+	"Hybrid",
+};
+
+static const char *plug417_alorithm_ide_log[] = {
+	"IDE",
+	"LOG"
+};
+
+static const char *plug417_temperature_mode[] = {
+	"Minimum + maximum temperature of current analysis object",
+	"Cross cursor spot+ maximum temperature",
+	"minimum + Cross cursor spot temperature",
+};
+
+static const char *plug417_temperature_unit[] = {
+	"°C",
+	"°F",
+	"°K",
+};
+
+static const char *plug417_analisys_area[] = {
+	"Disable",
+	"Full screen",
+	"Area 1",
+	"Area 2",
+	"Area 3",
+};
+
+
+
+static const char *plug417_module_type[] = {
+	"Observation type",
+	"Thermography type",
+};
+
+static const char *plug417_video_resolution[] = {
+	"400x300",
+	"384x288",
+	"360x288",
+	"320x240",
+	"360x240",
+	"160x120",
+};
+
+#define PLUG417_QUERY_BASE	offsetof(struct plug417_query, option)
+
+#define PLUG417_PAYLOAD_SIZE	PLUG417_MEMBER_SIZE(plug417_frame, raw)
+
+_Static_assert(sizeof(struct plug417_status) <= PLUG417_PAYLOAD_SIZE,
+		"status page exceeds frame payload");
+_Static_assert(PLUG417_QUERY_BASE + sizeof(struct plug417_area_analysis_page) <=
+		PLUG417_PAYLOAD_SIZE, "area analysis page exceeds frame payload");
+
+static const struct plug417_field plug417_status_fields[] = {
+	PLUG417_FIELD(plug417_status, module_id, "module_id", "ID number of module",
+			.max = PLUG417_THERMOGRAPHY_TYPE, .labels = plug417_module_type),
+	PLUG417_FIELD(plug417_status, year, "year", "Program version year"),
+	PLUG417_FIELD(plug417_status, month, "month", "Program version month"),
+	PLUG417_FIELD(plug417_status, day, "day", "Program version day"),
+	PLUG417_FIELD(plug417_status, focal_spot_temperature, "focal_spot_temperature",
+			"Focal spot temperature", .scale = 0.01),
+	PLUG417_FIELD(plug417_status, video_system, "video_system", "Video system"),
+	PLUG417_FIELD(plug417_status, video_resolution, "video_resolution",
+			"Video resolution", .max = PLUG417_VIDEO_160_120,
+			.labels = plug417_video_resolution),
+	PLUG417_FIELD(plug417_status, machine_id, "machine_id",
+			"Machine identification code", .flags = PLUG417_FIELD_HEX),
+};
+
+static const struct plug417_field plug417_analog_video_fields[] = {
+	PLUG417_FIELD(plug417_analog_video_page, on, "on", "Analog video",
+			.flags = PLUG417_FIELD_ON_OFF),
+	PLUG417_FIELD(plug417_analog_video_page, video_system, "video_system",
+			"Video system", .max = PLUG417_ANALOG_VIDEO_SYSTEM_MAX,
+			.labels = plug417_video_system),
+	PLUG417_FIELD(plug417_analog_video_page, frame_rate, "frame_rate",
+			"Frame rate", .max = PLUG417_ANALOG_FRAME_RATE_MAX,
+			.labels = plug417_frame_rate),
+	PLUG417_FIELD(plug417_analog_video_page, pseudo_color, "pseudo_color",
+			"Pseudo collor", .max = PLUG417_COMMAND_COLOR_MAX,
+			.labels = plug417_pseudo_color),
+	PLUG417_FIELD(plug417_analog_video_page, mirror, "mirror",
+			"Mirror image", .max = PLUG417_ANALOG_MIRROR_MAX,
+			.labels = plug417_mirror),
+	PLUG417_FIELD(plug417_analog_video_page, ezoom, "ezoom", "EZOOM zoom factor"),
+	PLUG417_FIELD(plug417_analog_video_page, zoom_x, "zoom_x",
+			"Coordinate X the center of zoomed area"),
+	PLUG417_FIELD(plug417_analog_video_page, zoom_y, "zoom_y",
+			"Coordinate Y the center of zoomed area"),
+	PLUG417_FIELD(plug417_analog_video_page, hotspot_track, "hotspot_track",
+			"Hotspot track", .flags = PLUG417_FIELD_ON_OFF),
+};
+
+static const struct plug417_field plug417_digital_video_fields[] = {
+	PLUG417_FIELD(plug417_digital_video_page, external_sync, "external_sync",
+			"External synchronization", .flags = PLUG417_FIELD_ON_OFF),
+	PLUG417_FIELD(plug417_digital_video_page, port, "port", "Digital port",
+			.max = PLUG417_DIGITAL_PORT_MAX, .labels = plug417_digital_port),
+	PLUG417_FIELD(plug417_digital_video_page, format, "format", "Output contents",
+			.max = PLUG417_DIGITAL_FORMAT_MAX, .labels = plug417_digital_format),
+	PLUG417_FIELD(plug417_digital_video_page, interface, "interface",
+			"Interface type", .max = PLUG417_DIGITAL_INTERFACE_MAX,
+			.labels = plug417_digital_interface),
+	PLUG417_FIELD(plug417_digital_video_page, frame_rate, "frame_rate",
+			"Frame rate", .max = PLUG417_DIGITAL_FRAME_RATE_MAX,
+			.labels = plug417_frame_rate),
+	PLUG417_FIELD(plug417_digital_video_page, mipi, "mipi", "MIPI",
+			.flags = PLUG417_FIELD_ON_OFF),
+};
+
+static const struct plug417_field plug417_algorithm_control_1_fields[] = {
+	PLUG417_FIELD(plug417_alorithm_control_page_1, time_domain_filering,
+			"time_domain_filtering", "Time-domain filtering",
+			.flags = PLUG417_FIELD_ON_OFF),
+	PLUG417_FIELD(plug417_alorithm_control_page_1, filtering_strength,
+			"filtering_strength", "Filtering strength"),
+	PLUG417_FIELD(plug417_alorithm_control_page_1, vertical_strip_removal,
+			"vertical_strip_removal", "Vertical strip removal",
+			.flags = PLUG417_FIELD_ON_OFF),
+	PLUG417_FIELD(plug417_alorithm_control_page_1, vertical_strip_strength,
+			"vertical_strip_strength", "Vertical strip strength"),
+	PLUG417_FIELD(plug417_alorithm_control_page_1, sharpening,
+			"sharpening", "Sharpening", .flags = PLUG417_FIELD_ON_OFF),
+	PLUG417_FIELD(plug417_alorithm_control_page_1, sharpening_strength,
+			"sharpening_strength", "Sharpening strength"),
+	PLUG417_FIELD(plug417_alorithm_control_page_1, dimming_mode,
+			"dimming_mode", "Dimming mode",
+			.max = PLUG417_ALGORITHM_DIMMING_MODE_MAX,
+			.labels = plug417_alorithm_dimming_mode),
+	PLUG417_FIELD(plug417_alorithm_control_page_1, proportion_upper_throwing_point,
+			"proportion_upper_throwing_point",
+			"Proportion of upper throwing point"),
+	PLUG417_FIELD(plug417_alorithm_control_page_1, proportion_lower_throwing_point,
+			"proportion_lower_throwing_point",
+			"Proportion of lower throwing point"),
+	PLUG417_FIELD(plug417_alorithm_control_page_1, brightness,
+			"brightness", "Brightness"),
+	PLUG417_FIELD(plug417_alorithm_control_page_1, contrast,
+			"contrast", "Contrast"),
+	PLUG417_FIELD(plug417_alorithm_control_page_1, hybrid_dimming_mapping,
+			"hybrid_dimming_mapping", "Hybrid dimming mapping"),
+};
+
+static const struct plug417_field plug417_algorithm_control_2_fields[] = {
+	PLUG417_FIELD(plug417_alorithm_control_page_2, y8_correction,
+			"y8_correction", "Y8 correction", .flags = PLUG417_FIELD_ON_OFF),
+	PLUG417_FIELD(plug417_alorithm_control_page_2, ide_log,
+			"ide_log", "IDE/LOG", .max = 1, .labels = plug417_alorithm_ide_log),
+	PLUG417_FIELD(plug417_alorithm_control_page_2, ide_enhancement,
+			"ide_enhancement", "IDE enhancement", .flags = PLUG417_FIELD_ON_OFF),
+	PLUG417_FIELD(plug417_alorithm_control_page_2, ide_filtering_level,
+			"ide_filtering_level", "IDE filtering level"),
+	PLUG417_FIELD(plug417_alorithm_control_page_2, ide_detail_gain,
+			"ide_detail_gain", "IDE detail gain"),
+	PLUG417_FIELD(plug417_alorithm_control_page_2, log_enhancement,
+			"log_enhancement", "LOG enhancement", .flags = PLUG417_FIELD_ON_OFF),
+};
+
+#define PLUG417_ICON_FIELDS(i)							\
+	PLUG417_FIELD(plug417_menu_function_page_1, small_icon[i].display,	\
+			"icon" #i "_display", "Icon " #i " display",		\
+			.flags = PLUG417_FIELD_ON_OFF),				\
+	PLUG417_FIELD(plug417_menu_function_page_1, small_icon[i].width,	\
+			"icon" #i "_width", "Icon " #i " width"),		\
+	PLUG417_FIELD(plug417_menu_function_page_1, small_icon[i].x,		\
+			"icon" #i "_x", "Icon " #i " location setting X"),	\
+	PLUG417_FIELD(plug417_menu_function_page_1, small_icon[i].y,		\
+			"icon" #i "_y", "Icon " #i " location setting Y")
+
+static const struct plug417_field plug417_menu_function_1_fields[] = {
+	PLUG417_ICON_FIELDS(0),
+	PLUG417_ICON_FIELDS(1),
+	PLUG417_FIELD(plug417_menu_function_page_1, small_icon_transparency,
+			"small_icon_transparency", "Small icon transparency setting"),
+};
+
+static const struct plug417_field plug417_menu_function_2_fields[] = {
+	PLUG417_FIELD(plug417_menu_function_page_2, menu_bar_display,
+			"menu_bar_display", "Menu bar display",
+			.flags = PLUG417_FIELD_ON_OFF),
+	PLUG417_FIELD(plug417_menu_function_page_2, menu_bar_location,
+			"menu_bar_location", "Menu bar location setting"),
+	PLUG417_FIELD(plug417_menu_function_page_2, menu_bar_transparency_level,
+			"menu_bar_transparency_level", "Menu bar transparency level"),
+	PLUG417_FIELD(plug417_menu_function_page_2, layer_display,
+			"layer_display", "Layer display", .flags = PLUG417_FIELD_ON_OFF),
+	PLUG417_FIELD(plug417_menu_function_page_2, layer_transparency,
+			"layer_transparency", "Layer transparency setting"),
+	PLUG417_FIELD(plug417_menu_function_page_2, half_pixel_cursor,
+			"half_pixel_cursor", "Half pixel cursor",
+			.flags = PLUG417_FIELD_ON_OFF),
+	PLUG417_FIELD(plug417_menu_function_page_2, half_pixel_cursor_lacation_x,
+			"half_pixel_cursor_x", "Half pixel cursor location setting X"),
+	PLUG417_FIELD(plug417_menu_function_page_2, half_pixel_cursor_lacation_y,
+			"half_pixel_cursor_y", "Half pixel cursor location setting Y"),
+	PLUG417_FIELD(plug417_menu_function_page_2, half_pixel_color_label.v8[0],
+			"half_pixel_color_r", "Half pixel color label R"),
+	PLUG417_FIELD(plug417_menu_function_page_2, half_pixel_color_label.v8[1],
+			"half_pixel_color_g", "Half pixel color label G"),
+	PLUG417_FIELD(plug417_menu_function_page_2, half_pixel_color_label.v8[2],
+			"half_pixel_color_b", "Half pixel color label B"),
+};
+
+static const struct plug417_field plug417_area_analysis_fields[] = {
+	PLUG417_FIELD(plug417_area_analysis_page, analysis, "analysis", "Analysis",
+			.max = 4, .labels = plug417_analisys_area),
+	PLUG417_FIELD(plug417_area_analysis_page, x, "x", "Starting coordinate X"),
+	PLUG417_FIELD(plug417_area_analysis_page, y, "y", "Starting coordinate Y"),
+	PLUG417_FIELD(plug417_area_analysis_page, width, "width", "Area width"),
+	PLUG417_FIELD(plug417_area_analysis_page, height, "height", "Area height"),
+	PLUG417_FIELD(plug417_area_analysis_page, r, "r", "Color Component R"),
+	PLUG417_FIELD(plug417_area_analysis_page, g, "g", "Color Component G"),
+	PLUG417_FIELD(plug417_area_analysis_page, b, "b", "Color Component B"),
+	PLUG417_FIELD(plug417_area_analysis_page, high_temperature_alarm,
+			"high_temperature_alarm", "High temperature alarm",
+			.flags = PLUG417_FIELD_ON_OFF),
+	PLUG417_FIELD(plug417_area_analysis_page, high_temperature_alarm_threshold,
+			"high_temperature_alarm_threshold",
+			"High temperature alarm threshold"),
+	PLUG417_FIELD(plug417_area_analysis_page, temperature_exceeds_alarm_threshold,
+			"temperature_exceeds_alarm_threshold",
+			"Temperature exceeds alarm threshold",
+			.flags = PLUG417_FIELD_ON_OFF),
+	PLUG417_FIELD(plug417_area_analysis_page, coldest_x,
+			"coldest_x", "Coldest point X coordinate"),
+	PLUG417_FIELD(plug417_area_analysis_page, coldest_y,
+			"coldest_y", "Coldest point Y coordinate"),
+	PLUG417_FIELD(plug417_area_analysis_page, coldest_temperature_y16,
+			"coldest_temperature_y16",
+			"Coldest point temperature measurement / observation Y16"),
+	PLUG417_FIELD(plug417_area_analysis_page, hottest_x,
+			"hottest_x", "Hottest X coordinate"),
+	PLUG417_FIELD(plug417_area_analysis_page, hottest_y,
+			"hottest_y", "Hottest Y coordinate"),
+	PLUG417_FIELD(plug417_area_analysis_page, hottest_temperature_y16,
+			"hottest_temperature_y16",
+			"Hottest temperature measurement / observation Y16"),
+	PLUG417_FIELD(plug417_area_analysis_page, cursor_x,
+			"cursor_x", "Cursor X coordinate"),
+	PLUG417_FIELD(plug417_area_analysis_page, cursor_y,
+			"cursor_y", "Cursor Y coordinate"),
+	PLUG417_FIELD(plug417_area_analysis_page, cursor_temperature_y16,
+			"cursor_temperature_y16",
+			"Cursor temperature measurement / observation Y16"),
+	PLUG417_FIELD(plug417_area_analysis_page, regional_temperature_y16,
+			"regional_temperature_y16",
+			"Regional average temperature measurement / observation Y16"),
+};
+
+static const struct plug417_field plug417_hotspot_tracking_fields[] = {
+	PLUG417_FIELD(plug417_hotspot_tracking_page, cursor, "hottest_cursor",
+			"Hottest cursor", .mask = 1, .flags = PLUG417_FIELD_ON_OFF),
+	PLUG417_FIELD(plug417_hotspot_tracking_page, cursor, "coldest_cursor",
+			"Coldest cursor", .mask = 2, .flags = PLUG417_FIELD_ON_OFF),
+	PLUG417_FIELD(plug417_hotspot_tracking_page, upper_limit, "upper_limit",
+			"Hotspot tracking upper limit"),
+	PLUG417_FIELD(plug417_hotspot_tracking_page, lower_limit, "lower_limit",
+			"Hotspot tracking lower limit"),
+	PLUG417_FIELD(plug417_hotspot_tracking_page, r, "r",
+			"Hottest cursor color component R"),
+	PLUG417_FIELD(plug417_hotspot_tracking_page, g, "g",
+			"Hottest cursor color component G"),
+	PLUG417_FIELD(plug417_hotspot_tracking_page, b, "b",
+			"Hottest cursor color component B"),
+};
+
+static const struct plug417_field plug417_measurement_1_fields[] = {
+	PLUG417_FIELD(plug417_measurement_page_1, distance, "distance",
+			"The value of distance setting"),
+	PLUG417_FIELD(plug417_measurement_page_1, emissivity, "emissivity",
+			"The value of emissivity setting"),
+	PLUG417_FIELD(plug417_measurement_page_1, temperature_mode,
+			"temperature_mode", "Temperature mode",
+			.max = 2, .labels = plug417_temperature_mode),
+	PLUG417_FIELD(plug417_measurement_page_1, temperature_unit,
+			"temperature_unit", "Temperature unit",
+			.max = 2, .labels = plug417_temperature_unit),
+	PLUG417_FIELD(plug417_measurement_page_1, min_x, "min_x",
+			"Min Corresponding Coordinate X"),
+	PLUG417_FIELD(plug417_measurement_page_1, min_y, "min_y",
+			"Min Corresponding Coordinate Y"),
+	PLUG417_FIELD(plug417_measurement_page_1, min_temperature_calibrated,
+			"min_temperature_calibrated",
+			"Min Corresponding temperature after calibration",
+			.flags = PLUG417_FIELD_SIGNED),
+	PLUG417_FIELD(plug417_measurement_page_1, max_x, "max_x",
+			"Max Corresponding Coordinate X"),
+	PLUG417_FIELD(plug417_measurement_page_1, max_y, "max_y",
+			"Max Corresponding Coordinate Y"),
+	PLUG417_FIELD(plug417_measurement_page_1, max_temperature_calibrated,
+			"max_temperature_calibrated",
+			"Max Corresponding temperature after calibration",
+			.flags = PLUG417_FIELD_SIGNED),
+	PLUG417_FIELD(plug417_measurement_page_1, temperature_reflected,
+			"temperature_reflected", "Reflected temp",
+			.flags = PLUG417_FIELD_SIGNED),
+	PLUG417_FIELD(plug417_measurement_page_1, humidity, "humidity",
+			"Humidity value"),
+	PLUG417_FIELD(plug417_measurement_page_1, temperature_range,
+			"temperature_range", "Temperature measurement range"),
+};
+
+static const struct plug417_page_schema plug417_schema[] = {
+	PLUG417_PAGE_SCHEMA(PLUG417_STATUS_PAGE, 0, plug417_status, 0,
+			"PLUG417 status", plug417_status_fields),
+	PLUG417_PAGE_SCHEMA(PLUG417_VIDEO_PAGE, PLUG417_ANALOG_VIDEO_PAGE,
+			plug417_analog_video_page, PLUG417_QUERY_BASE,
+			"Analog video page", plug417_analog_video_fields),
+	PLUG417_PAGE_SCHEMA(PLUG417_VIDEO_PAGE, PLUG417_DIGITAL_VIDEO_PAGE,
+			plug417_digital_video_page, PLUG417_QUERY_BASE,
+			"Digital video page", plug417_digital_video_fields),
+	PLUG417_PAGE_SCHEMA(PLUG417_VIDEO_PAGE, PLUG417_ALGORITHM_SETTING_PAGE,
+			plug417_alorithm_control_page_1, PLUG417_QUERY_BASE,
+			"Algorithm control page 1", plug417_algorithm_control_1_fields),
+	PLUG417_PAGE_SCHEMA(PLUG417_VIDEO_PAGE, PLUG417_ALGORITHM_CONTROL_PAGE_2,
+			plug417_alorithm_control_page_2, PLUG417_QUERY_BASE,
+			"Algorithm control page 2", plug417_algorithm_control_2_fields),
+	PLUG417_PAGE_SCHEMA(PLUG417_APPLICATION_PAGE, PLUG417_MENU_PAGE_1,
+			plug417_menu_function_page_1, PLUG417_QUERY_BASE,
+			"Menu function page 1", plug417_menu_function_1_fields),
+	PLUG417_PAGE_SCHEMA(PLUG417_APPLICATION_PAGE, PLUG417_MENU_PAGE_2,
+			plug417_menu_function_page_2, PLUG417_QUERY_BASE,
+			"Menu function page 2", plug417_menu_function_2_fields),
+	PLUG417_PAGE_SCHEMA(PLUG417_APPLICATION_PAGE, PLUG417_AREA_ANALYSIS_PAGE,
+			plug417_area_analysis_page, PLUG417_QUERY_BASE,
+			"Area analysis page", plug417_area_analysis_fields),
+	PLUG417_PAGE_SCHEMA(PLUG417_APPLICATION_PAGE, PLUG417_HOTSPOT_TRACKING_PAGE,
+			plug417_hotspot_tracking_page, PLUG417_QUERY_BASE,
+			"Hotspot tracking page", plug417_hotspot_tracking_fields),
+	PLUG417_PAGE_SCHEMA(PLUG417_TEMPERATURE_MEASUREMENT_PAGE,
+			PLUG417_PARAMETER_SETTING_PAGE,
+			plug417_measurement_page_1, PLUG417_QUERY_BASE,
+			"Temperature measurement page 1", plug417_measurement_1_fields),
+};
+
+#define PLUG417_SCHEMA_COUNT	(sizeof(plug417_schema) / sizeof(plug417_schema[0]))
+
+/*
+ *
+ */
+const struct plug417_page_schema *plug417_schema_find(unsigned int functional,
+		unsigned int page)
+{
+	int i;
+
+	for (i = 0; i < PLUG417_SCHEMA_COUNT; i++) {
+		if (plug417_schema[i].functional == functional &&
+				plug417_schema[i].page == page)
+			return &plug417_schema[i];
+	}
+	return NULL;
+}
+
+/*
+ * Validate every table against its structure and the frame payload
+ */
+int plug417_schema_check(void)
+{
+	const struct plug417_page_schema *ps;
+	const struct plug417_field *fl;
+	int i, n;
+
+	for (i = 0; i < PLUG417_SCHEMA_COUNT; i++) {
+		ps = &plug417_schema[i];
+		if (ps->count > PLUG417_SCHEMA_FIELDS_MAX ||
+				ps->base + ps->size > PLUG417_PAYLOAD_SIZE)
+			return -1;
+
+		for (n = 0; n < ps->count; n++) {
+			fl = &ps->fields[n];
+			if (fl->width != 1 && fl->width != 2 && fl->width != 4)
+				return -1;
+			if (fl->offset + fl->width > ps->size)
+				return -1;
+			if (fl->labels && fl->flags & PLUG417_FIELD_ON_OFF)
+				return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ *
+ */
+int plug417_schema_field_index(const struct plug417_page_schema *ps,
+		const char *name)
+{
+	int i;
+
+	for (i = 0; i < ps->count; i++) {
+		if (!strcmp(ps->fields[i].name, name))
+			return i;
+	}
+	return -1;
+}
+
+/*
+ *
+ */
+static int32_t plug417_field_decode(const struct plug417_field *fl,
+		const uint8_t *p)
+{
+	uint32_t v;
+
+	switch (fl->width) {
+		case 1:
+			v = p[0];
+			break;
+		case 2:
+			v = (p[0] << 8) | p[1];
+			break;
+		default:
+			v = ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+			break;
+	}
+
+	if (fl->mask)
+		v = (v & fl->mask) >> __builtin_ctz(fl->mask);
+
+	if (fl->flags & PLUG417_FIELD_SIGNED) {
+		if (fl->width == 1)
+			return (int8_t)v;
+		if (fl->width == 2)
+			return (int16_t)v;
+	}
+	return (int32_t)v;
+}
+
+/*
+ * Decode frame payload into host order values, fields beyond the
+ * received payload size are zero
+ */
+int plug417_schema_decode(const struct plug417_page_schema *ps,
+		const void *payload, int size, int32_t *values)
+{
+	const uint8_t *p = (const uint8_t *)payload + ps->base;
+	const struct plug417_field *fl;
+	int i, n = 0;
+
+	size -= ps->base;
+	for (i = 0; i < ps->count; i++) {
+		fl = &ps->fields[i];
+		if (fl->offset + fl->width > size) {
+			values[i] = 0;
+			continue;
+		}
+		values[i] = plug417_field_decode(fl, p + fl->offset);
+		n++;
+	}
+	return n;
+}
+
+/*
+ *
+ */
+static void plug417_field_format(const struct plug417_field *fl, int32_t v,
+		struct plug417_output *o)
+{
+	if (fl->flags & PLUG417_FIELD_ON_OFF) {
+		plug417_out_field(o, fl->name, fl->label, v ? 1 : 0, v ? "ON" : "OFF");
+	} else if (fl->labels) {
+		plug417_out_field(o, fl->name, fl->label, v,
+				(uint32_t)v > fl->max ? "UNKNOWN" : fl->labels[v]);
+	} else if (fl->scale != 0.0) {
+		plug417_out_fixed(o, fl->name, fl->label, v, fl->scale);
+	} else if (fl->flags & PLUG417_FIELD_HEX) {
+		plug417_out_hex(o, fl->name, fl->label, v, fl->width * 2);
+	} else if (fl->flags & PLUG417_FIELD_SIGNED) {
+		plug417_out_field(o, fl->name, fl->label, v, NULL);
+	} else {
+		plug417_out_field(o, fl->name, fl->label, (uint32_t)v, NULL);
+	}
+}
+
+/*
+ * Fields only, for records that combine several pages
+ */
+void plug417_schema_fields(const struct plug417_page_schema *ps,
+		const int32_t *values, struct plug417_output *o)
+{
+	int i;
+
+	for (i = 0; i < ps->count; i++)
+		plug417_field_format(&ps->fields[i], values[i], o);
+}
+
+/*
+ * Render decoded values, CSV takes a header and a value pass
+ */
+int plug417_schema_format(const struct plug417_page_schema *ps,
+		const int32_t *values, struct plug417_output *o)
+{
+	int passes = o->format == PLUG417_FORMAT_CSV ? 2 : 1;
+
+	for (o->pass = 0; o->pass < passes; o->pass++) {
+		plug417_out_begin(o, ps->functional, ps->page, ps->name);
+		plug417_schema_fields(ps, values, o);
+		plug417_out_end(o, ps->functional, ps->page);
+	}
+
+	return o->overflow ? -1 : o->len;
+}
+
+/*
+ * Render only the fields changed since prev, returns number of changes
+ */
+int plug417_schema_diff(const struct plug417_page_schema *ps,
+		const int32_t *prev, const int32_t *values, struct plug417_output *o)
+{
+	int passes = o->format == PLUG417_FORMAT_CSV ? 2 : 1;
+	const struct plug417_field *fl;
+	int i, n = 0;
+
+	for (i = 0; i < ps->count; i++) {
+		if (prev[i] != values[i])
+			n++;
+	}
+	if (n == 0)
+		return 0;
+
+	for (o->pass = 0; o->pass < passes; o->pass++) {
+		plug417_out_begin(o, ps->functional, ps->page, ps->name);
+		for (i = 0; i < ps->count; i++) {
+			fl = &ps->fields[i];
+			if (prev[i] == values[i])
+				continue;
+
+			if (o->format == PLUG417_FORMAT_TEXT)
+				plug417_out_printf(o, "%s: %d -> %d\n", fl->label,
+						prev[i], values[i]);
+			else
+				plug417_field_format(fl, values[i], o);
+		}
+		plug417_out_end(o, ps->functional, ps->page);
+	}
+
+	return o->overflow ? -1 : n;
+}
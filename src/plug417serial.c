@@ -4,15 +4,20 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <time.h>
+#include <endian.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <termios.h>
+#include <errno.h>
+#include <poll.h>
 
 #include "plug417serial.h"
+#include "plug417trace.h"
 
 /*
  *
@@ -75,7 +80,7 @@ static int plug417_put_byte(struct plug417_serial *s, uint8_t b)
 	s->frame.raw[s->size - 3] = b;
 
 	if (s->frame.cs != xor_checkout(&s->frame.length, s->frame.length + 1))
-		return -1;
+		return -2;
 
 	return 1;
 }
@@ -85,23 +90,50 @@ static int plug417_put_byte(struct plug417_serial *s, uint8_t b)
  */
 int plug417_recv(struct plug417_serial *s, const void *buf, unsigned int len)
 {
-	int err = 0;
+	int err = 0, restart;
 	const uint8_t *p = (uint8_t *)buf;
+	uint8_t b;
 
 	while (len--) {
-		if ((err = plug417_put_byte(s, *p++)) < 0) {
+		b = *p++;
+		if ((err = plug417_put_byte(s, b)) < 0) {
+			if (err == -2) {
+				plug417_metrics_inc(&s->metrics, checksum_errors, 1);
+				plug417_trace(PLUG417_TRACE_LEVEL_ERROR, PLUG417_TRACE_CHECKSUM,
+						&s->frame, s->size + 1);
+			} else if (!s->hunting) {
+				/* Once per lost frame, not per byte skipped */
+				plug417_metrics_inc(&s->metrics, resyncs, 1);
+				plug417_trace(PLUG417_TRACE_LEVEL_ERROR, PLUG417_TRACE_RESYNC,
+						&s->frame, s->size + 1);
+			}
+			s->hunting = 1;
+
+			/* Hunt for next frame header, it may start with this byte */
+			restart = s->size > 0;
 			s->size = 0;
-			break;
+			if (restart && plug417_put_byte(s, b) == 0)
+				s->size++;
+			err = -1;
+			continue;
 		}
 
 		if (err > 0) {
 			/* Frame complete */
+			plug417_metrics_inc(&s->metrics, frames_rx, 1);
+			plug417_trace(PLUG417_TRACE_LEVEL_FRAME, PLUG417_TRACE_RX,
+					&s->frame, s->size + 1);
 			debug(PLUG417_SERIAL_DEBUG, "Received buffer %d bytes\n", s->size + 1);
 			dump_buf(PLUG417_SERIAL_DEBUG, &s->frame, s->size + 1);
+			if (s->monitor)
+				s->monitor(s->monitor_arg, PLUG417_MONITOR_RX, &s->frame, s->size + 1);
 			s->frame_size = s->size + 1;
 			s->size = 0;
 			return 1;
 		} else {
+			/* Both header bytes seen, a new frame started */
+			if (s->size == 1)
+				s->hunting = 0;
 			s->size++;
 		}
 	}
@@ -109,13 +141,11 @@ int plug417_recv(struct plug417_serial *s, const void *buf, unsigned int len)
 }
 
 /*
- *
+ * Returns the frame length
  */
-int plug417_send(struct plug417_serial *s,
+static int plug417_frame_build(uint8_t *buf,
 		uint8_t functional, uint8_t page, uint8_t option, uint32_t command)
 {
-	uint8_t buf[64];
-
 	struct plug417_frame *f = (struct plug417_frame *)buf;
 
 	f->header[0] = PLUG417_FRAME_HEADER0;
@@ -129,9 +159,32 @@ int plug417_send(struct plug417_serial *s,
 	buf[f->length + 3] = xor_checkout(&buf[2], f->length + 1);
 	buf[f->length + 4] = PLUG417_FRAME_END;
 
-	debug(PLUG417_SERIAL_DEBUG, "Send buffer %d bytes\n", f->length + 5);
-	dump_buf(PLUG417_SERIAL_DEBUG, buf, f->length + 5);
-	return write(s->fd, buf, f->length + 5);
+	return f->length + 5;
+}
+
+/*
+ *
+ */
+int plug417_send(struct plug417_serial *s,
+		uint8_t functional, uint8_t page, uint8_t option, uint32_t command)
+{
+	uint8_t buf[sizeof(struct plug417_frame)];
+	int n, len;
+
+	len = plug417_frame_build(buf, functional, page, option, command);
+
+	plug417_trace(PLUG417_TRACE_LEVEL_FRAME, PLUG417_TRACE_TX, buf, len);
+	debug(PLUG417_SERIAL_DEBUG, "Send buffer %d bytes\n", len);
+	dump_buf(PLUG417_SERIAL_DEBUG, buf, len);
+
+	n = write(s->fd, buf, len);
+	if (n > 0) {
+		plug417_metrics_inc(&s->metrics, frames_tx, 1);
+		plug417_metrics_inc(&s->metrics, bytes_tx, n);
+		if (s->monitor)
+			s->monitor(s->monitor_arg, PLUG417_MONITOR_TX, buf, n);
+	}
+	return n;
 }
 
 /*
@@ -144,9 +197,14 @@ static int plug417_handshake_decode(struct plug417_serial *s)
 
 	/* Decode handshake */
 	if (s->frame.handshake.option != 0) {
+		plug417_trace(PLUG417_TRACE_LEVEL_ERROR, PLUG417_TRACE_HANDSHAKE_ERROR,
+				&s->frame.handshake, 1);
+		plug417_metrics_inc(&s->metrics, handshake_error, 1);
 		debug(PLUG417_HANDSHAKE_DEBUG, "Handshake ERROR\n");
 		return -1;
 	}
+	plug417_trace(PLUG417_TRACE_LEVEL_FRAME, PLUG417_TRACE_HANDSHAKE_OK, NULL, 0);
+	plug417_metrics_inc(&s->metrics, handshake_ok, 1);
 	debug(PLUG417_HANDSHAKE_DEBUG, "Handshake OK\n");
 
 	return 0;
@@ -159,26 +217,152 @@ int plug417_receive(struct plug417_serial *s)
 {
 	int n;
 	char buf[256];
-	struct timeval tv;
+	struct pollfd pfd;
 	uint64_t start, cur;
 
 	s->frame_size = 0;
+	start = plug417_clock_ns() / 1000;
+	cur = start;
 	do {
-		gettimeofday(&tv, NULL);
-		start = tv.tv_sec * 1000000UL + tv.tv_usec;
+		/* Sleep until data or the rest of timeout expires */
+		pfd.fd = s->fd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, (s->timeout - (cur - start) + 999) / 1000) < 0 &&
+				errno != EINTR)
+			break;
 
 		n = read(s->fd, buf, sizeof(buf));
 		if (n > 0) {
+			plug417_metrics_inc(&s->metrics, bytes_rx, n);
+			plug417_trace(PLUG417_TRACE_LEVEL_BYTES, PLUG417_TRACE_READ, buf, n);
 			if (plug417_recv(s, buf, n) > 0)
 				return 0;
 		}
-		gettimeofday(&tv, NULL);
-		cur = tv.tv_sec * 1000000UL + tv.tv_usec;
+		cur = plug417_clock_ns() / 1000;
 	} while ((cur - start) < s->timeout);
 
+	plug417_metrics_inc(&s->metrics, timeouts, 1);
+	plug417_trace(PLUG417_TRACE_LEVEL_ERROR, PLUG417_TRACE_TIMEOUT, NULL, 0);
 	return -1;
 }
 
+/*
+ * Like plug417_receive() but for several frames in a row, bytes past a
+ * frame are kept for the next one. Stops at the first timeout.
+ */
+static int plug417_receive_frames(struct plug417_serial *s, unsigned int count,
+		int (*frame)(struct plug417_serial *s, unsigned int n, void *arg), void *arg)
+{
+	uint8_t buf[256];
+	unsigned int done = 0, pos = 0, len = 0;
+	struct pollfd pfd;
+	uint64_t start, cur;
+	int n;
+
+	s->frame_size = 0;
+	start = plug417_clock_ns() / 1000;
+	cur = start;
+	while (done < count) {
+		for (; pos < len && done < count; pos++) {
+			if (plug417_recv(s, buf + pos, 1) > 0) {
+				if (frame(s, done, arg) < 0)
+					return -1;
+				done++;
+				/* Each frame gets the whole timeout */
+				start = plug417_clock_ns() / 1000;
+			}
+		}
+		if (done == count)
+			break;
+
+		cur = plug417_clock_ns() / 1000;
+		if ((cur - start) >= s->timeout) {
+			plug417_metrics_inc(&s->metrics, timeouts, 1);
+			plug417_trace(PLUG417_TRACE_LEVEL_ERROR, PLUG417_TRACE_TIMEOUT, NULL, 0);
+			break;
+		}
+
+		pfd.fd = s->fd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, (s->timeout - (cur - start) + 999) / 1000) < 0 &&
+				errno != EINTR)
+			break;
+
+		n = read(s->fd, buf, sizeof(buf));
+		if (n > 0) {
+			plug417_metrics_inc(&s->metrics, bytes_rx, n);
+			plug417_trace(PLUG417_TRACE_LEVEL_BYTES, PLUG417_TRACE_READ, buf, n);
+			len = n;
+		} else {
+			len = 0;
+		}
+		pos = 0;
+	}
+	return done;
+}
+
+/*
+ *
+ */
+static int plug417_batch_handshake(struct plug417_serial *s, unsigned int n, void *arg)
+{
+	struct plug417_batch *b = (struct plug417_batch *)arg;
+
+	b[n].result = plug417_handshake_decode(s);
+	return 0;
+}
+
+/*
+ * Writes up to window commands back to back and then collects their
+ * handshakes, instead of one round trip per command. window is bounded
+ * by the receive buffer of the sensor, 0 uses PLUG417_BATCH_WINDOW.
+ * Sets result of every command, returns the number acknowledged or -1
+ * when the link fails.
+ */
+int plug417_send_batch(struct plug417_serial *s, struct plug417_batch *b,
+		unsigned int count, unsigned int window)
+{
+	uint8_t buf[PLUG417_BATCH_WINDOW_MAX * sizeof(struct plug417_frame)];
+	unsigned int i, j, n, ok = 0;
+	int len, r;
+
+	if (!window)
+		window = PLUG417_BATCH_WINDOW;
+	if (window > PLUG417_BATCH_WINDOW_MAX)
+		window = PLUG417_BATCH_WINDOW_MAX;
+
+	for (i = 0; i < count; i++)
+		b[i].result = -1;
+
+	for (i = 0; i < count; i += n) {
+		n = count - i < window ? count - i : window;
+
+		for (j = 0, len = 0; j < n; j++) {
+			r = plug417_frame_build(buf + len, b[i + j].functional, b[i + j].page,
+					b[i + j].option, b[i + j].command);
+			plug417_trace(PLUG417_TRACE_LEVEL_FRAME, PLUG417_TRACE_TX, buf + len, r);
+			len += r;
+		}
+		debug(PLUG417_SERIAL_DEBUG, "Send batch %u frames %d bytes\n", n, len);
+		dump_buf(PLUG417_SERIAL_DEBUG, buf, len);
+
+		if (write(s->fd, buf, len) != len)
+			return -1;
+		plug417_metrics_inc(&s->metrics, frames_tx, n);
+		plug417_metrics_inc(&s->metrics, bytes_tx, len);
+		if (s->monitor)
+			s->monitor(s->monitor_arg, PLUG417_MONITOR_TX, buf, len);
+
+		if (plug417_receive_frames(s, n, plug417_batch_handshake, b + i) != (int)n)
+			return -1;
+
+		for (j = 0; j < n; j++)
+			if (b[i + j].result == 0)
+				ok++;
+	}
+	return ok;
+}
+
 /*
  *
  */
@@ -216,10 +400,38 @@ int plug417_query_status(struct plug417_serial *s, struct plug417_status *st)
 		return -1;
 
 	memcpy(st, &s->frame.status, sizeof(struct plug417_status));
+
+	__atomic_store_n(&s->metrics.focal_spot_temperature,
+			(int16_t)be16toh(st->focal_spot_temperature), __ATOMIC_RELAXED);
+	__atomic_store_n(&s->metrics.focal_spot_timestamp,
+			plug417_clock_ns(), __ATOMIC_RELAXED);
 	return 0;
 
 }
 
+/*
+ * The defective pixel page layout is not documented, the reply payload
+ * after functional and page is copied as is. Returns its length.
+ */
+int plug417_query_defective_pixel(struct plug417_serial *s, void *buf, unsigned int size)
+{
+	const unsigned int base = offsetof(struct plug417_query, option);
+	unsigned int len;
+
+	if (plug417_query(s, PLUG417_APPLICATION_PAGE,
+			PLUG417_DEFECTIVE_PIXEL_CORRECTION_PAGE) < 0)
+		return -1;
+
+	if (s->frame.query.functional != PLUG417_APPLICATION_PAGE ||
+			s->frame.query.page != PLUG417_DEFECTIVE_PIXEL_CORRECTION_PAGE ||
+			s->frame.length < base)
+		return -1;
+
+	len = s->frame.length - base;
+	memcpy(buf, s->frame.raw + base, len < size ? len : size);
+	return len;
+}
+
 /*
  *
  */
@@ -319,6 +531,16 @@ int plug417_set_test_screen(struct plug417_serial *s, unsigned int test)
 				PLUG417_OPTION_TEST_SCREEN_SWITCHING, test);
 }
 
+/*
+ * Closes the shutter and runs a compensation now, frames freeze or jump
+ * while it lasts
+ */
+int plug417_set_shutter_control(struct plug417_serial *s, unsigned int v)
+{
+	return plug417_request(s, PLUG417_SETUP_PAGE, PLUG417_ANALOG_VIDEO_PAGE,
+				PLUG417_OPTION_SHUTTER_CONTROL, v);
+}
+
 /*
  *
  */
@@ -818,6 +1040,8 @@ struct plug417_serial *plug417_open(const char *serial)
 	if (!s)
 		return NULL;
 
+	memset(s, 0, sizeof(struct plug417_serial));
+
 	if (plug417_setup(s, serial) < 0) {
 		free(s);
 		return NULL;
@@ -835,3 +1059,12 @@ void plug417_close(struct plug417_serial *s)
 	free(s);
 }
 
+/*
+ * NULL monitor removes it
+ */
+void plug417_serial_monitor(struct plug417_serial *s, plug417_monitor monitor, void *arg)
+{
+	s->monitor_arg = arg;
+	s->monitor = monitor;
+}
+
@@ -0,0 +1,25 @@
+/*
+ * plug417 internal SIMD selection, scalar code is always available
+ */
+#ifndef _PLUG417_SIMD_H_
+#define _PLUG417_SIMD_H_
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PLUG417_SSE2		1
+#endif
+
+/* AVX2 code is built per function and selected at run time */
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PLUG417_X86		1
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PLUG417_NEON		1
+#endif
+
+#define PLUG417_CACHE_LINE	64
+
+#endif
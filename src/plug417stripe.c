@@ -0,0 +1,270 @@
+/*
+ * plug417 host side vertical stripe removal for Y16
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "plug417stripe.h"
+#include "plug417simd.h"
+
+/*
+ * Per level update rate and edge threshold in Y16 units, level 0 is the
+ * lightest as on the sensor
+ */
+static const struct {
+	float rate;
+	int threshold;
+} plug417_stripe_levels[] = {
+	[PLUG417_ALGORITHM_LEVEL_0] = { 0.02f, 3 },
+	[PLUG417_ALGORITHM_LEVEL_1] = { 0.04f, 4 },
+	[PLUG417_ALGORITHM_LEVEL_2] = { 0.06f, 6 },
+	[PLUG417_ALGORITHM_LEVEL_3] = { 0.08f, 8 },
+	[PLUG417_ALGORITHM_LEVEL_4] = { 0.10f, 10 },
+};
+
+/*
+ *
+ */
+struct plug417_stripe *plug417_stripe_alloc(unsigned int width, unsigned int height,
+		int level)
+{
+	struct plug417_stripe *s;
+
+	if (width < 3)
+		return NULL;
+
+	s = malloc(sizeof(struct plug417_stripe));
+	if (!s)
+		return NULL;
+
+	memset(s, 0, sizeof(struct plug417_stripe));
+	s->width = width;
+	s->height = height;
+	s->offset = calloc(width, sizeof(float));
+	s->correction = calloc(width, sizeof(int16_t));
+	s->sum = calloc(width, sizeof(int16_t));
+	s->count = calloc(width, sizeof(int16_t));
+	s->total = calloc(width, sizeof(int32_t));
+	s->total_count = calloc(width, sizeof(int32_t));
+	if (!s->offset || !s->correction || !s->sum || !s->count || !s->total ||
+			!s->total_count || plug417_stripe_set(s, level) < 0) {
+		plug417_stripe_free(s);
+		return NULL;
+	}
+	return s;
+}
+
+/*
+ *
+ */
+void plug417_stripe_free(struct plug417_stripe *s)
+{
+	free(s->offset);
+	free(s->correction);
+	free(s->sum);
+	free(s->count);
+	free(s->total);
+	free(s->total_count);
+	free(s);
+}
+
+/*
+ *
+ */
+int plug417_stripe_set(struct plug417_stripe *s, int level)
+{
+	if (level < PLUG417_STRIPE_OFF || level > PLUG417_ALGORITHM_LEVEL_MAX)
+		return -1;
+
+	s->level = level;
+	if (level != PLUG417_STRIPE_OFF) {
+		s->rate = plug417_stripe_levels[level].rate;
+		s->threshold = plug417_stripe_levels[level].threshold;
+	}
+	return 0;
+}
+
+/*
+ * Same switch and strength as the sensor's vertical stripe removal
+ */
+int plug417_stripe_from_page(struct plug417_stripe *s,
+		const struct plug417_alorithm_control_page_1 *page)
+{
+	if (!page->vertical_strip_removal)
+		return plug417_stripe_set(s, PLUG417_STRIPE_OFF);
+
+	return plug417_stripe_set(s, page->vertical_strip_strength);
+}
+
+/*
+ * Column offsets start over, after a NUC the pattern changes
+ */
+void plug417_stripe_reset(struct plug417_stripe *s)
+{
+	memset(s->offset, 0, s->width * sizeof(float));
+	memset(s->correction, 0, s->width * sizeof(int16_t));
+}
+
+/*
+ *
+ */
+static void plug417_stripe_flush(struct plug417_stripe *s)
+{
+	unsigned int x;
+
+	for (x = 0; x < s->width; x++) {
+		s->total[x] += s->sum[x];
+		s->total_count[x] += s->count[x];
+	}
+	memset(s->sum, 0, s->width * sizeof(int16_t));
+	memset(s->count, 0, s->width * sizeof(int16_t));
+}
+
+/*
+ *
+ */
+static inline void plug417_stripe_residual(struct plug417_stripe *s, int r, unsigned int x)
+{
+	if (r >= -s->threshold && r <= s->threshold) {
+		s->sum[x] += r;
+		s->count[x]++;
+	}
+}
+
+/*
+ * Corrects one row and sums the difference of each pixel to the mean of
+ * its neighbours, which a column offset shows as a bias
+ */
+static void plug417_stripe_row(struct plug417_stripe *s, uint16_t *row)
+{
+	int16_t *p = (int16_t *)row;
+	const unsigned int n = s->width;
+	unsigned int x = 0;
+	int v;
+
+#if defined(PLUG417_SSE2)
+	const __m128i bias = _mm_set1_epi16((int16_t)0x8000);
+	const __m128i limit = _mm_set1_epi16(s->threshold + 1);
+	__m128i c, l, r, res, mask;
+
+	for (; x + 8 <= n; x += 8)
+		_mm_storeu_si128((__m128i *)(p + x), _mm_subs_epi16(
+				_mm_loadu_si128((const __m128i *)(p + x)),
+				_mm_loadu_si128((const __m128i *)(s->correction + x))));
+#elif defined(PLUG417_NEON)
+	const int16x8_t limit = vdupq_n_s16(s->threshold);
+	int16x8_t c, l, r, res;
+	uint16x8_t mask;
+
+	for (; x + 8 <= n; x += 8)
+		vst1q_s16(p + x, vqsubq_s16(vld1q_s16(p + x), vld1q_s16(s->correction + x)));
+#endif
+	for (; x < n; x++) {
+		v = p[x] - s->correction[x];
+		p[x] = v < INT16_MIN ? INT16_MIN : v > INT16_MAX ? INT16_MAX : v;
+	}
+
+	plug417_stripe_residual(s, p[0] - p[1], 0);
+	x = 1;
+#if defined(PLUG417_SSE2)
+	for (; x + 9 <= n; x += 8) {
+		c = _mm_loadu_si128((const __m128i *)(p + x));
+		l = _mm_loadu_si128((const __m128i *)(p + x - 1));
+		r = _mm_loadu_si128((const __m128i *)(p + x + 1));
+		/* Signed (l + r + 1) >> 1 through the unsigned average */
+		res = _mm_xor_si128(_mm_avg_epu16(_mm_xor_si128(l, bias),
+				_mm_xor_si128(r, bias)), bias);
+		res = _mm_subs_epi16(c, res);
+		mask = _mm_cmpgt_epi16(limit, _mm_max_epi16(res,
+				_mm_subs_epi16(_mm_setzero_si128(), res)));
+		_mm_storeu_si128((__m128i *)(s->sum + x), _mm_add_epi16(
+				_mm_loadu_si128((const __m128i *)(s->sum + x)),
+				_mm_and_si128(res, mask)));
+		_mm_storeu_si128((__m128i *)(s->count + x), _mm_sub_epi16(
+				_mm_loadu_si128((const __m128i *)(s->count + x)), mask));
+	}
+#elif defined(PLUG417_NEON)
+	for (; x + 9 <= n; x += 8) {
+		c = vld1q_s16(p + x);
+		l = vld1q_s16(p + x - 1);
+		r = vld1q_s16(p + x + 1);
+		res = vqsubq_s16(c, vrhaddq_s16(l, r));
+		mask = vcleq_s16(vqabsq_s16(res), limit);
+		vst1q_s16(s->sum + x, vaddq_s16(vld1q_s16(s->sum + x),
+				vandq_s16(res, vreinterpretq_s16_u16(mask))));
+		vst1q_s16(s->count + x, vsubq_s16(vld1q_s16(s->count + x),
+				vreinterpretq_s16_u16(mask)));
+	}
+#endif
+	for (; x + 1 < n; x++) {
+		v = p[x] - ((p[x - 1] + p[x + 1] + 1) >> 1);
+		plug417_stripe_residual(s, v < INT16_MIN ? INT16_MIN : v > INT16_MAX ?
+				INT16_MAX : v, x);
+	}
+	plug417_stripe_residual(s, p[n - 1] - p[n - 2], n - 1);
+}
+
+/*
+ * Moves the offsets by the mean residual of this frame, the correction
+ * of the next frame is rounded from them. Offsets keep a zero mean so
+ * the frame mean is unchanged.
+ */
+static void plug417_stripe_update(struct plug417_stripe *s)
+{
+	const int32_t min = s->height / 4 ? s->height / 4 : 1;
+	unsigned int x;
+	float mean = 0.0f;
+
+	for (x = 0; x < s->width; x++) {
+		if (s->total_count[x] >= min)
+			s->offset[x] += s->rate * s->total[x] / s->total_count[x];
+		mean += s->offset[x];
+	}
+	mean /= s->width;
+
+	for (x = 0; x < s->width; x++) {
+		s->offset[x] -= mean;
+		s->correction[x] = lrintf(s->offset[x]);
+	}
+}
+
+/*
+ * Corrects the Y16 image in place, the same work for every frame
+ */
+int plug417_stripe_frame(struct plug417_stripe *s, struct plug417_video_frame *f)
+{
+	uint16_t *p = f->y16;
+	unsigned int y, rows = 0;
+
+	if (!p || f->width != s->width || f->height != s->height)
+		return -1;
+
+	if (s->level == PLUG417_STRIPE_OFF)
+		return 0;
+
+	memset(s->sum, 0, s->width * sizeof(int16_t));
+	memset(s->count, 0, s->width * sizeof(int16_t));
+	memset(s->total, 0, s->width * sizeof(int32_t));
+	memset(s->total_count, 0, s->width * sizeof(int32_t));
+
+	for (y = 0; y < s->height; y++, p += f->stride) {
+		plug417_stripe_row(s, p);
+		if (++rows == PLUG417_STRIPE_FLUSH) {
+			plug417_stripe_flush(s);
+			rows = 0;
+		}
+	}
+	plug417_stripe_flush(s);
+	plug417_stripe_update(s);
+	s->frames++;
+	return 0;
+}
+
+/*
+ * Pipeline stage, add it as ordered so offsets follow frames in sequence
+ */
+int plug417_stripe_process(void *arg, struct plug417_video_frame *f)
+{
+	return plug417_stripe_frame(arg, f);
+}
@@ -0,0 +1,434 @@
+/*
+ * plug417 parameter sweep
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <errno.h>
+
+#include "plug417sweep.h"
+#include "plug417schema.h"
+#include "plug417trace.h"
+
+struct plug417_sweep_option {
+	const char *name;
+	uint8_t functional;
+	uint8_t page;
+	uint8_t option;
+};
+
+static const struct plug417_sweep_option plug417_sweep_options[] = {
+	{"filter", PLUG417_VIDEO_PAGE, PLUG417_ALGORITHM_SETTING_PAGE,
+		PLUG417_OPTION_TIME_DOMAIN_FILTERING},
+	{"filter_strength", PLUG417_VIDEO_PAGE, PLUG417_ALGORITHM_SETTING_PAGE,
+		PLUG417_OPTION_FILTERING_STRENGTH},
+	{"stripe", PLUG417_VIDEO_PAGE, PLUG417_ALGORITHM_SETTING_PAGE,
+		PLUG417_OPTION_VERTICAL_STRIP_REMOVAL},
+	{"stripe_strength", PLUG417_VIDEO_PAGE, PLUG417_ALGORITHM_SETTING_PAGE,
+		PLUG417_OPTION_VERTICAL_STRIP_STRENGTH},
+	{"sharpening", PLUG417_VIDEO_PAGE, PLUG417_ALGORITHM_SETTING_PAGE,
+		PLUG417_OPTION_SHARPENING},
+	{"sharpening_strength", PLUG417_VIDEO_PAGE, PLUG417_ALGORITHM_SETTING_PAGE,
+		PLUG417_OPTION_SHARPENING_STRENGTH},
+	{"dimming", PLUG417_VIDEO_PAGE, PLUG417_ALGORITHM_SETTING_PAGE,
+		PLUG417_OPTION_DIMMING_MODE},
+	{"upper", PLUG417_VIDEO_PAGE, PLUG417_ALGORITHM_SETTING_PAGE,
+		PLUG417_OPTION_UPPER_THROWING_POINT},
+	{"lower", PLUG417_VIDEO_PAGE, PLUG417_ALGORITHM_SETTING_PAGE,
+		PLUG417_OPTION_LOWER_THROWING_POINT},
+	{"brightness", PLUG417_VIDEO_PAGE, PLUG417_ALGORITHM_SETTING_PAGE,
+		PLUG417_OPTION_BRIGHTNESS},
+	{"contrast", PLUG417_VIDEO_PAGE, PLUG417_ALGORITHM_SETTING_PAGE,
+		PLUG417_OPTION_CONTRAST},
+	{"hybrid", PLUG417_VIDEO_PAGE, PLUG417_ALGORITHM_SETTING_PAGE,
+		PLUG417_OPTION_HYBRID_DIMMING_MAPPING},
+	{"scene_compensation", PLUG417_VIDEO_PAGE, PLUG417_DIGITAL_VIDEO_PAGE,
+		PLUG417_OPTION_SCENE_COMPENSATION},
+	{"shutter_compensation", PLUG417_VIDEO_PAGE, PLUG417_DIGITAL_VIDEO_PAGE,
+		PLUG417_OPTION_SHUTTER_COMPENSATION},
+	{"distance", PLUG417_TEMPERATURE_MEASUREMENT_PAGE, PLUG417_PARAMETER_SETTING_PAGE,
+		PLUG417_OPTION_DISTANCE},
+	{"emissivity", PLUG417_TEMPERATURE_MEASUREMENT_PAGE, PLUG417_PARAMETER_SETTING_PAGE,
+		PLUG417_OPTION_EMISSIVITY},
+	{"reflected", PLUG417_TEMPERATURE_MEASUREMENT_PAGE, PLUG417_PARAMETER_SETTING_PAGE,
+		PLUG417_OPTION_REFLECTED},
+	{"humidity", PLUG417_TEMPERATURE_MEASUREMENT_PAGE, PLUG417_PARAMETER_SETTING_PAGE,
+		PLUG417_OPTION_HUMIDITY_SAVE_SETTINGS},
+	{"range", PLUG417_TEMPERATURE_MEASUREMENT_PAGE, PLUG417_PARAMETER_SETTING_PAGE,
+		PLUG417_OPTION_TEMPERATURE_MEASUREMENT_RANGE},
+	{"calibration", PLUG417_TEMPERATURE_MEASUREMENT_PAGE, PLUG417_PARAMETER_SETTING_PAGE,
+		PLUG417_OPTION_TEMPERATURE_CALIBRATION},
+	{NULL},
+};
+
+/*
+ *
+ */
+struct plug417_sweep *plug417_sweep_alloc(void)
+{
+	struct plug417_sweep *sw;
+
+	sw = malloc(sizeof(struct plug417_sweep));
+	if (!sw)
+		return NULL;
+
+	memset(sw, 0, sizeof(struct plug417_sweep));
+	sw->functional = -1;
+	sw->whole = 1;
+	return sw;
+}
+
+/*
+ *
+ */
+void plug417_sweep_free(struct plug417_sweep *sw)
+{
+	free(sw);
+}
+
+/*
+ *
+ */
+void plug417_sweep_help(void)
+{
+	const struct plug417_sweep_option *op;
+
+	printf("Sweep axis: <name>=<values>, values are a comma separated list of\n"
+			"numbers or start:stop[:step] ranges, name is f.p.o (functional,\n"
+			"page, option) or one of:\n");
+	for (op = plug417_sweep_options; op->name; op++)
+		printf("\t%-24s%u.%u.%u\n", op->name, op->functional, op->page, op->option);
+}
+
+/*
+ *
+ */
+static int plug417_sweep_name(struct plug417_sweep_axis *a, const char *name, int len)
+{
+	const struct plug417_sweep_option *op;
+	unsigned int f, p, o;
+	char c;
+
+	if (len <= 0 || len >= PLUG417_SWEEP_NAME_SIZE)
+		return -1;
+
+	memcpy(a->name, name, len);
+	a->name[len] = '\0';
+
+	for (op = plug417_sweep_options; op->name; op++) {
+		if (!strcmp(op->name, a->name)) {
+			a->functional = op->functional;
+			a->page = op->page;
+			a->option = op->option;
+			return 0;
+		}
+	}
+
+	if (sscanf(a->name, "%u.%u.%u%c", &f, &p, &o, &c) != 3 ||
+			f > PLUG417_PAGE_MAX || p > 0xff || o > 0xff)
+		return -1;
+
+	a->functional = f;
+	a->page = p;
+	a->option = o;
+	return 0;
+}
+
+/*
+ *
+ */
+static int plug417_sweep_values(struct plug417_sweep_axis *a, const char *p)
+{
+	long start, stop, step, v;
+	char *end;
+
+	while (*p) {
+		start = strtol(p, &end, 0);
+		if (end == p)
+			return -1;
+		stop = start;
+		step = 1;
+		p = end;
+		if (*p == ':') {
+			stop = strtol(p + 1, &end, 0);
+			if (end == p + 1)
+				return -1;
+			p = end;
+			if (*p == ':') {
+				step = strtol(p + 1, &end, 0);
+				if (end == p + 1 || step <= 0)
+					return -1;
+				p = end;
+			}
+		}
+		if (*p == ',')
+			p++;
+		else if (*p)
+			return -1;
+
+		for (v = start; start <= stop ? v <= stop : v >= stop;
+				v += start <= stop ? step : -step) {
+			if (a->count == PLUG417_SWEEP_VALUES_MAX)
+				return -1;
+			a->values[a->count++] = v;
+		}
+	}
+	return a->count ? 0 : -1;
+}
+
+/*
+ * name=values, see plug417_sweep_help()
+ */
+int plug417_sweep_axis(struct plug417_sweep *sw, const char *spec)
+{
+	struct plug417_sweep_axis *a;
+	const char *eq = strchr(spec, '=');
+
+	if (!eq || sw->count == PLUG417_SWEEP_AXES_MAX)
+		return -1;
+
+	a = &sw->axes[sw->count];
+	memset(a, 0, sizeof(struct plug417_sweep_axis));
+	if (plug417_sweep_name(a, spec, eq - spec) < 0 ||
+			plug417_sweep_values(a, eq + 1) < 0)
+		return -1;
+
+	sw->points = sw->count ? sw->points * a->count : a->count;
+	sw->count++;
+	return 0;
+}
+
+/*
+ * Page recorded with the status at every point
+ */
+void plug417_sweep_query(struct plug417_sweep *sw, int functional, int page)
+{
+	sw->functional = functional;
+	sw->page = page;
+}
+
+/*
+ * Frames averaged at every point, NULL roi for the whole frame
+ */
+void plug417_sweep_video(struct plug417_sweep *sw, struct plug417_video *v,
+		const struct plug417_roi *roi, unsigned int frames)
+{
+	sw->video = v;
+	sw->whole = !roi;
+	if (roi)
+		sw->roi = *roi;
+	sw->frames = frames ? frames : 1;
+}
+
+/*
+ * Frames captured at every point are also written to w
+ */
+void plug417_sweep_record(struct plug417_sweep *sw, struct plug417_record_writer *w)
+{
+	sw->record = w;
+}
+
+/*
+ *
+ */
+static void plug417_sweep_sleep(uint64_t deadline)
+{
+	struct timespec ts;
+
+	ts.tv_sec = deadline / 1000000000ULL;
+	ts.tv_nsec = deadline % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+/*
+ * Frames older than settled are dropped, then settle_frames more, by
+ * the frame counter of the parameter line when there is one
+ */
+static int plug417_sweep_capture(struct plug417_sweep *sw, uint64_t settled)
+{
+	struct plug417_sweep_stats *st = &sw->stats;
+	struct plug417_video_frame *f;
+	struct plug417_roi r;
+	const int16_t *row;
+	unsigned int x, y, dropped = 0;
+	uint32_t counter = 0;
+	int counting = 0;
+	double sum2 = 0.0, mean;
+	int64_t sum;
+	int err = 0;
+
+	memset(st, 0, sizeof(struct plug417_sweep_stats));
+	st->min = INT16_MAX;
+	st->max = INT16_MIN;
+
+	while (st->frames < sw->frames) {
+		if (plug417_video_dequeue(sw->video, &f, 1000) != 0)
+			return -1;
+
+		if (f->timestamp < settled || !f->y16) {
+			plug417_video_queue(sw->video, f);
+			continue;
+		}
+		if (!counting) {
+			counter = f->info.frame_counter;
+			counting = 1;
+		}
+		if (f->info.valid ? f->info.frame_counter - counter < sw->settle_frames :
+				dropped < sw->settle_frames) {
+			dropped++;
+			plug417_video_queue(sw->video, f);
+			continue;
+		}
+
+		if (plug417_video_roi(f, sw->whole ? NULL : &sw->roi, &r) < 0) {
+			plug417_video_queue(sw->video, f);
+			return -1;
+		}
+
+		sum = 0;
+		for (y = r.y; y < r.y + r.height; y++) {
+			row = (const int16_t *)f->y16 + (size_t)y * f->stride + r.x;
+			for (x = 0; x < r.width; x++) {
+				sum += row[x];
+				if (row[x] < st->min)
+					st->min = row[x];
+				if (row[x] > st->max)
+					st->max = row[x];
+			}
+		}
+		mean = (double)sum / ((double)r.width * r.height);
+
+		if (!st->frames) {
+			st->sequence = f->sequence;
+			st->timestamp = f->timestamp;
+		}
+		st->mean += mean;
+		sum2 += mean * mean;
+		st->frames++;
+
+		if (sw->record && plug417_record_write_frame(sw->record, f) < 0)
+			err = -1;
+		plug417_video_queue(sw->video, f);
+	}
+
+	st->mean /= st->frames;
+	st->noise = sum2 / st->frames - st->mean * st->mean;
+	st->noise = st->noise > 0.0 ? sqrt(st->noise) : 0.0;
+	return err;
+}
+
+/*
+ *
+ */
+static void plug417_sweep_format(struct plug417_sweep *sw, unsigned int point, int acked,
+		const struct plug417_page_schema *status, const int32_t *sv,
+		const struct plug417_page_schema *page, const int32_t *pv,
+		struct plug417_output *o)
+{
+	struct plug417_sweep_axis *a;
+	unsigned int i;
+
+	plug417_out_begin(o, PLUG417_FUNCTIONAL_HOST, PLUG417_HOST_SWEEP_POINT, "Sweep point");
+	plug417_out_field(o, "point", "Point", point, NULL);
+	for (i = 0; i < sw->count; i++) {
+		a = &sw->axes[i];
+		plug417_out_field(o, a->name, a->name, a->values[a->index], NULL);
+	}
+	plug417_out_field(o, "acked", "Acknowledged", acked, NULL);
+	if (status)
+		plug417_schema_fields(status, sv, o);
+	if (page)
+		plug417_schema_fields(page, pv, o);
+	if (sw->video) {
+		plug417_out_field(o, "frames", "Frames", sw->stats.frames, NULL);
+		plug417_out_field(o, "sequence", "First frame", sw->stats.sequence, NULL);
+		plug417_out_fixed(o, "mean", "ROI mean", llrint(sw->stats.mean * 10), 0.01);
+		plug417_out_fixed(o, "noise", "ROI temporal noise",
+				llrint(sw->stats.noise * 10), 0.01);
+		plug417_out_fixed(o, "min", "ROI min", sw->stats.min, 0.1);
+		plug417_out_fixed(o, "max", "ROI max", sw->stats.max, 0.1);
+	}
+	plug417_out_end(o, PLUG417_FUNCTIONAL_HOST, PLUG417_HOST_SWEEP_POINT);
+}
+
+/*
+ * Every point of the grid back to back, one record per point written
+ * to fd as soon as it is complete. Only the options that changed since
+ * the previous point are sent, as one batch.
+ */
+int plug417_sweep_run(struct plug417_sweep *sw, struct plug417_serial *s, int format, int fd)
+{
+	struct plug417_batch batch[PLUG417_SWEEP_AXES_MAX];
+	unsigned int prev[PLUG417_SWEEP_AXES_MAX];
+	int32_t sv[PLUG417_SCHEMA_FIELDS_MAX], pv[PLUG417_SCHEMA_FIELDS_MAX];
+	const struct plug417_page_schema *status, *page = NULL;
+	char buf[PLUG417_OUTPUT_SIZE];
+	struct plug417_output o;
+	struct plug417_sweep_axis *a;
+	unsigned int point, i, n, idx;
+	uint64_t settled;
+	int acked, err = 0;
+
+	if (!sw->count)
+		return -1;
+
+	status = plug417_schema_find(PLUG417_STATUS_PAGE, 0);
+	if (sw->functional >= 0) {
+		page = plug417_schema_find(sw->functional, sw->page);
+		if (!page)
+			return -1;
+	}
+
+	for (point = 0; point < sw->points; point++) {
+		/* Last axis fastest */
+		for (i = sw->count, idx = point; i-- > 0; idx /= sw->axes[i].count)
+			sw->axes[i].index = idx % sw->axes[i].count;
+
+		for (i = 0, n = 0; i < sw->count; i++) {
+			a = &sw->axes[i];
+			if (point && a->index == prev[i])
+				continue;
+			memset(&batch[n], 0, sizeof(struct plug417_batch));
+			batch[n].functional = a->functional;
+			batch[n].page = a->page;
+			batch[n].option = a->option;
+			batch[n].command = (uint32_t)a->values[a->index];
+			n++;
+			prev[i] = a->index;
+		}
+
+		acked = plug417_send_batch(s, batch, n, 0);
+		if (acked < 0)
+			return -1;
+
+		settled = plug417_clock_ns() + sw->settle_ms * 1000000ULL;
+		if (!sw->video && sw->settle_ms)
+			plug417_sweep_sleep(settled);
+
+		if (sw->video && plug417_sweep_capture(sw, settled) < 0)
+			err = -1;
+
+		if (plug417_query(s, PLUG417_STATUS_PAGE, 0) == 0)
+			plug417_schema_decode(status, s->frame.raw, s->frame.length, sv);
+		else
+			memset(sv, 0, sizeof(sv));
+
+		if (page) {
+			if (plug417_query(s, sw->functional, sw->page) == 0)
+				plug417_schema_decode(page, s->frame.raw, s->frame.length, pv);
+			else
+				memset(pv, 0, sizeof(pv));
+		}
+
+		/* CSV header before the first point only */
+		plug417_output_init(&o, format, buf, sizeof(buf));
+		for (o.pass = point || format != PLUG417_FORMAT_CSV; o.pass < 2; o.pass++)
+			plug417_sweep_format(sw, point, acked, status, sv, page, pv, &o);
+		if (plug417_output_write(&o, fd) < 0)
+			return -1;
+	}
+	return err;
+}
@@ -0,0 +1,514 @@
+/*
+ * plug417 Y16 to temperature conversion
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <endian.h>
+
+#include "plug417temp.h"
+#include "plug417simd.h"
+
+#define KELVIN		273.15
+
+static void plug417_temp_update(struct plug417_temp *t);
+
+/*
+ *
+ */
+static int plug417_temp_check(const struct plug417_temp_settings *settings)
+{
+	if (settings->unit > PLUG417_TEMP_UNIT_MAX || settings->emissivity > 100 ||
+			settings->humidity > 100)
+		return -1;
+	return 0;
+}
+
+/*
+ * NULL settings are all zero
+ */
+struct plug417_temp *plug417_temp_alloc(const struct plug417_temp_settings *settings)
+{
+	struct plug417_temp *t;
+
+	if (settings && plug417_temp_check(settings) < 0)
+		return NULL;
+
+	if (posix_memalign((void **)&t, PLUG417_CACHE_LINE, sizeof(struct plug417_temp)))
+		return NULL;
+
+	memset(t, 0, sizeof(struct plug417_temp));
+	if (settings)
+		t->settings = *settings;
+	plug417_temp_update(t);
+	return t;
+}
+
+/*
+ *
+ */
+void plug417_temp_free(struct plug417_temp *t)
+{
+	free(t);
+}
+
+/*
+ *
+ */
+void plug417_temp_settings_from_page(const struct plug417_measurement_page_1 *p,
+		struct plug417_temp_settings *settings)
+{
+	settings->distance = p->distance;
+	settings->emissivity = p->emissivity;
+	settings->reflected = (int16_t)be16toh(p->temperature_reflected);
+	settings->humidity = p->humidity;
+	settings->unit = p->temperature_unit;
+}
+
+/*
+ * Tables are rebuilt here, only when a setting changed, so conversions
+ * only read t. Must not run while t is used to convert.
+ */
+int plug417_temp_set(struct plug417_temp *t, const struct plug417_temp_settings *settings)
+{
+	if (plug417_temp_check(settings) < 0)
+		return -1;
+
+	if (!memcmp(&t->settings, settings, sizeof(struct plug417_temp_settings)))
+		return 0;
+
+	t->settings = *settings;
+	plug417_temp_update(t);
+	return 0;
+}
+
+/*
+ * Atmospheric transmission from distance and water vapour content,
+ * atmosphere is assumed at the reflected temperature
+ */
+static double plug417_temp_transmission(const struct plug417_temp_settings *st)
+{
+	double t = (double)st->reflected / PLUG417_TEMP_Y16_SCALE;
+	double h2o, d, tau;
+
+	h2o = st->humidity / 100.0 * exp(1.5587 + 0.06939 * t -
+			0.00027816 * t * t + 0.00000068455 * t * t * t);
+	d = sqrt(st->distance);
+
+	tau = 1.9 * exp(-d * (0.006569 - 0.002276 * sqrt(h2o))) -
+		0.9 * exp(-d * (0.01262 - 0.00667 * sqrt(h2o)));
+
+	if (tau > 1.0)
+		tau = 1.0;
+	if (tau < 0.01)
+		tau = 0.01;
+	return tau;
+}
+
+/*
+ * Radiated power is approximated by T^4, object radiation is what is
+ * left after the reflected and atmospheric components
+ */
+static double plug417_temp_compensate(const struct plug417_temp_settings *st,
+		double tau, uint16_t y16)
+{
+	double t_app = (double)(int16_t)y16 / PLUG417_TEMP_Y16_SCALE + KELVIN;
+	double t_refl = (double)st->reflected / PLUG417_TEMP_Y16_SCALE + KELVIN;
+	double e = st->emissivity ? st->emissivity / 100.0 : 1.0;
+	double w_app, w_refl, w;
+
+	w_app = t_app * t_app * t_app * t_app;
+	w_refl = t_refl * t_refl * t_refl * t_refl;
+
+	w = (w_app - (1.0 - e) * tau * w_refl - (1.0 - tau) * w_refl) / (e * tau);
+	return w > 0.0 ? sqrt(sqrt(w)) : 0.0;
+}
+
+/*
+ *
+ */
+static double plug417_temp_unit(double kelvin, unsigned int unit)
+{
+	switch (unit) {
+		case PLUG417_TEMP_UNIT_FAHRENHEIT:
+			return (kelvin - KELVIN) * 1.8 + 32.0;
+		case PLUG417_TEMP_UNIT_KELVIN:
+			return kelvin;
+		default:
+			return kelvin - KELVIN;
+	}
+}
+
+/*
+ * Single value, no table needed
+ */
+float plug417_temp_y16(const struct plug417_temp_settings *settings, uint16_t y16)
+{
+	double tau = plug417_temp_transmission(settings);
+
+	return plug417_temp_unit(plug417_temp_compensate(settings, tau, y16),
+			settings->unit);
+}
+
+/*
+ *
+ */
+static void plug417_temp_update(struct plug417_temp *t)
+{
+	double tau, v;
+	int i;
+
+	tau = plug417_temp_transmission(&t->settings);
+	for (i = 0; i < PLUG417_TEMP_LUT_SIZE; i++) {
+		v = plug417_temp_unit(plug417_temp_compensate(&t->settings, tau, i),
+				t->settings.unit);
+		t->lut[i] = v;
+
+		v = lrint(v * PLUG417_TEMP_FIXED_SCALE);
+		if (v > INT16_MAX)
+			v = INT16_MAX;
+		if (v < INT16_MIN)
+			v = INT16_MIN;
+		t->lut_fixed[i] = v;
+	}
+}
+
+#if defined(PLUG417_X86)
+/*
+ *
+ */
+__attribute__((target("avx2")))
+static size_t plug417_temp_convert_avx2(const float *lut, const uint16_t *y16,
+		float *temp, size_t count)
+{
+	__m256i idx;
+	size_t i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		idx = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(y16 + i)));
+		_mm256_storeu_ps(temp + i, _mm256_i32gather_ps(lut, idx, 4));
+	}
+	return i;
+}
+#endif
+
+/*
+ * Whole frame conversion is one table load per pixel
+ */
+void plug417_temp_convert(const struct plug417_temp *t, const uint16_t *y16,
+		float *temp, size_t count)
+{
+	const float *lut = t->lut;
+	size_t i = 0;
+
+#if defined(PLUG417_X86)
+	if (__builtin_cpu_supports("avx2"))
+		i = plug417_temp_convert_avx2(lut, y16, temp, count);
+#endif
+	for (; i + 4 <= count; i += 4) {
+		temp[i] = lut[y16[i]];
+		temp[i + 1] = lut[y16[i + 1]];
+		temp[i + 2] = lut[y16[i + 2]];
+		temp[i + 3] = lut[y16[i + 3]];
+	}
+	for (; i < count; i++)
+		temp[i] = lut[y16[i]];
+}
+
+/*
+ *
+ */
+void plug417_temp_convert_fixed(const struct plug417_temp *t, const uint16_t *y16,
+		int16_t *temp, size_t count)
+{
+	const int16_t *lut = t->lut_fixed;
+	size_t i;
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		temp[i] = lut[y16[i]];
+		temp[i + 1] = lut[y16[i + 1]];
+		temp[i + 2] = lut[y16[i + 2]];
+		temp[i + 3] = lut[y16[i + 3]];
+	}
+	for (; i < count; i++)
+		temp[i] = lut[y16[i]];
+}
+
+/*
+ * Unit conversion from Kelvin as scale and offset
+ */
+static void plug417_temp_unit_linear(unsigned int unit, float *a, float *b)
+{
+	switch (unit) {
+		case PLUG417_TEMP_UNIT_FAHRENHEIT:
+			*a = 1.8f;
+			*b = -KELVIN * 1.8 + 32.0;
+			break;
+		case PLUG417_TEMP_UNIT_KELVIN:
+			*a = 1.0f;
+			*b = 0.0f;
+			break;
+		default:
+			*a = 1.0f;
+			*b = -KELVIN;
+			break;
+	}
+}
+
+/*
+ * Material 0 uses settings, which also select the output unit
+ */
+struct plug417_radiometry *plug417_radiometry_alloc(unsigned int width, unsigned int height,
+		const struct plug417_temp_settings *settings)
+{
+	struct plug417_radiometry *r;
+	double t;
+	int i;
+
+	if (posix_memalign((void **)&r, PLUG417_CACHE_LINE, sizeof(struct plug417_radiometry)))
+		return NULL;
+
+	memset(r, 0, sizeof(struct plug417_radiometry));
+	r->width = width;
+	r->height = height;
+	r->unit = settings->unit;
+	r->map = calloc((size_t)width * height, 1);
+	if (!r->map || r->unit > PLUG417_TEMP_UNIT_MAX ||
+			plug417_radiometry_material(r, settings) < 0) {
+		plug417_radiometry_free(r);
+		return NULL;
+	}
+
+	for (i = 0; i < PLUG417_TEMP_LUT_SIZE; i++) {
+		t = (double)(int16_t)i / PLUG417_TEMP_Y16_SCALE + KELVIN;
+		r->radiance[i] = t * t * t * t;
+	}
+	return r;
+}
+
+/*
+ *
+ */
+void plug417_radiometry_free(struct plug417_radiometry *r)
+{
+	free(r->map);
+	free(r);
+}
+
+/*
+ * Object radiance is (apparent - offset) * scale, as in
+ * plug417_temp_compensate()
+ */
+int plug417_radiometry_set(struct plug417_radiometry *r, unsigned int material,
+		const struct plug417_temp_settings *settings)
+{
+	double tau, t_refl, w_refl, e;
+
+	if (material >= r->count || settings->emissivity > 100 || settings->humidity > 100)
+		return -1;
+
+	tau = plug417_temp_transmission(settings);
+	t_refl = (double)settings->reflected / PLUG417_TEMP_Y16_SCALE + KELVIN;
+	w_refl = t_refl * t_refl * t_refl * t_refl;
+	e = settings->emissivity ? settings->emissivity / 100.0 : 1.0;
+
+	r->materials[material] = *settings;
+	r->offset[material] = (1.0 - e) * tau * w_refl + (1.0 - tau) * w_refl;
+	r->scale[material] = 1.0 / (e * tau);
+	return 0;
+}
+
+/*
+ * Returns the index of the new material, the unit of settings is ignored
+ */
+int plug417_radiometry_material(struct plug417_radiometry *r,
+		const struct plug417_temp_settings *settings)
+{
+	if (r->count == PLUG417_TEMP_MATERIALS_MAX)
+		return -1;
+
+	r->count++;
+	if (plug417_radiometry_set(r, r->count - 1, settings) < 0) {
+		r->count--;
+		return -1;
+	}
+	return r->count - 1;
+}
+
+/*
+ * NULL roi assigns the whole frame
+ */
+int plug417_radiometry_assign(struct plug417_radiometry *r, const struct plug417_roi *roi,
+		unsigned int material)
+{
+	struct plug417_video_frame f;
+	struct plug417_roi a;
+	unsigned int y;
+
+	if (material >= r->count)
+		return -1;
+
+	memset(&f, 0, sizeof(struct plug417_video_frame));
+	f.width = r->width;
+	f.height = r->height;
+	if (plug417_video_roi(&f, roi, &a) < 0)
+		return -1;
+
+	for (y = a.y; y < a.y + a.height; y++)
+		memset(r->map + (size_t)y * r->width + a.x, material, a.width);
+	return 0;
+}
+
+/*
+ *
+ */
+float plug417_radiometry_pixel(const struct plug417_radiometry *r, uint16_t y16,
+		unsigned int material)
+{
+	float a, b, w;
+
+	if (material >= r->count)
+		material = 0;
+
+	plug417_temp_unit_linear(r->unit, &a, &b);
+	w = (r->radiance[y16] - r->offset[material]) * r->scale[material];
+	return (w > 0.0f ? sqrtf(sqrtf(w)) : 0.0f) * a + b;
+}
+
+#if defined(PLUG417_X86)
+/*
+ *
+ */
+__attribute__((target("avx2")))
+static unsigned int plug417_radiometry_row_avx2(const struct plug417_radiometry *r,
+		const uint16_t *y16, const uint8_t *map, float *temp, unsigned int n,
+		float a, float b)
+{
+	const __m256 va = _mm256_set1_ps(a), vb = _mm256_set1_ps(b);
+	const __m256 zero = _mm256_setzero_ps();
+	__m256i idx, mat;
+	__m256 w;
+	unsigned int x;
+
+	for (x = 0; x + 8 <= n; x += 8) {
+		idx = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(y16 + x)));
+		mat = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(map + x)));
+		w = _mm256_i32gather_ps(r->radiance, idx, 4);
+		w = _mm256_sub_ps(w, _mm256_i32gather_ps(r->offset, mat, 4));
+		w = _mm256_mul_ps(w, _mm256_i32gather_ps(r->scale, mat, 4));
+		w = _mm256_sqrt_ps(_mm256_sqrt_ps(_mm256_max_ps(w, zero)));
+		_mm256_storeu_ps(temp + x, _mm256_add_ps(_mm256_mul_ps(w, va), vb));
+	}
+	return x;
+}
+#endif
+
+#if defined(PLUG417_SSE2)
+/*
+ * No gather before AVX2, the loads stay scalar and the roots are vectored
+ */
+static unsigned int plug417_radiometry_row_sse2(const struct plug417_radiometry *r,
+		const uint16_t *y16, const uint8_t *map, float *temp, unsigned int n,
+		float a, float b)
+{
+	const __m128 va = _mm_set1_ps(a), vb = _mm_set1_ps(b);
+	const __m128 zero = _mm_setzero_ps();
+	__m128 w;
+	unsigned int x;
+
+	for (x = 0; x + 4 <= n; x += 4) {
+		w = _mm_setr_ps(r->radiance[y16[x]], r->radiance[y16[x + 1]],
+				r->radiance[y16[x + 2]], r->radiance[y16[x + 3]]);
+		w = _mm_sub_ps(w, _mm_setr_ps(r->offset[map[x]], r->offset[map[x + 1]],
+				r->offset[map[x + 2]], r->offset[map[x + 3]]));
+		w = _mm_mul_ps(w, _mm_setr_ps(r->scale[map[x]], r->scale[map[x + 1]],
+				r->scale[map[x + 2]], r->scale[map[x + 3]]));
+		w = _mm_sqrt_ps(_mm_sqrt_ps(_mm_max_ps(w, zero)));
+		_mm_storeu_ps(temp + x, _mm_add_ps(_mm_mul_ps(w, va), vb));
+	}
+	return x;
+}
+#elif defined(PLUG417_NEON)
+/*
+ * ARMv7 has no vector square root, the reciprocal estimate is refined by
+ * two Newton steps to about full float precision
+ */
+static inline float32x4_t plug417_radiometry_sqrt(float32x4_t v)
+{
+#if defined(__aarch64__)
+	return vsqrtq_f32(v);
+#else
+	float32x4_t e = vrsqrteq_f32(v);
+
+	e = vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(v, e), e));
+	e = vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(v, e), e));
+	/* Estimate of 0 is infinite, the root stays 0 */
+	return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(vmulq_f32(v, e)),
+			vcgtq_f32(v, vdupq_n_f32(0.0f))));
+#endif
+}
+
+/*
+ * No gather, the loads stay scalar and the roots are vectored
+ */
+static unsigned int plug417_radiometry_row_neon(const struct plug417_radiometry *r,
+		const uint16_t *y16, const uint8_t *map, float *temp, unsigned int n,
+		float a, float b)
+{
+	const float32x4_t va = vdupq_n_f32(a), vb = vdupq_n_f32(b);
+	float rad[4], off[4], sc[4];
+	float32x4_t w;
+	unsigned int x, i;
+
+	for (x = 0; x + 4 <= n; x += 4) {
+		for (i = 0; i < 4; i++) {
+			rad[i] = r->radiance[y16[x + i]];
+			off[i] = r->offset[map[x + i]];
+			sc[i] = r->scale[map[x + i]];
+		}
+		w = vmulq_f32(vsubq_f32(vld1q_f32(rad), vld1q_f32(off)), vld1q_f32(sc));
+		w = vmaxq_f32(w, vdupq_n_f32(0.0f));
+		w = plug417_radiometry_sqrt(plug417_radiometry_sqrt(w));
+		vst1q_f32(temp + x, vmlaq_f32(vb, w, va));
+	}
+	return x;
+}
+#endif
+
+/*
+ * Every pixel with the material it was assigned, temp_stride in floats
+ */
+int plug417_radiometry_convert(const struct plug417_radiometry *r,
+		const struct plug417_video_frame *f, float *temp, unsigned int temp_stride)
+{
+	const uint16_t *y16;
+	const uint8_t *map;
+	unsigned int x, y;
+	float a, b, w, *t;
+
+	if (!f->y16 || f->width != r->width || f->height != r->height)
+		return -1;
+
+	plug417_temp_unit_linear(r->unit, &a, &b);
+
+	for (y = 0; y < f->height; y++) {
+		y16 = f->y16 + (size_t)y * f->stride;
+		map = r->map + (size_t)y * r->width;
+		t = temp + (size_t)y * temp_stride;
+		x = 0;
+#if defined(PLUG417_X86)
+		if (__builtin_cpu_supports("avx2"))
+			x = plug417_radiometry_row_avx2(r, y16, map, t, f->width, a, b);
+#endif
+#if defined(PLUG417_SSE2)
+		x += plug417_radiometry_row_sse2(r, y16 + x, map + x, t + x, f->width - x, a, b);
+#elif defined(PLUG417_NEON)
+		x = plug417_radiometry_row_neon(r, y16, map, t, f->width, a, b);
+#endif
+		for (; x < f->width; x++) {
+			w = (r->radiance[y16[x]] - r->offset[map[x]]) * r->scale[map[x]];
+			t[x] = (w > 0.0f ? sqrtf(sqrtf(w)) : 0.0f) * a + b;
+		}
+	}
+	return 0;
+}
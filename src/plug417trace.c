@@ -0,0 +1,223 @@
+/*
+ * plug417 lock free binary trace ring
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "plug417trace.h"
+
+static struct plug417_trace_header *trace_header;
+static struct plug417_trace_record *trace_ring;
+static uint32_t trace_mask;
+static size_t trace_map_size;
+static int trace_fd = -1;
+
+static const char *plug417_trace_event_name[] = {
+	"NONE",
+	"TX",
+	"RX",
+	"HANDSHAKE_OK",
+	"HANDSHAKE_ERROR",
+	"TIMEOUT",
+	"CHECKSUM",
+	"RESYNC",
+	"READ",
+};
+
+/*
+ * Ring lives in a shared file mapping when path is given, so it
+ * survives the process and can be formatted offline
+ */
+int plug417_trace_open(const char *path, unsigned int records)
+{
+	struct plug417_trace_header *h;
+	unsigned int n = 1;
+	size_t size;
+	void *p;
+	int fd = -1;
+
+	if (trace_ring)
+		return -1;
+
+	if (records == 0)
+		records = PLUG417_TRACE_RECORDS;
+
+	while (n < records)
+		n <<= 1;
+
+	size = sizeof(struct plug417_trace_header) +
+		(size_t)n * sizeof(struct plug417_trace_record);
+
+	if (path) {
+		fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0)
+			return -1;
+
+		if (ftruncate(fd, size) < 0) {
+			close(fd);
+			return -1;
+		}
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	} else {
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	}
+
+	if (p == MAP_FAILED) {
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	h = p;
+	memset(h, 0, sizeof(struct plug417_trace_header));
+	memcpy(h->magic, PLUG417_TRACE_MAGIC, sizeof(h->magic));
+	h->version = PLUG417_TRACE_VERSION;
+	h->records = n;
+
+	trace_fd = fd;
+	trace_map_size = size;
+	trace_mask = n - 1;
+	trace_header = h;
+	__atomic_store_n(&trace_ring, (struct plug417_trace_record *)(h + 1),
+			__ATOMIC_RELEASE);
+	return 0;
+}
+
+/*
+ * Writers must be stopped before the ring is closed
+ */
+void plug417_trace_close(void)
+{
+	if (!trace_ring)
+		return;
+
+	__atomic_store_n(&trace_ring, NULL, __ATOMIC_RELEASE);
+	munmap(trace_header, trace_map_size);
+	if (trace_fd >= 0)
+		close(trace_fd);
+
+	trace_header = NULL;
+	trace_fd = -1;
+}
+
+/*
+ * Claim a slot with one atomic add, publish it with the sequence store
+ */
+void plug417_trace_write(unsigned int event, const void *buf, unsigned int len)
+{
+	struct plug417_trace_record *ring, *r;
+	uint64_t pos;
+
+	ring = __atomic_load_n(&trace_ring, __ATOMIC_ACQUIRE);
+	if (!ring)
+		return;
+
+	pos = __atomic_fetch_add(&trace_header->head, 1, __ATOMIC_RELAXED);
+	r = &ring[pos & trace_mask];
+
+	__atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	r->event = event;
+	r->len = len;
+	r->timestamp = plug417_clock_ns();
+	if (len > PLUG417_TRACE_DATA_SIZE)
+		len = PLUG417_TRACE_DATA_SIZE;
+	if (len)
+		memcpy(r->data, buf, len);
+
+	__atomic_store_n(&r->seq, (uint32_t)(pos + 1), __ATOMIC_RELEASE);
+}
+
+/*
+ *
+ */
+static void plug417_trace_print(const struct plug417_trace_record *r,
+		uint64_t prev, FILE *out)
+{
+	char line[64 + PLUG417_TRACE_DATA_SIZE * 3 + 8];
+	unsigned int i, n, len;
+
+	len = r->len > PLUG417_TRACE_DATA_SIZE ? PLUG417_TRACE_DATA_SIZE : r->len;
+
+	n = snprintf(line, sizeof(line), "%" PRIu64 ".%09" PRIu64 " +%.6f %-15s %3u:",
+			(uint64_t)(r->timestamp / 1000000000ULL),
+			(uint64_t)(r->timestamp % 1000000000ULL),
+			prev ? (r->timestamp - prev) / 1e9 : 0.0,
+			r->event > PLUG417_TRACE_EVENT_MAX ? "UNKNOWN" :
+			plug417_trace_event_name[r->event], r->len);
+
+	for (i = 0; i < len; i++)
+		n += snprintf(line + n, sizeof(line) - n, " %02x", r->data[i]);
+
+	if (r->len > len)
+		n += snprintf(line + n, sizeof(line) - n, " ...");
+
+	fprintf(out, "%s\n", line);
+}
+
+/*
+ * Offline formatter, records not yet published are skipped
+ */
+int plug417_trace_dump(const char *path, FILE *out)
+{
+	const struct plug417_trace_header *h;
+	const struct plug417_trace_record *ring;
+	struct plug417_trace_record r;
+	uint64_t head, pos, prev = 0;
+	struct stat st;
+	uint32_t mask;
+	void *p;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st) < 0 || st.st_size < sizeof(struct plug417_trace_header)) {
+		close(fd);
+		return -1;
+	}
+
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return -1;
+
+	h = p;
+	if (memcmp(h->magic, PLUG417_TRACE_MAGIC, sizeof(h->magic)) ||
+			h->version != PLUG417_TRACE_VERSION ||
+			h->records == 0 || (h->records & (h->records - 1)) ||
+			sizeof(struct plug417_trace_header) + (size_t)h->records *
+			sizeof(struct plug417_trace_record) > st.st_size) {
+		munmap(p, st.st_size);
+		return -1;
+	}
+
+	ring = (const struct plug417_trace_record *)(h + 1);
+	mask = h->records - 1;
+	head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+	pos = head > h->records ? head - h->records : 0;
+
+	for (; pos < head; pos++) {
+		memcpy(&r, &ring[pos & mask], sizeof(r));
+		if (r.seq != (uint32_t)(pos + 1) ||
+				__atomic_load_n(&ring[pos & mask].seq,
+					__ATOMIC_ACQUIRE) != r.seq)
+			continue;
+
+		plug417_trace_print(&r, prev, out);
+		prev = r.timestamp;
+	}
+
+	munmap(p, st.st_size);
+	return 0;
+}
@@ -0,0 +1,482 @@
+/*
+ * plug417 digital video frame ingestion, V4L2 device or raw capture file
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <linux/videodev2.h>
+
+#include "plug417serial.h"
+#include "plug417trace.h"
+#include "plug417video.h"
+#include "plug417simd.h"
+
+/*
+ *
+ */
+int plug417_video_resolution(unsigned int resolution, unsigned int *width,
+		unsigned int *height)
+{
+	static const uint16_t res[][2] = {
+		[PLUG417_VIDEO_400_300] = {400, 300},
+		[PLUG417_VIDEO_384_288] = {384, 288},
+		[PLUG417_VIDEO_360_288] = {360, 288},
+		[PLUG417_VIDEO_320_240] = {320, 240},
+		[PLUG417_VIDEO_360_240] = {360, 240},
+		[PLUG417_VIDEO_160_120] = {160, 120},
+	};
+
+	if (resolution >= sizeof(res) / sizeof(res[0]))
+		return -1;
+
+	*width = res[resolution][0];
+	*height = res[resolution][1];
+	return 0;
+}
+
+/*
+ *
+ */
+static void plug417_video_layout_lines(struct plug417_video_layout *l,
+		unsigned int line_size)
+{
+	l->line_size = line_size;
+	l->param_offset = 0;
+	l->y16_offset = (size_t)l->param_lines * line_size;
+	l->yuv_offset = l->y16_offset + (size_t)l->y16_lines * line_size;
+	l->frame_size = l->yuv_offset + (size_t)l->yuv_lines * line_size;
+}
+
+/*
+ * Digital port content is described in PLUG417_DIGITAL_FORMAT_*
+ */
+int plug417_video_layout(unsigned int resolution, unsigned int format,
+		struct plug417_video_layout *l)
+{
+	memset(l, 0, sizeof(struct plug417_video_layout));
+
+	if (plug417_video_resolution(resolution, &l->width, &l->height) < 0)
+		return -1;
+
+	switch (format) {
+		case PLUG417_DIGITAL_FORMAT_YUV422:
+			l->yuv_lines = l->height;
+			break;
+		case PLUG417_DIGITAL_FORMAT_YUV422_PARAM_LINE:
+			l->param_lines = 1;
+			l->yuv_lines = l->height;
+			break;
+		case PLUG417_DIGITAL_FORMAT_YUV16:
+			l->y16_lines = l->height;
+			break;
+		case PLUG417_DIGITAL_FORMAT_YUV16_PARAM_LINE:
+			l->param_lines = 1;
+			l->y16_lines = l->height;
+			break;
+		case PLUG417_DIGITAL_FORMAT_Y16_YUV422:
+			l->y16_lines = l->height;
+			l->yuv_lines = l->height;
+			break;
+		case PLUG417_DIGITAL_FORMAT_Y16_PARAM_LINE_YUV422:
+			l->param_lines = 1;
+			l->y16_lines = l->height;
+			l->yuv_lines = l->height;
+			break;
+		default:
+			return -1;
+	}
+
+	plug417_video_layout_lines(l, l->width * 2);
+	return 0;
+}
+
+/*
+ * In place 16 bit byte swap
+ */
+void plug417_video_swap16(uint16_t *buf, size_t count)
+{
+	size_t i = 0;
+
+#if defined(PLUG417_SSE2)
+	for (; i + 8 <= count; i += 8) {
+		__m128i v = _mm_loadu_si128((__m128i *)(buf + i));
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		_mm_storeu_si128((__m128i *)(buf + i), v);
+	}
+#elif defined(PLUG417_NEON)
+	for (; i + 8 <= count; i += 8) {
+		uint8x16_t v = vld1q_u8((uint8_t *)(buf + i));
+		vst1q_u8((uint8_t *)(buf + i), vrev16q_u8(v));
+	}
+#endif
+	for (; i < count; i++)
+		buf[i] = __builtin_bswap16(buf[i]);
+}
+
+/*
+ * Checks roi against the frame, NULL selects the whole frame
+ */
+int plug417_video_roi(const struct plug417_video_frame *f, const struct plug417_roi *roi,
+		struct plug417_roi *r)
+{
+	if (!roi) {
+		r->x = 0;
+		r->y = 0;
+		r->width = f->width;
+		r->height = f->height;
+		return 0;
+	}
+
+	if (!roi->width || !roi->height || roi->x >= f->width || roi->y >= f->height ||
+			roi->width > f->width - roi->x || roi->height > f->height - roi->y)
+		return -1;
+
+	*r = *roi;
+	return 0;
+}
+
+/*
+ * CMOS16 words are native, CMOS8 carries two bytes per pixel in the
+ * configured order
+ */
+static int plug417_video_need_swap(struct plug417_video *v)
+{
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+	return v->interface == PLUG417_DIGITAL_INTERFACE_CMOS8_MSB;
+#else
+	return v->interface == PLUG417_DIGITAL_INTERFACE_CMOS8_LSB;
+#endif
+}
+
+/*
+ * Frame points straight into the capture buffer
+ */
+static void plug417_video_frame_setup(struct plug417_video *v,
+		struct plug417_video_frame *f, uint8_t *base)
+{
+	struct plug417_video_layout *l = &v->layout;
+
+	f->param = l->param_lines ? (uint16_t *)(base + l->param_offset) : NULL;
+	f->y16 = l->y16_lines ? (uint16_t *)(base + l->y16_offset) : NULL;
+	f->yuv = l->yuv_lines ? base + l->yuv_offset : NULL;
+	f->width = l->width;
+	f->height = l->height;
+	f->stride = l->line_size / 2;
+
+	if (plug417_video_need_swap(v)) {
+		plug417_video_swap16((uint16_t *)(base + l->param_offset),
+				(size_t)(l->param_lines + l->y16_lines) * f->stride);
+	}
+
+	if (f->param)
+		plug417_param_decode(f->param, f->width, f->height, &f->info);
+	else
+		memset(&f->info, 0, sizeof(struct plug417_param));
+}
+
+/*
+ *
+ */
+static int plug417_video_v4l2_setup(struct plug417_video *v, unsigned int buffers)
+{
+	struct plug417_video_layout *l = &v->layout;
+	struct v4l2_capability cap;
+	struct v4l2_format fmt;
+	struct v4l2_requestbuffers req;
+	struct v4l2_buffer buf;
+	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	uint32_t caps;
+	int cmos8 = v->interface != PLUG417_DIGITAL_INTERFACE_CMOS16;
+	int i;
+
+	if (ioctl(v->fd, VIDIOC_QUERYCAP, &cap) < 0)
+		return -1;
+
+	caps = cap.capabilities & V4L2_CAP_DEVICE_CAPS ?
+		cap.device_caps : cap.capabilities;
+	if (!(caps & V4L2_CAP_VIDEO_CAPTURE) || !(caps & V4L2_CAP_STREAMING))
+		return -1;
+
+	/* CMOS8 bridges deliver two 8 bit samples per pixel */
+	memset(&fmt, 0, sizeof(fmt));
+	fmt.type = type;
+	fmt.fmt.pix.width = cmos8 ? l->width * 2 : l->width;
+	fmt.fmt.pix.height = l->param_lines + l->y16_lines + l->yuv_lines;
+	fmt.fmt.pix.pixelformat = cmos8 ? V4L2_PIX_FMT_GREY : V4L2_PIX_FMT_Y16;
+	fmt.fmt.pix.field = V4L2_FIELD_NONE;
+
+	if (ioctl(v->fd, VIDIOC_S_FMT, &fmt) < 0)
+		return -1;
+
+	if (fmt.fmt.pix.bytesperline < l->width * 2 ||
+			fmt.fmt.pix.height < l->param_lines + l->y16_lines + l->yuv_lines)
+		return -1;
+
+	plug417_video_layout_lines(l, fmt.fmt.pix.bytesperline);
+
+	memset(&req, 0, sizeof(req));
+	req.count = buffers;
+	req.type = type;
+	req.memory = V4L2_MEMORY_MMAP;
+	if (ioctl(v->fd, VIDIOC_REQBUFS, &req) < 0 || req.count < 2)
+		return -1;
+
+	if (req.count > PLUG417_VIDEO_BUFFERS_MAX)
+		req.count = PLUG417_VIDEO_BUFFERS_MAX;
+
+	for (i = 0; i < req.count; i++) {
+		memset(&buf, 0, sizeof(buf));
+		buf.type = type;
+		buf.memory = V4L2_MEMORY_MMAP;
+		buf.index = i;
+		if (ioctl(v->fd, VIDIOC_QUERYBUF, &buf) < 0)
+			return -1;
+
+		if (buf.length < l->frame_size)
+			return -1;
+
+		v->map[i] = mmap(NULL, buf.length, PROT_READ | PROT_WRITE,
+				MAP_SHARED, v->fd, buf.m.offset);
+		if (v->map[i] == MAP_FAILED) {
+			v->map[i] = NULL;
+			return -1;
+		}
+		v->map_size[i] = buf.length;
+		v->frames[i].index = i;
+		v->count++;
+
+		if (ioctl(v->fd, VIDIOC_QBUF, &buf) < 0)
+			return -1;
+	}
+
+	return ioctl(v->fd, VIDIOC_STREAMON, &type);
+}
+
+/*
+ * Whole capture file is mapped, frames are never copied. Private mapping
+ * keeps the file intact when CMOS8 byte order is fixed up in place.
+ */
+static int plug417_video_file_setup(struct plug417_video *v, unsigned int buffers,
+		size_t size)
+{
+	int i;
+
+	if (size < v->layout.frame_size)
+		return -1;
+
+	v->file = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, v->fd, 0);
+	if (v->file == MAP_FAILED) {
+		v->file = NULL;
+		return -1;
+	}
+	madvise(v->file, size, MADV_SEQUENTIAL);
+	v->file_size = size;
+
+	if (buffers > PLUG417_VIDEO_BUFFERS_MAX)
+		buffers = PLUG417_VIDEO_BUFFERS_MAX;
+
+	for (i = 0; i < buffers; i++)
+		v->frames[i].index = i;
+	v->count = buffers;
+
+	return 0;
+}
+
+/*
+ *
+ */
+struct plug417_video *plug417_video_open(const char *path, unsigned int resolution,
+		unsigned int format, unsigned int interface, unsigned int buffers)
+{
+	struct plug417_video *v;
+	struct stat st;
+	int err;
+
+	if (interface > PLUG417_DIGITAL_INTERFACE_MAX)
+		return NULL;
+
+	if (buffers == 0)
+		buffers = PLUG417_VIDEO_BUFFERS;
+
+	v = malloc(sizeof(struct plug417_video));
+	if (!v)
+		return NULL;
+
+	memset(v, 0, sizeof(struct plug417_video));
+	v->resolution = resolution;
+	v->format = format;
+	v->interface = interface;
+
+	if (plug417_video_layout(resolution, format, &v->layout) < 0) {
+		free(v);
+		return NULL;
+	}
+
+	v->fd = open(path, O_RDWR | O_NONBLOCK);
+	if (v->fd < 0)
+		v->fd = open(path, O_RDONLY);
+	if (v->fd < 0) {
+		free(v);
+		return NULL;
+	}
+
+	if (fstat(v->fd, &st) < 0) {
+		plug417_video_close(v);
+		return NULL;
+	}
+
+	if (S_ISCHR(st.st_mode)) {
+		v->source = PLUG417_VIDEO_SOURCE_V4L2;
+		err = plug417_video_v4l2_setup(v, buffers);
+	} else {
+		v->source = PLUG417_VIDEO_SOURCE_FILE;
+		err = plug417_video_file_setup(v, buffers, st.st_size);
+	}
+
+	if (err < 0) {
+		plug417_video_close(v);
+		return NULL;
+	}
+	return v;
+}
+
+/*
+ *
+ */
+void plug417_video_close(struct plug417_video *v)
+{
+	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	int i;
+
+	if (v->source == PLUG417_VIDEO_SOURCE_V4L2) {
+		if (v->count)
+			ioctl(v->fd, VIDIOC_STREAMOFF, &type);
+		for (i = 0; i < v->count; i++) {
+			if (v->map[i])
+				munmap(v->map[i], v->map_size[i]);
+		}
+	} else if (v->file) {
+		munmap(v->file, v->file_size);
+	}
+
+	if (v->fd >= 0)
+		close(v->fd);
+	free(v);
+}
+
+/*
+ *
+ */
+static int plug417_video_v4l2_dequeue(struct plug417_video *v,
+		struct plug417_video_frame **frame, int timeout)
+{
+	struct plug417_video_frame *f;
+	struct v4l2_buffer buf;
+	struct pollfd pfd;
+	int n;
+
+	pfd.fd = v->fd;
+	pfd.events = POLLIN;
+	n = poll(&pfd, 1, timeout);
+	if (n <= 0) {
+		if (n == 0)
+			errno = ETIMEDOUT;
+		return -1;
+	}
+
+	memset(&buf, 0, sizeof(buf));
+	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.memory = V4L2_MEMORY_MMAP;
+	if (ioctl(v->fd, VIDIOC_DQBUF, &buf) < 0)
+		return -1;
+
+	f = &v->frames[buf.index];
+	plug417_video_frame_setup(v, f, v->map[buf.index]);
+	f->sequence = buf.sequence;
+	f->timestamp = buf.timestamp.tv_sec * 1000000000ULL +
+		buf.timestamp.tv_usec * 1000ULL;
+
+	*frame = f;
+	return 0;
+}
+
+/*
+ *
+ */
+static int plug417_video_file_dequeue(struct plug417_video *v,
+		struct plug417_video_frame **frame)
+{
+	struct plug417_video_frame *f;
+	int i;
+
+	if (v->file_pos + v->layout.frame_size > v->file_size)
+		return 1;
+
+	for (i = 0; i < v->count; i++) {
+		if (!(v->busy & (1U << i)))
+			break;
+	}
+	if (i == v->count) {
+		errno = ENOBUFS;
+		return -1;
+	}
+
+	f = &v->frames[i];
+	plug417_video_frame_setup(v, f, v->file + v->file_pos);
+	f->sequence = v->sequence++;
+	f->timestamp = plug417_clock_ns();
+	v->file_pos += v->layout.frame_size;
+
+	*frame = f;
+	return 0;
+}
+
+/*
+ * Returns 0 with a frame, 1 at end of capture file, -1 on error
+ */
+int plug417_video_dequeue(struct plug417_video *v, struct plug417_video_frame **frame,
+		int timeout)
+{
+	int err;
+
+	if (v->source == PLUG417_VIDEO_SOURCE_V4L2)
+		err = plug417_video_v4l2_dequeue(v, frame, timeout);
+	else
+		err = plug417_video_file_dequeue(v, frame);
+
+	if (err == 0)
+		v->busy |= 1U << (*frame)->index;
+
+	return err;
+}
+
+/*
+ * Return frame buffer to the pool
+ */
+int plug417_video_queue(struct plug417_video *v, struct plug417_video_frame *frame)
+{
+	struct v4l2_buffer buf;
+
+	if (frame->index >= v->count || !(v->busy & (1U << frame->index)))
+		return -1;
+
+	v->busy &= ~(1U << frame->index);
+
+	if (v->source != PLUG417_VIDEO_SOURCE_V4L2)
+		return 0;
+
+	memset(&buf, 0, sizeof(buf));
+	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.memory = V4L2_MEMORY_MMAP;
+	buf.index = frame->index;
+	return ioctl(v->fd, VIDIOC_QBUF, &buf);
+}
@@ -0,0 +1,403 @@
+/*
+ * plug417 BT.656 stream decoding and YUV422 conversion
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "plug417yuv.h"
+#include "plug417simd.h"
+
+/*
+ * BT.601 studio range to RGB in Q8, scaled by 4 for the 16 bit high
+ * multiply on (value << 6). Scalar code does the same rounding so all
+ * paths give identical pixels.
+ */
+#define KY	(298 * 4)
+#define KRV	(409 * 4)
+#define KGU	(100 * 4)
+#define KGV	(208 * 4)
+#define KBU	(516 * 4)
+
+/*
+ *
+ */
+struct plug417_bt656 *plug417_bt656_alloc(unsigned int resolution, int interlaced)
+{
+	struct plug417_bt656 *p;
+	unsigned int w, h;
+
+	if (plug417_video_resolution(resolution, &w, &h) < 0 || (interlaced && (h & 1)))
+		return NULL;
+
+	p = malloc(sizeof(struct plug417_bt656));
+	if (!p)
+		return NULL;
+
+	memset(p, 0, sizeof(struct plug417_bt656));
+	p->width = w;
+	p->height = h;
+	p->interlaced = interlaced;
+	p->frame = malloc((size_t)w * h * 2);
+	if (!p->frame) {
+		free(p);
+		return NULL;
+	}
+	return p;
+}
+
+/*
+ *
+ */
+void plug417_bt656_free(struct plug417_bt656 *p)
+{
+	free(p->frame);
+	free(p);
+}
+
+/*
+ * Timing reference XY = 1 F V H P3 P2 P1 P0
+ */
+static int plug417_bt656_xy_valid(uint8_t xy)
+{
+	unsigned int f = (xy >> 6) & 1, v = (xy >> 5) & 1, h = (xy >> 4) & 1;
+	unsigned int p = ((v ^ h) << 3) | ((f ^ h) << 2) | ((f ^ v) << 1) | (f ^ v ^ h);
+
+	return (xy & 0x80) && (xy & 0x0f) == p;
+}
+
+/*
+ * Start of vertical blanking, returns 1 when a whole frame was received
+ */
+static int plug417_bt656_vblank(struct plug417_bt656 *p)
+{
+	int done = 0;
+
+	if (!p->interlaced) {
+		done = p->lines[0] == p->height;
+		if (!done && p->lines[0])
+			p->errors++;
+		p->lines[0] = 0;
+		return done;
+	}
+
+	/* Frame ends with the second field */
+	if (p->field == 1) {
+		done = p->lines[0] == p->height / 2 && p->lines[1] == p->height / 2;
+		if (!done && (p->lines[0] || p->lines[1]))
+			p->errors++;
+		p->lines[0] = 0;
+		p->lines[1] = 0;
+	}
+	return done;
+}
+
+/*
+ *
+ */
+static int plug417_bt656_sav(struct plug417_bt656 *p, unsigned int f)
+{
+	unsigned int y;
+
+	if (p->interlaced) {
+		y = p->lines[f] * 2 + f;
+		p->lines[f]++;
+	} else {
+		y = p->lines[0]++;
+	}
+
+	if (y >= p->height) {
+		p->errors++;
+		return -1;
+	}
+
+	p->field = f;
+	p->line = p->frame + (size_t)y * p->width * 2;
+	p->pos = 0;
+	p->state = PLUG417_BT656_ACTIVE;
+	return 0;
+}
+
+/*
+ * Consumes buf up to the end of a frame. Returns 1 with the UYVY picture
+ * in frame, valid until the next call, 0 when all of buf was consumed.
+ */
+int plug417_bt656_parse(struct plug417_bt656 *p, const uint8_t *buf, size_t len,
+		size_t *used)
+{
+	const size_t line_size = (size_t)p->width * 2;
+	const uint8_t *ff;
+	size_t i = 0, n;
+	unsigned int f, v, h;
+	uint8_t b;
+
+	while (i < len) {
+		if (p->state == PLUG417_BT656_ACTIVE) {
+			n = line_size - p->pos < len - i ? line_size - p->pos : len - i;
+			memcpy(p->line + p->pos, buf + i, n);
+			p->pos += n;
+			i += n;
+			if (p->pos == line_size)
+				p->state = PLUG417_BT656_SYNC;
+			continue;
+		}
+
+		/* Blanking, skip to the next preamble */
+		if (p->sync == 0) {
+			ff = memchr(buf + i, 0xff, len - i);
+			if (!ff)
+				break;
+			i = ff - buf + 1;
+			p->sync = 1;
+			continue;
+		}
+
+		b = buf[i++];
+		if (p->sync < 3) {
+			p->sync = b == 0x00 ? p->sync + 1 : b == 0xff;
+			continue;
+		}
+
+		p->sync = 0;
+		if (!plug417_bt656_xy_valid(b)) {
+			p->errors++;
+			continue;
+		}
+
+		f = (b >> 6) & 1;
+		v = (b >> 5) & 1;
+		h = (b >> 4) & 1;
+
+		if (v && !p->vblank) {
+			p->vblank = 1;
+			if (plug417_bt656_vblank(p)) {
+				p->frames++;
+				*used = i;
+				return 1;
+			}
+		}
+		p->vblank = v;
+
+		if (!v && !h)
+			plug417_bt656_sav(p, p->interlaced ? f : 0);
+	}
+
+	*used = len;
+	return 0;
+}
+
+/*
+ *
+ */
+static inline int plug417_yuv_mul(int x, int k)
+{
+	return (x * 64 * k) >> 16;
+}
+
+/*
+ *
+ */
+static inline uint8_t plug417_yuv_clamp(int v)
+{
+	return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+/*
+ *
+ */
+static void plug417_yuv_row_rgb(const uint8_t *s, unsigned int w, int order,
+		uint8_t *d, int format)
+{
+	const unsigned int bpp = format == PLUG417_RGBA ? 4 : 3;
+	unsigned int x = 0, i;
+	int y0, y1, u, v, c, r, g, b;
+	uint8_t *o;
+
+#if defined(PLUG417_SSE2)
+	const __m128i mask = _mm_set1_epi16(0xff);
+	const __m128i k16 = _mm_set1_epi16(16), k128 = _mm_set1_epi16(128);
+	const __m128i alpha = _mm_set1_epi8(-1);
+	__m128i in, vy, vuv, vu, vv, vr, vg, vb, rg, ba;
+	uint8_t tr[16], tg[16], tb[16];
+
+	for (; x + 8 <= w; x += 8) {
+		in = _mm_loadu_si128((const __m128i *)(s + x * 2));
+		if (order == PLUG417_YUV_YUYV) {
+			vy = _mm_and_si128(in, mask);
+			vuv = _mm_srli_epi16(in, 8);
+		} else {
+			vy = _mm_srli_epi16(in, 8);
+			vuv = _mm_and_si128(in, mask);
+		}
+		vu = _mm_shufflehi_epi16(_mm_shufflelo_epi16(vuv, _MM_SHUFFLE(2, 2, 0, 0)),
+				_MM_SHUFFLE(2, 2, 0, 0));
+		vv = _mm_shufflehi_epi16(_mm_shufflelo_epi16(vuv, _MM_SHUFFLE(3, 3, 1, 1)),
+				_MM_SHUFFLE(3, 3, 1, 1));
+
+		vy = _mm_slli_epi16(_mm_sub_epi16(vy, k16), 6);
+		vu = _mm_slli_epi16(_mm_sub_epi16(vu, k128), 6);
+		vv = _mm_slli_epi16(_mm_sub_epi16(vv, k128), 6);
+
+		vy = _mm_mulhi_epi16(vy, _mm_set1_epi16(KY));
+		vr = _mm_add_epi16(vy, _mm_mulhi_epi16(vv, _mm_set1_epi16(KRV)));
+		vg = _mm_sub_epi16(_mm_sub_epi16(vy, _mm_mulhi_epi16(vu, _mm_set1_epi16(KGU))),
+				_mm_mulhi_epi16(vv, _mm_set1_epi16(KGV)));
+		vb = _mm_add_epi16(vy, _mm_mulhi_epi16(vu, _mm_set1_epi16(KBU)));
+
+		vr = _mm_packus_epi16(vr, vr);
+		vg = _mm_packus_epi16(vg, vg);
+		vb = _mm_packus_epi16(vb, vb);
+
+		if (format == PLUG417_RGBA) {
+			rg = _mm_unpacklo_epi8(vr, vg);
+			ba = _mm_unpacklo_epi8(vb, alpha);
+			_mm_storeu_si128((__m128i *)(d + x * 4), _mm_unpacklo_epi16(rg, ba));
+			_mm_storeu_si128((__m128i *)(d + x * 4 + 16), _mm_unpackhi_epi16(rg, ba));
+		} else {
+			_mm_storeu_si128((__m128i *)tr, vr);
+			_mm_storeu_si128((__m128i *)tg, vg);
+			_mm_storeu_si128((__m128i *)tb, vb);
+			for (i = 0, o = d + x * 3; i < 8; i++, o += 3) {
+				o[0] = tr[i];
+				o[1] = tg[i];
+				o[2] = tb[i];
+			}
+		}
+	}
+#elif defined(PLUG417_NEON)
+	const int16x8_t k16 = vdupq_n_s16(16), k128 = vdupq_n_s16(128);
+	int16x8_t c0, c1, du, dv, cr, cg, cb;
+	uint8x8x2_t zr, zg, zb;
+	uint8x16x4_t rgba;
+	uint8x16x3_t rgb;
+	uint8x8x4_t q;
+	uint8x8_t ey, oy, qu, qv;
+
+	/* vqdmulh doubles the product, coefficients are halved */
+	for (; x + 16 <= w; x += 16) {
+		q = vld4_u8(s + x * 2);
+		if (order == PLUG417_YUV_YUYV) {
+			ey = q.val[0];
+			qu = q.val[1];
+			oy = q.val[2];
+			qv = q.val[3];
+		} else {
+			qu = q.val[0];
+			ey = q.val[1];
+			qv = q.val[2];
+			oy = q.val[3];
+		}
+
+		du = vshlq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(qu)), k128), 6);
+		dv = vshlq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(qv)), k128), 6);
+		cr = vqdmulhq_n_s16(dv, KRV / 2);
+		cg = vaddq_s16(vqdmulhq_n_s16(du, KGU / 2), vqdmulhq_n_s16(dv, KGV / 2));
+		cb = vqdmulhq_n_s16(du, KBU / 2);
+
+		c0 = vshlq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(ey)), k16), 6);
+		c1 = vshlq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(oy)), k16), 6);
+		c0 = vqdmulhq_n_s16(c0, KY / 2);
+		c1 = vqdmulhq_n_s16(c1, KY / 2);
+
+		zr = vzip_u8(vqmovun_s16(vaddq_s16(c0, cr)), vqmovun_s16(vaddq_s16(c1, cr)));
+		zg = vzip_u8(vqmovun_s16(vsubq_s16(c0, cg)), vqmovun_s16(vsubq_s16(c1, cg)));
+		zb = vzip_u8(vqmovun_s16(vaddq_s16(c0, cb)), vqmovun_s16(vaddq_s16(c1, cb)));
+
+		if (format == PLUG417_RGBA) {
+			rgba.val[0] = vcombine_u8(zr.val[0], zr.val[1]);
+			rgba.val[1] = vcombine_u8(zg.val[0], zg.val[1]);
+			rgba.val[2] = vcombine_u8(zb.val[0], zb.val[1]);
+			rgba.val[3] = vdupq_n_u8(255);
+			vst4q_u8(d + x * 4, rgba);
+		} else {
+			rgb.val[0] = vcombine_u8(zr.val[0], zr.val[1]);
+			rgb.val[1] = vcombine_u8(zg.val[0], zg.val[1]);
+			rgb.val[2] = vcombine_u8(zb.val[0], zb.val[1]);
+			vst3q_u8(d + x * 3, rgb);
+		}
+	}
+#endif
+	for (; x + 2 <= w; x += 2) {
+		if (order == PLUG417_YUV_YUYV) {
+			y0 = s[x * 2];
+			u = s[x * 2 + 1];
+			y1 = s[x * 2 + 2];
+			v = s[x * 2 + 3];
+		} else {
+			u = s[x * 2];
+			y0 = s[x * 2 + 1];
+			v = s[x * 2 + 2];
+			y1 = s[x * 2 + 3];
+		}
+		u -= 128;
+		v -= 128;
+		r = plug417_yuv_mul(v, KRV);
+		g = plug417_yuv_mul(u, KGU) + plug417_yuv_mul(v, KGV);
+		b = plug417_yuv_mul(u, KBU);
+
+		for (i = 0; i < 2; i++) {
+			c = plug417_yuv_mul((i ? y1 : y0) - 16, KY);
+			o = d + (x + i) * bpp;
+			o[0] = plug417_yuv_clamp(c + r);
+			o[1] = plug417_yuv_clamp(c - g);
+			o[2] = plug417_yuv_clamp(c + b);
+			if (bpp == 4)
+				o[3] = 255;
+		}
+	}
+}
+
+/*
+ * Width must be even
+ */
+void plug417_yuv_to_rgb(const uint8_t *src, unsigned int src_stride, unsigned int width,
+		unsigned int height, int order, uint8_t *dst, unsigned int dst_stride,
+		int format)
+{
+	unsigned int y;
+
+	for (y = 0; y < height; y++)
+		plug417_yuv_row_rgb(src + (size_t)y * src_stride, width, order,
+				dst + (size_t)y * dst_stride, format);
+}
+
+/*
+ * Luma only
+ */
+void plug417_yuv_to_gray(const uint8_t *src, unsigned int src_stride, unsigned int width,
+		unsigned int height, int order, uint8_t *dst, unsigned int dst_stride)
+{
+	const unsigned int off = order == PLUG417_YUV_YUYV ? 0 : 1;
+	unsigned int x, y;
+	const uint8_t *s;
+	uint8_t *d;
+
+	for (y = 0; y < height; y++) {
+		s = src + (size_t)y * src_stride;
+		d = dst + (size_t)y * dst_stride;
+		x = 0;
+#if defined(PLUG417_SSE2)
+		{
+			const __m128i mask = _mm_set1_epi16(0xff);
+			__m128i a, b;
+
+			for (; x + 16 <= width; x += 16) {
+				a = _mm_loadu_si128((const __m128i *)(s + x * 2));
+				b = _mm_loadu_si128((const __m128i *)(s + x * 2 + 16));
+				if (off) {
+					a = _mm_srli_epi16(a, 8);
+					b = _mm_srli_epi16(b, 8);
+				} else {
+					a = _mm_and_si128(a, mask);
+					b = _mm_and_si128(b, mask);
+				}
+				_mm_storeu_si128((__m128i *)(d + x), _mm_packus_epi16(a, b));
+			}
+		}
+#elif defined(PLUG417_NEON)
+		for (; x + 16 <= width; x += 16)
+			vst1q_u8(d + x, vld2q_u8(s + x * 2).val[off]);
+#endif
+		for (; x < width; x++)
+			d[x] = s[x * 2 + off];
+	}
+}